@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2022 The LineageOS Project
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""Checks powerhint.json and writes the copy installed on the device.
+
+libperfmgr rejects the whole config on a single bad action, which leaves
+the power HAL unable to start. Every check it makes at boot is made here at
+build time instead. The installed copy has no whitespace and no Comments,
+which makes it smaller for libperfmgr to read and parse on every HAL
+start.
+"""
+
+import argparse
+import hashlib
+import json
+import sys
+
+
+def check(config):
+    errors = []
+    nodes = {}
+    for node in config.get('Nodes', []):
+        name = node.get('Name')
+        if name in nodes:
+            errors.append(f'node {name}: defined twice')
+        nodes[name] = node
+        values = node.get('Values', [])
+        if not values:
+            errors.append(f'node {name}: no Values')
+        if len(set(values)) != len(values):
+            errors.append(f'node {name}: repeated Values')
+        if not 0 <= node.get('DefaultIndex', 0) < len(values):
+            errors.append(f'node {name}: DefaultIndex out of range')
+
+    for action in config.get('Actions', []):
+        hint = action.get('PowerHint')
+        node = nodes.get(action.get('Node'))
+        if node is None:
+            errors.append(f'{hint}: unknown node {action.get("Node")}')
+            continue
+        if action.get('Value') not in node.get('Values', []):
+            errors.append(f'{hint}: {action.get("Value")} is not a value of {node["Name"]}')
+        duration = action.get('Duration')
+        if not isinstance(duration, int) or duration < 0:
+            errors.append(f'{hint}: bad Duration {duration}')
+
+    profiles = [profile.get('Name') for profile in config.get('AdpfConfig', [])]
+    if len(set(profiles)) != len(profiles):
+        errors.append('AdpfConfig: repeated Name')
+    return errors
+
+
+def compact(config):
+    for node in config.get('Nodes', []):
+        node.pop('Comments', None)
+    return json.dumps(config, separators=(',', ':'))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('input')
+    parser.add_argument('output')
+    parser.add_argument('--stats', action='store_true',
+                        help='print the size and hash of both forms')
+    args = parser.parse_args()
+
+    with open(args.input, 'rb') as f:
+        source = f.read()
+    config = json.loads(source)
+    errors = check(config)
+    for error in errors:
+        print(f'{args.input}: {error}', file=sys.stderr)
+    if errors:
+        return 1
+
+    output = compact(config).encode()
+    with open(args.output, 'wb') as f:
+        f.write(output)
+
+    if args.stats:
+        for label, data in (('source', source), ('compact', output)):
+            print(f'{label}: {len(data)} bytes, sha256 {hashlib.sha256(data).hexdigest()}')
+        print(f'{len(config.get("Nodes", []))} nodes, {len(config.get("Actions", []))} actions')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
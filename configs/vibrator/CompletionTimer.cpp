@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.qti.vibrator.xiaomi_kona"
+
+#include <log/log.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+#include "include/CompletionTimer.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+CompletionTimer::CompletionTimer()
+    : mTimerFd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)), mNextId(1), mStop(false) {
+    if (!mTimerFd.ok())
+        ALOGE("timerfd_create failed, errno = %d", errno);
+    mThread = std::thread([this] { loop(); });
+}
+
+CompletionTimer::~CompletionTimer() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        struct itimerspec spec = {};
+
+        mStop = true;
+        spec.it_value.tv_nsec = 1;
+        timerfd_settime(mTimerFd.get(), 0, &spec, NULL);
+    }
+    mThread.join();
+}
+
+uint64_t CompletionTimer::schedule(std::chrono::milliseconds delay, Task task) {
+    return scheduleAt(Clock::now() + delay, std::move(task));
+}
+
+uint64_t CompletionTimer::scheduleAt(Clock::time_point deadline, Task task) {
+    std::lock_guard<std::mutex> lock(mLock);
+    uint64_t id = mNextId++;
+
+    mQueue[id] = {deadline, std::move(task)};
+    armLocked();
+    return id;
+}
+
+bool CompletionTimer::expedite(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mQueue.find(id);
+
+    if (it == mQueue.end())
+        return false;
+    it->second.deadline = Clock::now();
+    armLocked();
+    return true;
+}
+
+bool CompletionTimer::cancel(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    /* The timerfd stays armed; the thread wakes once and finds nothing due. */
+    return mQueue.erase(id) > 0;
+}
+
+/* should be called while locked */
+void CompletionTimer::armLocked() {
+    struct itimerspec spec = {};
+    auto earliest = std::min_element(mQueue.begin(), mQueue.end(),
+            [](const auto &a, const auto &b) { return a.second.deadline < b.second.deadline; });
+
+    if (earliest != mQueue.end()) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                earliest->second.deadline.time_since_epoch()).count();
+        /* An absolute time already passed fires at once; zero would disarm. */
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = std::max<long>(ns % 1000000000, 1);
+    }
+    if (timerfd_settime(mTimerFd.get(), TFD_TIMER_ABSTIME, &spec, NULL) == -1)
+        ALOGE("timerfd_settime failed, errno = %d", errno);
+}
+
+void CompletionTimer::loop() {
+    pthread_setname_np(pthread_self(), "vibrator-timer");
+
+    while (true) {
+        uint64_t expirations;
+        std::vector<std::tuple<Clock::time_point, uint64_t, Task>> due;
+
+        if (TEMP_FAILURE_RETRY(read(mTimerFd.get(), &expirations, sizeof(expirations))) == -1) {
+            ALOGE("read timerfd failed, errno = %d", errno);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            Clock::time_point now = Clock::now();
+
+            if (mStop)
+                return;
+            for (auto it = mQueue.begin(); it != mQueue.end();) {
+                if (it->second.deadline <= now) {
+                    due.emplace_back(it->second.deadline, it->first, std::move(it->second.task));
+                    it = mQueue.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            armLocked();
+        }
+
+        std::sort(due.begin(), due.end(), [](const auto &a, const auto &b) {
+            return std::tie(std::get<0>(a), std::get<1>(a)) <
+                   std::tie(std::get<0>(b), std::get<1>(b));
+        });
+        for (auto &entry : due)
+            std::get<2>(entry)();
+    }
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
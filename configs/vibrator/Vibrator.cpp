@@ -34,9 +34,10 @@
 #include <inttypes.h>
 #include <linux/input.h>
 #include <log/log.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
-#include <thread>
+#include <algorithm>
 
 #include "include/Vibrator.h"
 #ifdef USE_EFFECT_STREAM
@@ -54,6 +55,9 @@ namespace vibrator {
 #define INVALID_VALUE           -1
 #define CUSTOM_DATA_LEN         3
 #define NAME_BUF_SIZE           32
+#define COMPOSE_DELAY_MAX_MS    10000
+#define COMPOSE_SIZE_MAX        127
+#define AMPLITUDE_INTERVAL_MS   5
 
 #define MSM_CPU_LAHAINA         415
 #define APQ_CPU_LAHAINA         439
@@ -65,41 +69,202 @@ namespace vibrator {
 #define test_bit(bit, array)    ((array)[(bit)/8] & (1<<((bit)%8)))
 
 static const char LED_DEVICE[] = "/sys/class/leds/vibrator";
+static const char INPUT_DIR[] = "/dev/input/";
+static const char SYSFS_INPUT_DIR[] = "/sys/class/input/";
+static const char DEVICE_CACHE[] = "/data/vendor/vibrator/ff_device";
+
+static const char *const HAPTICS_DEVICES[] = {
+    "qcom-hv-haptics",
+    "qti-haptics",
+    "aw8697_haptic",
+    "aw8624_haptic",
+};
+
+static bool is_haptics_device(const char *name) {
+    for (const char *haptics : HAPTICS_DEVICES) {
+        if (!strcmp(name, haptics))
+            return true;
+    }
+    return false;
+}
+
+static bool read_line(FILE *fp, char *buf, size_t size) {
+    if (fgets(buf, size, fp) == NULL)
+        return false;
+
+    buf[strcspn(buf, "\n")] = '\0';
+    return true;
+}
 
 InputFFDevice::InputFFDevice()
+    : InputFFDevice(InputFFPaths{INPUT_DIR, SYSFS_INPUT_DIR, DEVICE_CACHE})
 {
-    DIR *dp;
-    FILE *fp = NULL;
-    struct dirent *dir;
-    uint8_t ffBitmask[FF_CNT / 8];
-    char devicename[PATH_MAX];
-    const char *INPUT_DIR = "/dev/input/";
-    char name[NAME_BUF_SIZE];
-    int fd, ret;
-    int soc = property_get_int32("ro.vendor.qti.soc_id", -1);
+}
 
+/*
+ * The device found on the last start is tried first, then the haptics device
+ * is looked up by name in sysfs, which needs no device node opened. Opening
+ * every node in /dev/input is only the last resort.
+ */
+InputFFDevice::InputFFDevice(const InputFFPaths &paths) : mPaths(paths)
+{
     mVibraFd = INVALID_VALUE;
     mSupportGain = false;
     mSupportEffects = false;
-    mSupportExternalControl = false;
+    mSupportExternalControl = INVALID_VALUE;
     mCurrAppId = INVALID_VALUE;
     mCurrMagnitude = 0x7fff;
+    mCurrGain = INVALID_VALUE;
+    mGainWrites = 0;
     mInExternalControl = false;
+    mLoaded = false;
+    mLoadedEffectId = INVALID_VALUE;
+    mLoadedMagnitude = 0;
+    mLoadedTimeoutMs = 0;
+    mLoadedPlayLengthMs = 0;
+
+    if (!open_cached_device() && !find_device_sysfs() && !find_device_dev())
+        ALOGE("no haptics input device found");
+}
+
+/* Takes over fd if the device can play force feedback, closes it otherwise */
+bool InputFFDevice::use_device(int fd, const char *devicename, const char *name) {
+    uint8_t ffBitmask[FF_CNT / 8];
+    int ret;
+
+    ALOGI("%s is detected at %s\n", name, devicename);
+    memset(ffBitmask, 0, sizeof(ffBitmask));
+    ret = TEMP_FAILURE_RETRY(ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffBitmask)), ffBitmask));
+    if (ret == -1) {
+        ALOGE("ioctl failed, errno = %d", errno);
+        close(fd);
+        return false;
+    }
+
+    if (!test_bit(FF_CONSTANT, ffBitmask) && !test_bit(FF_PERIODIC, ffBitmask)) {
+        close(fd);
+        return false;
+    }
+
+    mVibraFd = fd;
+    if (test_bit(FF_CUSTOM, ffBitmask))
+        mSupportEffects = true;
+    if (test_bit(FF_GAIN, ffBitmask))
+        mSupportGain = true;
+    return true;
+}
+
+/* Reads the name of input device event from sysfs, without opening its node */
+bool InputFFDevice::read_sysfs_name(const char *event, char *name, size_t size) {
+    char file[PATH_MAX];
+    FILE *fp;
+    bool ok;
+
+    snprintf(file, sizeof(file), "%s%s/device/name", mPaths.sysfsInputDir.c_str(), event);
+    fp = fopen(file, "re");
+    if (fp == NULL)
+        return false;
+    ok = read_line(fp, name, size);
+    fclose(fp);
+    return ok;
+}
+
+/*
+ * The event number can change across boots, so the cached name is checked
+ * against sysfs before the node is opened.
+ */
+bool InputFFDevice::open_cached_device() {
+    char devicename[PATH_MAX];
+    char cached[NAME_BUF_SIZE];
+    char name[NAME_BUF_SIZE];
+    const char *event;
+    FILE *fp;
+    bool ok;
+    int fd;
 
-    dp = opendir(INPUT_DIR);
+    fp = fopen(mPaths.deviceCache.c_str(), "re");
+    if (fp == NULL)
+        return false;
+    ok = read_line(fp, devicename, sizeof(devicename)) && read_line(fp, cached, sizeof(cached));
+    fclose(fp);
+    if (!ok)
+        return false;
+
+    if (strncmp(devicename, mPaths.inputDir.c_str(), mPaths.inputDir.size()))
+        return false;
+    event = devicename + mPaths.inputDir.size();
+    if (strchr(event, '/') != NULL || !read_sysfs_name(event, name, sizeof(name)) ||
+            strcmp(name, cached)) {
+        ALOGI("%s is no longer %s\n", devicename, cached);
+        return false;
+    }
+
+    fd = TEMP_FAILURE_RETRY(open(devicename, O_RDWR));
+    if (fd < 0) {
+        ALOGE("open %s failed, errno = %d", devicename, errno);
+        return false;
+    }
+
+    return use_device(fd, devicename, name);
+}
+
+bool InputFFDevice::find_device_sysfs() {
+    DIR *dp;
+    struct dirent *dir;
+    char devicename[PATH_MAX];
+    char name[NAME_BUF_SIZE];
+    bool found = false;
+    int fd;
+
+    dp = opendir(mPaths.sysfsInputDir.c_str());
     if (!dp) {
-        ALOGE("open %s failed, errno = %d", INPUT_DIR, errno);
-        return;
+        ALOGE("open %s failed, errno = %d", mPaths.sysfsInputDir.c_str(), errno);
+        return false;
     }
 
-    memset(ffBitmask, 0, sizeof(ffBitmask));
-    while ((dir = readdir(dp)) != NULL){
+    while (!found && (dir = readdir(dp)) != NULL) {
+        if (strncmp(dir->d_name, "event", strlen("event")))
+            continue;
+        if (!read_sysfs_name(dir->d_name, name, sizeof(name)) || !is_haptics_device(name))
+            continue;
+
+        snprintf(devicename, sizeof(devicename), "%s%s", mPaths.inputDir.c_str(), dir->d_name);
+        fd = TEMP_FAILURE_RETRY(open(devicename, O_RDWR));
+        if (fd < 0) {
+            ALOGE("open %s failed, errno = %d", devicename, errno);
+            continue;
+        }
+
+        found = use_device(fd, devicename, name);
+    }
+
+    closedir(dp);
+    if (found)
+        save_device_cache(devicename, name);
+    return found;
+}
+
+bool InputFFDevice::find_device_dev() {
+    DIR *dp;
+    struct dirent *dir;
+    char devicename[PATH_MAX];
+    char name[NAME_BUF_SIZE];
+    bool found = false;
+    int fd, ret;
+
+    dp = opendir(mPaths.inputDir.c_str());
+    if (!dp) {
+        ALOGE("open %s failed, errno = %d", mPaths.inputDir.c_str(), errno);
+        return false;
+    }
+
+    while (!found && (dir = readdir(dp)) != NULL) {
         if (dir->d_name[0] == '.' &&
             (dir->d_name[1] == '\0' ||
              (dir->d_name[1] == '.' && dir->d_name[2] == '\0')))
             continue;
 
-        snprintf(devicename, PATH_MAX, "%s%s", INPUT_DIR, dir->d_name);
+        snprintf(devicename, PATH_MAX, "%s%s", mPaths.inputDir.c_str(), dir->d_name);
         fd = TEMP_FAILURE_RETRY(open(devicename, O_RDWR));
         if (fd < 0) {
             ALOGE("open %s failed, errno = %d", devicename, errno);
@@ -113,53 +278,79 @@ InputFFDevice::InputFFDevice()
             continue;
         }
 
-        if (strcmp(name, "qcom-hv-haptics") && strcmp(name, "qti-haptics") &&
-                strcmp(name, "aw8697_haptic") && strcmp(name, "aw8624_haptic")) {
+        if (!is_haptics_device(name)) {
             ALOGD("not a qcom/qti haptics device\n");
             close(fd);
             continue;
         }
 
-        ALOGI("%s is detected at %s\n", name, devicename);
-        ret = TEMP_FAILURE_RETRY(ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffBitmask)), ffBitmask));
-        if (ret == -1) {
-            ALOGE("ioctl failed, errno = %d", errno);
-            close(fd);
-            continue;
-        }
+        found = use_device(fd, devicename, name);
+    }
 
-        if (test_bit(FF_CONSTANT, ffBitmask) ||
-                test_bit(FF_PERIODIC, ffBitmask)) {
-            mVibraFd = fd;
-            if (test_bit(FF_CUSTOM, ffBitmask))
-                mSupportEffects = true;
-            if (test_bit(FF_GAIN, ffBitmask))
-                mSupportGain = true;
-
-            if (soc <= 0 && (fp = fopen("/sys/devices/soc0/soc_id", "r")) != NULL) {
-                fscanf(fp, "%u", &soc);
-                fclose(fp);
-            }
-            switch (soc) {
-            case MSM_CPU_LAHAINA:
-            case APQ_CPU_LAHAINA:
-            case MSM_CPU_SHIMA:
-            case MSM_CPU_SM8325:
-            case APQ_CPU_SM8325P:
-            case MSM_CPU_YUPIK:
-                mSupportExternalControl = true;
-                break;
-            default:
-                mSupportExternalControl = false;
-                break;
-            }
-            break;
-        }
+    closedir(dp);
+    if (found)
+        save_device_cache(devicename, name);
+    return found;
+}
 
-        close(fd);
+void InputFFDevice::save_device_cache(const char *devicename, const char *name) {
+    char tmp[PATH_MAX];
+    FILE *fp;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", mPaths.deviceCache.c_str());
+    fp = fopen(tmp, "we");
+    if (fp == NULL) {
+        ALOGW("open %s failed, errno = %d", tmp, errno);
+        return;
     }
 
-    closedir(dp);
+    fprintf(fp, "%s\n%s\n", devicename, name);
+    if (fclose(fp) != 0 || rename(tmp, mPaths.deviceCache.c_str()) != 0) {
+        ALOGW("write %s failed, errno = %d", mPaths.deviceCache.c_str(), errno);
+        unlink(tmp);
+    }
+}
+
+/* Only asked for when capabilities are, so the SoC ID is read then */
+bool InputFFDevice::supportExternalControl() {
+    FILE *fp;
+    int soc;
+
+    if (mVibraFd == INVALID_VALUE)
+        return false;
+    if (mSupportExternalControl != INVALID_VALUE)
+        return mSupportExternalControl;
+
+    soc = property_get_int32("ro.vendor.qti.soc_id", -1);
+    if (soc <= 0 && (fp = fopen("/sys/devices/soc0/soc_id", "r")) != NULL) {
+        fscanf(fp, "%u", &soc);
+        fclose(fp);
+    }
+    switch (soc) {
+    case MSM_CPU_LAHAINA:
+    case APQ_CPU_LAHAINA:
+    case MSM_CPU_SHIMA:
+    case MSM_CPU_SM8325:
+    case APQ_CPU_SM8325P:
+    case MSM_CPU_YUPIK:
+        mSupportExternalControl = true;
+        break;
+    default:
+        mSupportExternalControl = false;
+        break;
+    }
+    return mSupportExternalControl;
+}
+
+static int write_play(int fd, int16_t id, int value) {
+    struct input_event play;
+
+    play.value = value;
+    play.type = EV_FF;
+    play.code = id;
+    play.time.tv_sec = 0;
+    play.time.tv_usec = 0;
+    return TEMP_FAILURE_RETRY(write(fd, (const void*)&play, sizeof(play)));
 }
 
 /** Play vibration
@@ -179,15 +370,14 @@ InputFFDevice::InputFFDevice()
  *                    The effect-ID is used for passing down the predefined effect to
  *                    kernel driver, and the rest two parameters are used for returning
  *                    back the real playing length from kernel driver.
+ *
+ *  The haptics drivers load the pattern into the hardware when an effect is
+ *  uploaded and play whatever was loaded last, whichever effect ID is played.
+ *  So one effect slot is kept: replaying the effect that is loaded only needs
+ *  the play event, and any other effect is uploaded over it in place.
  */
 int InputFFDevice::play(int effectId, uint32_t timeoutMs, long *playLengthMs) {
-    struct ff_effect effect;
-    struct input_event play;
-    int16_t data[CUSTOM_DATA_LEN] = {0, 0, 0};
     int ret;
-#ifdef USE_EFFECT_STREAM
-    const struct effect_stream *stream;
-#endif
 
     /* For QMAA compliance, return OK even if vibrator device doesn't exist */
     if (mVibraFd == INVALID_VALUE) {
@@ -196,83 +386,129 @@ int InputFFDevice::play(int effectId, uint32_t timeoutMs, long *playLengthMs) {
             return 0;
     }
 
-    if (timeoutMs != 0) {
+    if (timeoutMs == 0) {
         if (mCurrAppId != INVALID_VALUE) {
-            ret = TEMP_FAILURE_RETRY(ioctl(mVibraFd, EVIOCRMFF, mCurrAppId));
+            ret = write_play(mVibraFd, mCurrAppId, 0);
             if (ret == -1) {
-                ALOGE("ioctl EVIOCRMFF failed, errno = %d", -errno);
-                goto errout;
+                ALOGE("write failed, errno = %d\n", -errno);
+                return ret;
             }
-            mCurrAppId = INVALID_VALUE;
         }
+        return 0;
+    }
 
-        memset(&effect, 0, sizeof(effect));
-        if (effectId != INVALID_VALUE) {
-            data[0] = effectId;
-            effect.type = FF_PERIODIC;
-            effect.u.periodic.waveform = FF_CUSTOM;
-            effect.u.periodic.magnitude = mCurrMagnitude;
-            effect.u.periodic.custom_data = data;
-            effect.u.periodic.custom_len = sizeof(int16_t) * CUSTOM_DATA_LEN;
-#ifdef USE_EFFECT_STREAM
-            stream = get_effect_stream(effectId);
-            if (stream != NULL) {
-                effect.u.periodic.custom_data = (int16_t *)stream;
-                effect.u.periodic.custom_len = sizeof(*stream);
-            }
-#endif
-        } else {
-            effect.type = FF_CONSTANT;
-            effect.u.constant.level = mCurrMagnitude;
-            effect.replay.length = timeoutMs;
-        }
+    ret = load(effectId, timeoutMs);
+    if (ret != 0)
+        return ret;
 
-        effect.id = mCurrAppId;
-        effect.replay.delay = 0;
+    if (effectId != INVALID_VALUE && playLengthMs != NULL)
+        *playLengthMs = mLoadedPlayLengthMs;
 
-        ret = TEMP_FAILURE_RETRY(ioctl(mVibraFd, EVIOCSFF, &effect));
-        if (ret == -1) {
-            ALOGE("ioctl EVIOCSFF failed, errno = %d", -errno);
-            goto errout;
-        }
+    ret = write_play(mVibraFd, mCurrAppId, 1);
+    if (ret == -1) {
+        ALOGE("write failed, errno = %d\n", -errno);
+        mLoaded = false;
+        return ret;
+    }
+    return 0;
+}
 
-        mCurrAppId = effect.id;
-        if (effectId != INVALID_VALUE && playLengthMs != NULL) {
-            *playLengthMs = data[1] * 1000 + data[2];
+/* Uploads the effect to the slot unless it is the one loaded already. */
+int InputFFDevice::load(int effectId, uint32_t timeoutMs) {
+    struct ff_effect effect;
+    int16_t data[CUSTOM_DATA_LEN] = {0, 0, 0};
+    int ret;
 #ifdef USE_EFFECT_STREAM
-            if (stream != NULL && stream->play_rate_hz != 0)
-                *playLengthMs = ((stream->length * 1000) / stream->play_rate_hz) + 1;
+    const struct effect_stream *stream = NULL;
 #endif
-        }
 
-        play.value = 1;
-        play.type = EV_FF;
-        play.code = mCurrAppId;
-        play.time.tv_sec = 0;
-        play.time.tv_usec = 0;
-        ret = TEMP_FAILURE_RETRY(write(mVibraFd, (const void*)&play, sizeof(play)));
-        if (ret == -1) {
-            ALOGE("write failed, errno = %d\n", -errno);
-            ret = TEMP_FAILURE_RETRY(ioctl(mVibraFd, EVIOCRMFF, mCurrAppId));
-            if (ret == -1)
-                ALOGE("ioctl EVIOCRMFF failed, errno = %d", -errno);
-            goto errout;
-        }
-    } else if (mCurrAppId != INVALID_VALUE) {
+    if (mLoaded && mLoadedEffectId == effectId && mLoadedMagnitude == mCurrMagnitude &&
+            (effectId != INVALID_VALUE || mLoadedTimeoutMs == timeoutMs))
+        return 0;
+
+    /* The kernel only updates an effect in place if its type is unchanged */
+    if (mCurrAppId != INVALID_VALUE && (!mLoaded ||
+            (mLoadedEffectId == INVALID_VALUE) != (effectId == INVALID_VALUE))) {
         ret = TEMP_FAILURE_RETRY(ioctl(mVibraFd, EVIOCRMFF, mCurrAppId));
+        mCurrAppId = INVALID_VALUE;
         if (ret == -1) {
             ALOGE("ioctl EVIOCRMFF failed, errno = %d", -errno);
             goto errout;
         }
-        mCurrAppId = INVALID_VALUE;
     }
+
+    memset(&effect, 0, sizeof(effect));
+    if (effectId != INVALID_VALUE) {
+        data[0] = effectId;
+        effect.type = FF_PERIODIC;
+        effect.u.periodic.waveform = FF_CUSTOM;
+        effect.u.periodic.magnitude = mCurrMagnitude;
+        effect.u.periodic.custom_data = data;
+        effect.u.periodic.custom_len = sizeof(int16_t) * CUSTOM_DATA_LEN;
+#ifdef USE_EFFECT_STREAM
+        stream = get_effect_stream(effectId);
+        if (stream != NULL) {
+            effect.u.periodic.custom_data = (int16_t *)stream;
+            effect.u.periodic.custom_len = sizeof(*stream);
+        }
+#endif
+    } else {
+        effect.type = FF_CONSTANT;
+        effect.u.constant.level = mCurrMagnitude;
+        effect.replay.length = timeoutMs;
+    }
+
+    effect.id = mCurrAppId;
+    effect.replay.delay = 0;
+
+    mLoaded = false;
+    ret = TEMP_FAILURE_RETRY(ioctl(mVibraFd, EVIOCSFF, &effect));
+    if (ret == -1) {
+        ALOGE("ioctl EVIOCSFF failed, errno = %d", -errno);
+        goto errout;
+    }
+
+    mCurrAppId = effect.id;
+    mLoaded = true;
+    mLoadedEffectId = effectId;
+    mLoadedMagnitude = mCurrMagnitude;
+    mLoadedTimeoutMs = timeoutMs;
+    mLoadedPlayLengthMs = data[1] * 1000 + data[2];
+#ifdef USE_EFFECT_STREAM
+    if (stream != NULL && stream->play_rate_hz != 0)
+        mLoadedPlayLengthMs = ((stream->length * 1000) / stream->play_rate_hz) + 1;
+#endif
+    if (effectId != INVALID_VALUE)
+        mEffectLengthMs[effectId] = mLoadedPlayLengthMs;
     return 0;
 
 errout:
-    mCurrAppId = INVALID_VALUE;
+    mLoaded = false;
     return ret;
 }
 
+/*
+ * Loads a predefined effect without playing it, to learn its length. Only
+ * safe while nothing plays, as it replaces what the hardware has loaded.
+ */
+int InputFFDevice::probeEffect(int effectId) {
+    if (mVibraFd == INVALID_VALUE)
+        return 0;
+
+    return load(effectId, INVALID_VALUE);
+}
+
+long InputFFDevice::effectLengthMs(int effectId) {
+    auto it = mEffectLengthMs.find(effectId);
+
+    return it != mEffectLengthMs.end() ? it->second : INVALID_VALUE;
+}
+
+int InputFFDevice::playPrimitive(int effectId, float scale) {
+    mCurrMagnitude = LIGHT_MAGNITUDE + scale * (STRONG_MAGNITUDE - LIGHT_MAGNITUDE);
+    return play(effectId, INVALID_VALUE, NULL);
+}
+
 int InputFFDevice::on(int32_t timeoutMs) {
     return play(INVALID_VALUE, timeoutMs, NULL);
 }
@@ -291,6 +527,12 @@ int InputFFDevice::setAmplitude(uint8_t amplitude) {
 
     tmp = amplitude * (STRONG_MAGNITUDE - LIGHT_MAGNITUDE) / 255;
     tmp += LIGHT_MAGNITUDE;
+    /* The gain stays set, but constant effects also take their level from it */
+    if (tmp == mCurrGain) {
+        mCurrMagnitude = tmp;
+        return 0;
+    }
+
     ie.type = EV_FF;
     ie.code = FF_GAIN;
     ie.value = tmp;
@@ -298,10 +540,13 @@ int InputFFDevice::setAmplitude(uint8_t amplitude) {
     ret = TEMP_FAILURE_RETRY(write(mVibraFd, &ie, sizeof(ie)));
     if (ret == -1) {
         ALOGE("write FF_GAIN failed, errno = %d", -errno);
+        mCurrGain = INVALID_VALUE;
         return ret;
     }
 
+    mCurrGain = tmp;
     mCurrMagnitude = tmp;
+    mGainWrites++;
     return 0;
 }
 
@@ -323,36 +568,60 @@ int InputFFDevice::playEffect(int effectId, EffectStrength es, long *playLengthM
     return play(effectId, INVALID_VALUE, playLengthMs);
 }
 
-LedVibratorDevice::LedVibratorDevice() {
-    char devicename[PATH_MAX];
-    int fd;
+LedVibratorDevice::LedVibratorDevice() : LedVibratorDevice(LED_DEVICE) {}
 
+/*
+ * The attributes are opened once here and written with pwrite() on every
+ * vibration, instead of being opened and closed for each write.
+ */
+LedVibratorDevice::LedVibratorDevice(const std::string &dir) : mDir(dir) {
     mDetected = false;
+    mState = INVALID_VALUE;
+    mDurationMs = INVALID_VALUE;
 
-    snprintf(devicename, sizeof(devicename), "%s/%s", LED_DEVICE, "activate");
-    fd = TEMP_FAILURE_RETRY(open(devicename, O_RDWR));
-    if (fd < 0) {
-        ALOGE("open %s failed, errno = %d", devicename, errno);
+    mStateFd = INVALID_VALUE;
+    mDurationFd = INVALID_VALUE;
+
+    mActivateFd = open_attr("activate", O_RDWR);
+    if (mActivateFd < 0)
         return;
-    }
 
+    mStateFd = open_attr("state", O_WRONLY);
+    mDurationFd = open_attr("duration", O_WRONLY);
     mDetected = true;
 }
 
-int LedVibratorDevice::write_value(const char *file, const char *value) {
+LedVibratorDevice::~LedVibratorDevice() {
+    if (mActivateFd >= 0)
+        close(mActivateFd);
+    if (mStateFd >= 0)
+        close(mStateFd);
+    if (mDurationFd >= 0)
+        close(mDurationFd);
+}
+
+int LedVibratorDevice::open_attr(const char *attr, int flags) {
+    char file[PATH_MAX];
     int fd;
-    int ret;
 
-    fd = TEMP_FAILURE_RETRY(open(file, O_WRONLY));
-    if (fd < 0) {
+    snprintf(file, sizeof(file), "%s/%s", mDir.c_str(), attr);
+    fd = TEMP_FAILURE_RETRY(open(file, flags | O_CLOEXEC));
+    if (fd < 0)
         ALOGE("open %s failed, errno = %d", file, errno);
-        return -errno;
-    }
 
-    ret = TEMP_FAILURE_RETRY(write(fd, value, strlen(value) + 1));
+    return fd;
+}
+
+int LedVibratorDevice::write_value(int fd, const char *value, size_t len) {
+    int ret;
+
+    if (fd < 0)
+        return -ENODEV;
+
+    ret = TEMP_FAILURE_RETRY(pwrite(fd, value, len, 0));
     if (ret == -1) {
         ret = -errno;
-    } else if (ret != strlen(value) + 1) {
+    } else if (ret != len) {
         /* even though EAGAIN is an errno value that could be set
            by write() in some cases, none of them apply here.  So, this return
            value can be clearly identified when debugging and suggests the
@@ -363,29 +632,31 @@ int LedVibratorDevice::write_value(const char *file, const char *value) {
     }
 
     errno = 0;
-    close(fd);
-
     return ret;
 }
 
+/* state and duration keep their value, so they are only written on change */
 int LedVibratorDevice::on(int32_t timeoutMs) {
-    char file[PATH_MAX];
+    static const char ONE[] = "1";
     char value[32];
-    int ret;
+    int len, ret;
 
-    snprintf(file, sizeof(file), "%s/%s", LED_DEVICE, "state");
-    ret = write_value(file, "1");
-    if (ret < 0)
-       goto error;
+    if (mState != 1) {
+        ret = write_value(mStateFd, ONE, sizeof(ONE));
+        if (ret < 0)
+           goto error;
+        mState = 1;
+    }
 
-    snprintf(file, sizeof(file), "%s/%s", LED_DEVICE, "duration");
-    snprintf(value, sizeof(value), "%u\n", timeoutMs);
-    ret = write_value(file, value);
-    if (ret < 0)
-       goto error;
+    if (mDurationMs != timeoutMs) {
+        len = snprintf(value, sizeof(value), "%u\n", timeoutMs);
+        ret = write_value(mDurationFd, value, len + 1);
+        if (ret < 0)
+           goto error;
+        mDurationMs = timeoutMs;
+    }
 
-    snprintf(file, sizeof(file), "%s/%s", LED_DEVICE, "activate");
-    ret = write_value(file, "1");
+    ret = write_value(mActivateFd, ONE, sizeof(ONE));
     if (ret < 0)
        goto error;
 
@@ -393,17 +664,115 @@ int LedVibratorDevice::on(int32_t timeoutMs) {
 
 error:
     ALOGE("Failed to turn on vibrator ret: %d\n", ret);
+    mState = INVALID_VALUE;
+    mDurationMs = INVALID_VALUE;
     return ret;
 }
 
 int LedVibratorDevice::off()
 {
-    char file[PATH_MAX];
-    int ret;
+    static const char ZERO[] = "0";
 
-    snprintf(file, sizeof(file), "%s/%s", LED_DEVICE, "activate");
-    ret = write_value(file, "0");
-    return ret;
+    return write_value(mActivateFd, ZERO, sizeof(ZERO));
+}
+
+/* Primitives are played with the kernel's predefined effects closest to them */
+static int primitive_effect_id(CompositePrimitive primitive) {
+    switch (primitive) {
+    case CompositePrimitive::CLICK:
+        return static_cast<int>(Effect::CLICK);
+    case CompositePrimitive::THUD:
+        return static_cast<int>(Effect::THUD);
+    case CompositePrimitive::LIGHT_TICK:
+        return static_cast<int>(Effect::TICK);
+    default:
+        return INVALID_VALUE;
+    }
+}
+
+static const CompositePrimitive COMPOSE_PRIMITIVES[] = {
+    CompositePrimitive::CLICK,
+    CompositePrimitive::THUD,
+    CompositePrimitive::LIGHT_TICK,
+};
+
+Vibrator::Vibrator()
+    : Vibrator(InputFFPaths{INPUT_DIR, SYSFS_INPUT_DIR, DEVICE_CACHE}, LED_DEVICE)
+{
+}
+
+/*
+ * Nothing plays yet, so this is when the lengths of the effects used for
+ * composition can be read back from the driver.
+ */
+Vibrator::Vibrator(const InputFFPaths &paths, const std::string &ledDir)
+    : ff(paths), ledVib(ledDir) {
+    if (ledVib.mDetected || !ff.mSupportEffects)
+        return;
+
+    for (CompositePrimitive primitive : COMPOSE_PRIMITIVES) {
+        if (ff.probeEffect(primitive_effect_id(primitive)) != 0)
+            ALOGE("Failed to probe effect for primitive %d", static_cast<int>(primitive));
+    }
+}
+
+/* should be called while locked */
+void Vibrator::completeAt(CompletionTimer::Clock::time_point deadline,
+                          const std::shared_ptr<IVibratorCallback>& callback) {
+    if (callback == nullptr)
+        return;
+
+    mCompletionId = mTimer.scheduleAt(deadline, [callback] {
+        ALOGD("Notifying vibration complete");
+        if (!callback->onComplete().isOk())
+            ALOGE("Failed to call onComplete");
+    });
+}
+
+/*
+ * A vibration cut short by off() or by a newer one is complete as of now, so
+ * its callback runs at once instead of at its original end.
+ *
+ * should be called while locked
+ */
+void Vibrator::preempt() {
+    mGeneration++;
+    for (uint64_t id : mComposeSteps)
+        mTimer.cancel(id);
+    mComposeSteps.clear();
+
+    if (mCompletionId == 0)
+        return;
+
+    mTimer.expedite(mCompletionId);
+    mCompletionId = 0;
+}
+
+/*
+ * A held amplitude is meant for the vibration playing when it was set, so it
+ * is written before a new vibration is uploaded instead of in the middle of
+ * it, and dropped once the vibrator is off.
+ *
+ * should be called while locked
+ */
+void Vibrator::flushAmplitude() {
+    if (!mAmplitudeHeld)
+        return;
+
+    mTimer.cancel(mHeldWriteId);
+    mAmplitudeHeld = false;
+    mLastAmplitudeWrite = CompletionTimer::Clock::now();
+    if (!ff.mInExternalControl && ff.setAmplitude(mHeldAmplitude) != 0)
+        ALOGE("Failed to set held amplitude %u", mHeldAmplitude);
+}
+
+/* should be called while locked */
+void Vibrator::dropAmplitude() {
+    if (!mAmplitudeHeld)
+        return;
+
+    mTimer.cancel(mHeldWriteId);
+    mAmplitudeHeld = false;
 }
 
 ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
@@ -418,8 +787,8 @@ ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
     if (ff.mSupportGain)
         *_aidl_return |= IVibrator::CAP_AMPLITUDE_CONTROL;
     if (ff.mSupportEffects)
-        *_aidl_return |= IVibrator::CAP_PERFORM_CALLBACK;
-    if (ff.mSupportExternalControl)
+        *_aidl_return |= IVibrator::CAP_PERFORM_CALLBACK | IVibrator::CAP_COMPOSE_EFFECTS;
+    if (ff.supportExternalControl())
         *_aidl_return |= IVibrator::CAP_EXTERNAL_CONTROL;
 
     ALOGD("QTI Vibrator reporting capabilities: %d", *_aidl_return);
@@ -428,8 +797,11 @@ ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
 
 ndk::ScopedAStatus Vibrator::off() {
     int ret;
+    std::lock_guard<std::mutex> lock(mLock);
 
     ALOGD("QTI Vibrator off");
+    preempt();
+    dropAmplitude();
     if (ledVib.mDetected)
         ret = ledVib.off();
     else
@@ -443,8 +815,11 @@ ndk::ScopedAStatus Vibrator::off() {
 ndk::ScopedAStatus Vibrator::on(int32_t timeoutMs,
                                 const std::shared_ptr<IVibratorCallback>& callback) {
     int ret;
+    std::lock_guard<std::mutex> lock(mLock);
 
     ALOGD("Vibrator on for timeoutMs: %d", timeoutMs);
+    preempt();
+    flushAmplitude();
     if (ledVib.mDetected)
         ret = ledVib.on(timeoutMs);
     else
@@ -453,23 +828,14 @@ ndk::ScopedAStatus Vibrator::on(int32_t timeoutMs,
     if (ret != 0)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_SERVICE_SPECIFIC));
 
-    if (callback != nullptr) {
-        std::thread([=] {
-            ALOGD("Starting on on another thread");
-            usleep(timeoutMs * 1000);
-            ALOGD("Notifying on complete");
-            if (!callback->onComplete().isOk()) {
-                ALOGE("Failed to call onComplete");
-            }
-        }).detach();
-    }
-
+    completeAt(CompletionTimer::Clock::now() + std::chrono::milliseconds(timeoutMs), callback);
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::perform(Effect effect, EffectStrength es, const std::shared_ptr<IVibratorCallback>& callback, int32_t* _aidl_return) {
     long playLengthMs;
     int ret;
+    std::lock_guard<std::mutex> lock(mLock);
 
     if (ledVib.mDetected)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
@@ -483,19 +849,14 @@ ndk::ScopedAStatus Vibrator::perform(Effect effect, EffectStrength es, const std
     if (es != EffectStrength::LIGHT && es != EffectStrength::MEDIUM && es != EffectStrength::STRONG)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
+    preempt();
+    flushAmplitude();
     ret = ff.playEffect((static_cast<int>(effect)), es, &playLengthMs);
     if (ret != 0)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_SERVICE_SPECIFIC));
 
-    if (callback != nullptr) {
-        std::thread([=] {
-            ALOGD("Starting perform on another thread");
-            usleep(playLengthMs * 1000);
-            ALOGD("Notifying perform complete");
-            callback->onComplete();
-        }).detach();
-    }
-
+    completeAt(CompletionTimer::Clock::now() + std::chrono::milliseconds(playLengthMs),
+               callback);
     *_aidl_return = playLengthMs;
     return ndk::ScopedAStatus::ok();
 }
@@ -510,14 +871,22 @@ ndk::ScopedAStatus Vibrator::getSupportedEffects(std::vector<Effect>* _aidl_retu
     return ndk::ScopedAStatus::ok();
 }
 
+/*
+ * Amplitude follows audio in games and ringtones at high rates. At most one
+ * FF_GAIN write goes out per AMPLITUDE_INTERVAL_MS: a value coming sooner is
+ * held and written by the timer thread when the interval is up, and any
+ * value after it replaces the held one.
+ */
 ndk::ScopedAStatus Vibrator::setAmplitude(float amplitude) {
+    CompletionTimer::Clock::time_point now, slot;
     uint8_t tmp;
     int ret;
+    std::lock_guard<std::mutex> lock(mLock);
 
     if (ledVib.mDetected)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
-    ALOGD("Vibrator set amplitude: %f", amplitude);
+    ALOGV("Vibrator set amplitude: %f", amplitude);
 
     if (amplitude <= 0.0f || amplitude > 1.0f)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_ILLEGAL_ARGUMENT));
@@ -526,47 +895,187 @@ ndk::ScopedAStatus Vibrator::setAmplitude(float amplitude) {
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
     tmp = (uint8_t)(amplitude * 0xff);
-    ret = ff.setAmplitude(tmp);
-    if (ret != 0)
-        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_SERVICE_SPECIFIC));
+    mAmplitudeRequests++;
+    if (mAmplitudeHeld) {
+        mHeldAmplitude = tmp;
+        mAmplitudeCoalesced++;
+        return ndk::ScopedAStatus::ok();
+    }
+
+    now = CompletionTimer::Clock::now();
+    slot = mLastAmplitudeWrite + std::chrono::milliseconds(AMPLITUDE_INTERVAL_MS);
+    if (now >= slot) {
+        mLastAmplitudeWrite = now;
+        ret = ff.setAmplitude(tmp);
+        if (ret != 0)
+            return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_SERVICE_SPECIFIC));
+        return ndk::ScopedAStatus::ok();
+    }
 
+    mAmplitudeHeld = true;
+    mHeldAmplitude = tmp;
+    mHeldSlot = slot;
+    mHeldWriteId = mTimer.scheduleAt(slot, [this, slot] {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto now = CompletionTimer::Clock::now();
+        auto lateUs = std::chrono::duration_cast<std::chrono::microseconds>(now - slot).count();
+
+        /* Flushed or dropped while this waited for the lock */
+        if (!mAmplitudeHeld || mHeldSlot != slot)
+            return;
+        mAmplitudeHeld = false;
+        mLastAmplitudeWrite = now;
+        mAmplitudeDeferred++;
+        mAmplitudeLateUsTotal += lateUs;
+        mAmplitudeLateUsMax = std::max<int64_t>(mAmplitudeLateUsMax, lateUs);
+        if (!ff.mInExternalControl && ff.setAmplitude(mHeldAmplitude) != 0)
+            ALOGE("Failed to set held amplitude %u", mHeldAmplitude);
+    });
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::setExternalControl(bool enabled) {
+    std::lock_guard<std::mutex> lock(mLock);
+
     if (ledVib.mDetected)
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
     ALOGD("Vibrator set external control: %d", enabled);
-    if (!ff.mSupportExternalControl)
+    if (!ff.supportExternalControl())
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 
     ff.mInExternalControl = enabled;
     return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Vibrator::getCompositionDelayMax(int32_t* maxDelayMs  __unused) {
-    return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+binder_status_t Vibrator::dump(int fd, const char** args __unused, uint32_t numArgs __unused) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    dprintf(fd, "QTI Vibrator: %s\n", ledVib.mDetected ? "LED" : "input FF");
+    dprintf(fd, "Amplitude: %" PRIu64 " requests, %" PRIu64 " FF_GAIN writes, "
+            "%" PRIu64 " coalesced\n", mAmplitudeRequests, ff.mGainWrites, mAmplitudeCoalesced);
+    dprintf(fd, "Held amplitude writes: %" PRIu64 ", late by %" PRId64 " us avg, %" PRId64
+            " us max\n", mAmplitudeDeferred,
+            mAmplitudeDeferred ? mAmplitudeLateUsTotal / (int64_t)mAmplitudeDeferred : 0,
+            mAmplitudeLateUsMax);
+    return STATUS_OK;
 }
 
-ndk::ScopedAStatus Vibrator::getCompositionSizeMax(int32_t* maxSize __unused) {
-    return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+ndk::ScopedAStatus Vibrator::getCompositionDelayMax(int32_t* maxDelayMs) {
+    if (ledVib.mDetected || !ff.mSupportEffects)
+        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+
+    *maxDelayMs = COMPOSE_DELAY_MAX_MS;
+    return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Vibrator::getSupportedPrimitives(std::vector<CompositePrimitive>* supported __unused) {
-    return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+ndk::ScopedAStatus Vibrator::getCompositionSizeMax(int32_t* maxSize) {
+    if (ledVib.mDetected || !ff.mSupportEffects)
+        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+
+    *maxSize = COMPOSE_SIZE_MAX;
+    return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Vibrator::getPrimitiveDuration(CompositePrimitive primitive __unused,
-                                                  int32_t* durationMs __unused) {
-    return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+ndk::ScopedAStatus Vibrator::getSupportedPrimitives(std::vector<CompositePrimitive>* supported) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (ledVib.mDetected || !ff.mSupportEffects)
+        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+
+    *supported = {CompositePrimitive::NOOP};
+    for (CompositePrimitive primitive : COMPOSE_PRIMITIVES) {
+        if (ff.effectLengthMs(primitive_effect_id(primitive)) > 0)
+            supported->push_back(primitive);
+    }
+    return ndk::ScopedAStatus::ok();
 }
 
-ndk::ScopedAStatus Vibrator::compose(const std::vector<CompositeEffect>& composite __unused,
-                                     const std::shared_ptr<IVibratorCallback>& callback __unused) {
-    return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+ndk::ScopedAStatus Vibrator::getPrimitiveDuration(CompositePrimitive primitive,
+                                                  int32_t* durationMs) {
+    std::lock_guard<std::mutex> lock(mLock);
+    long lengthMs;
+
+    if (ledVib.mDetected || !ff.mSupportEffects)
+        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+
+    if (primitive == CompositePrimitive::NOOP) {
+        *durationMs = 0;
+        return ndk::ScopedAStatus::ok();
+    }
+
+    lengthMs = ff.effectLengthMs(primitive_effect_id(primitive));
+    if (lengthMs <= 0)
+        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+
+    *durationMs = lengthMs;
+    return ndk::ScopedAStatus::ok();
 }
 
+/*
+ * The whole composition is laid out against one start time and each step is
+ * queued on the timer thread for its absolute deadline, so delays neither
+ * add up binder round trips nor drift from step to step.
+ */
+ndk::ScopedAStatus Vibrator::compose(const std::vector<CompositeEffect>& composite,
+                                     const std::shared_ptr<IVibratorCallback>& callback) {
+    std::lock_guard<std::mutex> lock(mLock);
+    CompletionTimer::Clock::time_point start;
+    std::chrono::milliseconds offset(0);
+    uint64_t generation;
+
+    if (ledVib.mDetected || !ff.mSupportEffects)
+        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+
+    if (composite.empty() || composite.size() > COMPOSE_SIZE_MAX)
+        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_ILLEGAL_ARGUMENT));
+
+    for (const CompositeEffect& e : composite) {
+        if (e.delayMs < 0 || e.delayMs > COMPOSE_DELAY_MAX_MS || e.scale < 0.0f || e.scale > 1.0f)
+            return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_ILLEGAL_ARGUMENT));
+        if (e.primitive != CompositePrimitive::NOOP &&
+                ff.effectLengthMs(primitive_effect_id(e.primitive)) <= 0)
+            return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
+    }
+
+    ALOGD("Vibrator compose %zu primitives", composite.size());
+    preempt();
+    flushAmplitude();
+    generation = mGeneration;
+    start = CompletionTimer::Clock::now();
+
+    for (const CompositeEffect& e : composite) {
+        int effectId = primitive_effect_id(e.primitive);
+        float scale = e.scale;
+
+        offset += std::chrono::milliseconds(e.delayMs);
+        if (e.primitive == CompositePrimitive::NOOP)
+            continue;
+
+        mComposeSteps.push_back(mTimer.scheduleAt(start + offset,
+                [this, generation, effectId, scale] {
+            std::lock_guard<std::mutex> lock(mLock);
+
+            if (generation != mGeneration)
+                return;
+            if (ff.playPrimitive(effectId, scale) != 0)
+                ALOGE("Failed to play primitive effect %d", effectId);
+        }));
+        offset += std::chrono::milliseconds(ff.effectLengthMs(effectId));
+    }
+
+    completeAt(start + offset, callback);
+    return ndk::ScopedAStatus::ok();
+}
+
+/*
+ * Always-on effects are played by the vibrator on a hardware trigger, with
+ * no call into the HAL. The haptics drivers have no such trigger, and they
+ * play whatever pattern was uploaded last, so no effect can stay resident
+ * next to the one in use. CAP_ALWAYS_ON_CONTROL is therefore not reported.
+ * Replaying the effect that is loaded through perform() already needs only
+ * the play event.
+ */
 ndk::ScopedAStatus Vibrator::getSupportedAlwaysOnEffects(std::vector<Effect>* _aidl_return __unused) {
     return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_UNSUPPORTED_OPERATION));
 }
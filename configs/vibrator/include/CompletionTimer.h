@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+/*
+ * Runs tasks once their deadline passes, all on a single thread that sleeps
+ * on a timerfd armed for the earliest deadline. Tasks run in deadline order,
+ * without the queue locked, so a task may schedule another.
+ */
+class CompletionTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::function<void()>;
+
+    CompletionTimer();
+    ~CompletionTimer();
+
+    /* Returns an id for expedite() and cancel(), never 0. */
+    uint64_t schedule(std::chrono::milliseconds delay, Task task);
+    uint64_t scheduleAt(Clock::time_point deadline, Task task);
+    /* Runs the task now, on the timer thread, if it has not run yet. */
+    bool expedite(uint64_t id);
+    /* Drops the task if it has not run yet. */
+    bool cancel(uint64_t id);
+
+private:
+    struct Entry {
+        Clock::time_point deadline;
+        Task task;
+    };
+
+    void loop();
+    void armLocked();
+
+    ::android::base::unique_fd mTimerFd;
+    std::mutex mLock;
+    std::map<uint64_t, Entry> mQueue;
+    uint64_t mNextId;
+    bool mStop;
+    std::thread mThread;
+};
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
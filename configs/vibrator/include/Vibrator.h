@@ -31,41 +31,91 @@
 
 #include <aidl/android/hardware/vibrator/BnVibrator.h>
 
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "CompletionTimer.h"
+
 namespace aidl {
 namespace android {
 namespace hardware {
 namespace vibrator {
 
+/* Where InputFFDevice looks for the haptics device, a fake tree in tests */
+struct InputFFPaths {
+    std::string inputDir;
+    std::string sysfsInputDir;
+    std::string deviceCache;
+};
+
 class InputFFDevice {
 public:
     InputFFDevice();
+    explicit InputFFDevice(const InputFFPaths &paths);
     int playEffect(int effectId, EffectStrength es, long *playLengthMs);
+    int playPrimitive(int effectId, float scale);
+    int probeEffect(int effectId);
+    long effectLengthMs(int effectId);
     int on(int32_t timeoutMs);
     int off();
     int setAmplitude(uint8_t amplitude);
+    bool supportExternalControl();
     bool mSupportGain;
     bool mSupportEffects;
-    bool mSupportExternalControl;
     bool mInExternalControl;
+    uint64_t mGainWrites;
 private:
+    bool use_device(int fd, const char *devicename, const char *name);
+    bool read_sysfs_name(const char *event, char *name, size_t size);
+    bool open_cached_device();
+    bool find_device_sysfs();
+    bool find_device_dev();
+    void save_device_cache(const char *devicename, const char *name);
+    const InputFFPaths mPaths;
+    int mSupportExternalControl;
     int play(int effectId, uint32_t timeoutMs, long *playLengthMs);
+    int load(int effectId, uint32_t timeoutMs);
     int mVibraFd;
     int16_t mCurrAppId;
     int16_t mCurrMagnitude;
+    /* Last FF_GAIN written, INVALID_VALUE if unknown */
+    int mCurrGain;
+    /* What the effect slot mCurrAppId was last uploaded with */
+    bool mLoaded;
+    int mLoadedEffectId;
+    int16_t mLoadedMagnitude;
+    uint32_t mLoadedTimeoutMs;
+    long mLoadedPlayLengthMs;
+    std::map<int, long> mEffectLengthMs;
 };
 
 class LedVibratorDevice {
 public:
     LedVibratorDevice();
+    /* Uses the activate, state and duration attributes in dir */
+    explicit LedVibratorDevice(const std::string &dir);
+    ~LedVibratorDevice();
     int on(int32_t timeoutMs);
     int off();
     bool mDetected;
 private:
-    int write_value(const char *file, const char *value);
+    int open_attr(const char *attr, int flags);
+    int write_value(int fd, const char *value, size_t len);
+    const std::string mDir;
+    int mActivateFd;
+    int mStateFd;
+    int mDurationFd;
+    /* Last values written, INVALID_VALUE if unknown */
+    int mState;
+    int32_t mDurationMs;
 };
 
 class Vibrator : public BnVibrator {
 public:
+    Vibrator();
+    /* Uses the input devices under paths and the LED vibrator in ledDir */
+    Vibrator(const InputFFPaths &paths, const std::string &ledDir);
     class InputFFDevice ff;
     class LedVibratorDevice ledVib;
     ndk::ScopedAStatus getCapabilities(int32_t* _aidl_return) override;
@@ -78,8 +128,8 @@ public:
     ndk::ScopedAStatus getSupportedEffects(std::vector<Effect>* _aidl_return) override;
     ndk::ScopedAStatus setAmplitude(float amplitude) override;
     ndk::ScopedAStatus setExternalControl(bool enabled) override;
-    ndk::ScopedAStatus getCompositionDelayMax(int32_t* maxDelayMs);
-    ndk::ScopedAStatus getCompositionSizeMax(int32_t* maxSize);
+    ndk::ScopedAStatus getCompositionDelayMax(int32_t* maxDelayMs) override;
+    ndk::ScopedAStatus getCompositionSizeMax(int32_t* maxSize) override;
     ndk::ScopedAStatus getSupportedPrimitives(std::vector<CompositePrimitive>* supported) override;
     ndk::ScopedAStatus getPrimitiveDuration(CompositePrimitive primitive,
                                             int32_t* durationMs) override;
@@ -88,6 +138,35 @@ public:
     ndk::ScopedAStatus getSupportedAlwaysOnEffects(std::vector<Effect>* _aidl_return) override;
     ndk::ScopedAStatus alwaysOnEnable(int32_t id, Effect effect, EffectStrength strength) override;
     ndk::ScopedAStatus alwaysOnDisable(int32_t id) override;
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+private:
+    void completeAt(CompletionTimer::Clock::time_point deadline,
+                    const std::shared_ptr<IVibratorCallback>& callback);
+    void preempt();
+    void flushAmplitude();
+    void dropAmplitude();
+    /* Guards the devices, which composition steps drive from the timer thread */
+    std::mutex mLock;
+    uint64_t mCompletionId = 0;
+    /* Bumped on preemption, so steps of a composition cut short do nothing */
+    uint64_t mGeneration = 0;
+    std::vector<uint64_t> mComposeSteps;
+    /* An amplitude waiting for its write slot on the timer thread */
+    bool mAmplitudeHeld = false;
+    uint8_t mHeldAmplitude = 0;
+    CompletionTimer::Clock::time_point mHeldSlot;
+    uint64_t mHeldWriteId = 0;
+    CompletionTimer::Clock::time_point mLastAmplitudeWrite;
+    uint64_t mAmplitudeRequests = 0;
+    uint64_t mAmplitudeCoalesced = 0;
+    uint64_t mAmplitudeDeferred = 0;
+    int64_t mAmplitudeLateUsTotal = 0;
+    int64_t mAmplitudeLateUsMax = 0;
+    /*
+     * Timer tasks use the members above, so the timer is declared last: it
+     * is destroyed, and its thread joined, before any of them.
+     */
+    CompletionTimer mTimer;
 };
 
 }  // namespace vibrator
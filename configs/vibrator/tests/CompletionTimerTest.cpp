@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "CompletionTimer.h"
+
+using std::chrono_literals::operator""ms;
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+namespace {
+
+/* Collects which tasks ran, in order, and lets the test wait for them */
+class RunLog {
+public:
+    CompletionTimer::Task task(int tag) {
+        return [this, tag] {
+            std::lock_guard<std::mutex> lock(mLock);
+            mTags.push_back(tag);
+            mTimes.push_back(CompletionTimer::Clock::now());
+            mCond.notify_all();
+        };
+    }
+
+    bool waitFor(size_t count, std::chrono::milliseconds timeout = 1000ms) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCond.wait_for(lock, timeout, [&] { return mTags.size() >= count; });
+    }
+
+    std::vector<int> tags() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mTags;
+    }
+
+    CompletionTimer::Clock::time_point time(size_t i) {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mTimes.at(i);
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<int> mTags;
+    std::vector<CompletionTimer::Clock::time_point> mTimes;
+};
+
+}  // namespace
+
+TEST(CompletionTimerTest, runsTasksInDeadlineOrder) {
+    CompletionTimer timer;
+    RunLog log;
+    const auto start = CompletionTimer::Clock::now() + 20ms;
+
+    timer.scheduleAt(start + 30ms, log.task(3));
+    timer.scheduleAt(start + 10ms, log.task(1));
+    timer.scheduleAt(start + 20ms, log.task(2));
+    /* Same deadline: the one scheduled first runs first */
+    timer.scheduleAt(start + 10ms, log.task(11));
+
+    ASSERT_TRUE(log.waitFor(4));
+    EXPECT_EQ(std::vector<int>({1, 11, 2, 3}), log.tags());
+    EXPECT_GE(log.time(0), start + 10ms);
+    EXPECT_GE(log.time(3), start + 30ms);
+}
+
+TEST(CompletionTimerTest, idsAreUniqueAndNonZero) {
+    CompletionTimer timer;
+    const uint64_t a = timer.schedule(1000ms, [] {});
+    const uint64_t b = timer.schedule(1000ms, [] {});
+
+    EXPECT_NE(0u, a);
+    EXPECT_NE(0u, b);
+    EXPECT_NE(a, b);
+}
+
+TEST(CompletionTimerTest, expediteRunsTaskNow) {
+    CompletionTimer timer;
+    RunLog log;
+    const uint64_t id = timer.schedule(10000ms, log.task(1));
+    timer.schedule(50ms, log.task(2));
+
+    const auto expedited = CompletionTimer::Clock::now();
+    EXPECT_TRUE(timer.expedite(id));
+    ASSERT_TRUE(log.waitFor(1));
+    /* How long a preempted vibration's callback waits; well under a frame */
+    EXPECT_LT(log.time(0) - expedited, 20ms);
+
+    ASSERT_TRUE(log.waitFor(2));
+    EXPECT_EQ(std::vector<int>({1, 2}), log.tags());
+    /* Already ran */
+    EXPECT_FALSE(timer.expedite(id));
+}
+
+TEST(CompletionTimerTest, cancelDropsTask) {
+    CompletionTimer timer;
+    RunLog log;
+    const uint64_t id = timer.schedule(20ms, log.task(1));
+    timer.schedule(40ms, log.task(2));
+
+    EXPECT_TRUE(timer.cancel(id));
+    EXPECT_FALSE(timer.cancel(id));
+    EXPECT_FALSE(timer.expedite(id));
+    ASSERT_TRUE(log.waitFor(1));
+    EXPECT_EQ(std::vector<int>({2}), log.tags());
+}
+
+TEST(CompletionTimerTest, taskMayScheduleAnother) {
+    CompletionTimer timer;
+    RunLog log;
+    CompletionTimer::Task second = log.task(2);
+
+    timer.schedule(0ms, [&] {
+        log.task(1)();
+        timer.schedule(5ms, second);
+    });
+    ASSERT_TRUE(log.waitFor(2));
+    EXPECT_EQ(std::vector<int>({1, 2}), log.tags());
+}
+
+TEST(CompletionTimerTest, destructorDropsPendingTasks) {
+    RunLog log;
+    {
+        CompletionTimer timer;
+        timer.schedule(10000ms, log.task(1));
+    }
+    EXPECT_TRUE(log.tags().empty());
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
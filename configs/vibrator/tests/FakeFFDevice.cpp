@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "FakeFFDevice.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+FakeFFDevice gFake;
+
+void FakeFFDevice::reset(const std::string &newName) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    name = newName;
+    uploads = removals = failUploads = nextId = gainStallMs = 0;
+    effects.clear();
+    lengthMs.clear();
+    mEvents.clear();
+}
+
+int FakeFFDevice::ioctl(IoctlRequest request, uintptr_t arg) {
+    switch (_IOC_NR(request)) {
+    case _IOC_NR(EVIOCGNAME(0)): {
+        size_t len = std::min<size_t>(_IOC_SIZE(request), name.size() + 1);
+        memcpy(reinterpret_cast<char *>(arg), name.c_str(), len);
+        return len;
+    }
+    case _IOC_NR(EVIOCGBIT(EV_FF, 0)): {
+        uint8_t *bits = reinterpret_cast<uint8_t *>(arg);
+        memset(bits, 0, _IOC_SIZE(request));
+        for (int bit : {FF_CONSTANT, FF_PERIODIC, FF_CUSTOM, FF_GAIN})
+            bits[bit / 8] |= 1 << (bit % 8);
+        return _IOC_SIZE(request);
+    }
+    case _IOC_NR(EVIOCSFF):
+        return upload(reinterpret_cast<struct ff_effect *>(arg));
+    case _IOC_NR(EVIOCRMFF):
+        removals++;
+        if (effects.erase(static_cast<int>(arg)) == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        return 0;
+    default:
+        errno = ENOTTY;
+        return -1;
+    }
+}
+
+/* Like the kernel, only updates an effect in place if its type is unchanged */
+int FakeFFDevice::upload(struct ff_effect *effect) {
+    uploads++;
+    if (failUploads > 0) {
+        failUploads--;
+        errno = EIO;
+        return -1;
+    }
+    if (effect->id == -1) {
+        effect->id = nextId++;
+    } else {
+        auto it = effects.find(effect->id);
+        if (it == effects.end() || it->second != effect->type) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    effects[effect->id] = effect->type;
+    if (effect->type == FF_PERIODIC) {
+        int16_t *data = effect->u.periodic.custom_data;
+        auto it = lengthMs.find(data[0]);
+        int length = it != lengthMs.end() ? it->second : 30;
+
+        log(FFEvent::UPLOAD, data[0], effect->u.periodic.magnitude);
+        /* Play length: seconds, then milliseconds */
+        data[1] = length / 1000;
+        data[2] = length % 1000;
+    } else {
+        log(FFEvent::UPLOAD, -1, effect->u.constant.level);
+    }
+    return 0;
+}
+
+void FakeFFDevice::log(FFEvent::Kind kind, int effectId, int value) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mEvents.push_back({std::chrono::steady_clock::now(), kind, effectId, value});
+    mCond.notify_all();
+}
+
+std::vector<FFEvent> FakeFFDevice::events() {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    return mEvents;
+}
+
+bool FakeFFDevice::waitFor(FFEvent::Kind kind, size_t count, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    return mCond.wait_for(lock, timeout, [&] {
+        return (size_t)std::count_if(mEvents.begin(), mEvents.end(),
+                                     [&](const FFEvent &e) { return e.kind == kind; }) >= count;
+    });
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
+
+using aidl::android::hardware::vibrator::FFEvent;
+using aidl::android::hardware::vibrator::gFake;
+
+static bool isFakeNode(int fd) {
+    struct stat st;
+
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+extern "C" int __real_ioctl(int fd, IoctlRequest request, ...);
+extern "C" ssize_t __real_write(int fd, const void *buf, size_t count);
+
+extern "C" int __wrap_ioctl(int fd, IoctlRequest request, ...) {
+    uintptr_t arg;
+    va_list ap;
+
+    va_start(ap, request);
+    arg = va_arg(ap, uintptr_t);
+    va_end(ap);
+    if (!isFakeNode(fd) || _IOC_TYPE(request) != 'E')
+        return __real_ioctl(fd, request, arg);
+    return gFake.ioctl(request, arg);
+}
+
+extern "C" ssize_t __wrap_write(int fd, const void *buf, size_t count) {
+    struct input_event ie;
+
+    if (count == sizeof(ie) && isFakeNode(fd)) {
+        memcpy(&ie, buf, sizeof(ie));
+        if (ie.type == EV_FF && ie.code == FF_GAIN) {
+            gFake.log(FFEvent::GAIN, -1, ie.value);
+            if (gFake.gainStallMs > 0)
+                usleep(gFake.gainStallMs * 1000);
+        } else if (ie.type == EV_FF) {
+            gFake.log(FFEvent::PLAY, -1, ie.value);
+        }
+    }
+    return __real_write(fd, buf, count);
+}
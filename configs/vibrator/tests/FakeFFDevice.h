@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <linux/input.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * The device nodes of the fake tree are regular files, so the evdev ioctls
+ * on them are answered by the fake, with the test linked with
+ * -Wl,--wrap=ioctl. Writes land in the file, and -Wl,--wrap=write also logs
+ * them with the time they were made.
+ */
+#ifdef __BIONIC__
+using IoctlRequest = int;
+#else
+using IoctlRequest = unsigned long;
+#endif
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+/* What reached the device, in order */
+struct FFEvent {
+    enum Kind { UPLOAD, PLAY, GAIN };
+
+    std::chrono::steady_clock::time_point time;
+    Kind kind;
+    /* UPLOAD: the predefined effect id, or -1 for a constant effect */
+    int effectId;
+    /* UPLOAD: magnitude or level, PLAY: 1 to play and 0 to stop, GAIN: gain */
+    int value;
+};
+
+struct FakeFFDevice {
+    std::string name;
+    int uploads = 0;
+    int removals = 0;
+    int failUploads = 0;
+    int nextId = 0;
+    /* Type of each effect uploaded, by id */
+    std::map<int, uint16_t> effects;
+    /* Play length the driver reports for a predefined effect, 30ms if not listed */
+    std::map<int, int> lengthMs;
+    /* How long an FF_GAIN write takes, to hold up the HAL while it is made */
+    int gainStallMs = 0;
+
+    /* Forgets everything, and answers as a device called name from now on */
+    void reset(const std::string &newName);
+    int ioctl(IoctlRequest request, uintptr_t arg);
+    int upload(struct ff_effect *effect);
+    void log(FFEvent::Kind kind, int effectId, int value);
+
+    std::vector<FFEvent> events();
+    /* Waits until count events of the kind were logged */
+    bool waitFor(FFEvent::Kind kind, size_t count,
+                 std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<FFEvent> mEvents;
+};
+
+/* The device behind every node of the fake tree */
+extern FakeFFDevice gFake;
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <linux/input.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "FakeFFDevice.h"
+#include "Vibrator.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+class InputFFDeviceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        gFake.reset("qti-haptics");
+        mPaths.inputDir = std::string(mDir.path) + "/dev/";
+        mPaths.sysfsInputDir = std::string(mDir.path) + "/sys/";
+        mPaths.deviceCache = std::string(mDir.path) + "/ff_device";
+        ASSERT_EQ(0, mkdir(mPaths.inputDir.c_str(), 0755));
+        ASSERT_EQ(0, mkdir(mPaths.sysfsInputDir.c_str(), 0755));
+    }
+
+    /* Adds eventN with the given sysfs name and an empty device node */
+    void addDevice(const std::string &event, const std::string &name) {
+        std::string dir = mPaths.sysfsInputDir + event;
+
+        ASSERT_EQ(0, mkdir(dir.c_str(), 0755));
+        ASSERT_EQ(0, mkdir((dir + "/device").c_str(), 0755));
+        ASSERT_TRUE(::android::base::WriteStringToFile(name + "\n", dir + "/device/name"));
+        ASSERT_TRUE(::android::base::WriteStringToFile("", mPaths.inputDir + event));
+    }
+
+    /* The (code, value) of every play event written to eventN, in order */
+    std::vector<std::pair<int, int>> plays(const std::string &event) {
+        std::vector<std::pair<int, int>> result;
+        std::string data;
+
+        EXPECT_TRUE(::android::base::ReadFileToString(mPaths.inputDir + event, &data));
+        for (size_t i = 0; i + sizeof(struct input_event) <= data.size();
+                i += sizeof(struct input_event)) {
+            struct input_event ie;
+
+            memcpy(&ie, &data[i], sizeof(ie));
+            EXPECT_EQ(EV_FF, ie.type);
+            if (ie.code != FF_GAIN)
+                result.emplace_back(ie.code, ie.value);
+        }
+        return result;
+    }
+
+    void writeCache(const std::string &event, const std::string &name) {
+        ASSERT_TRUE(::android::base::WriteStringToFile(
+                mPaths.inputDir + event + "\n" + name + "\n", mPaths.deviceCache));
+    }
+
+    std::string cache() {
+        std::string data;
+
+        EXPECT_TRUE(::android::base::ReadFileToString(mPaths.deviceCache, &data));
+        return data;
+    }
+
+    TemporaryDir mDir;
+    InputFFPaths mPaths;
+};
+
+/* Tells whether a file was opened since the watch was added */
+class OpenWatch {
+public:
+    explicit OpenWatch(const std::string &path) : mFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+        EXPECT_GE(inotify_add_watch(mFd, path.c_str(), IN_OPEN), 0);
+    }
+    ~OpenWatch() { close(mFd); }
+
+    bool opened() {
+        char buf[sizeof(struct inotify_event) + NAME_MAX + 1];
+
+        return read(mFd, buf, sizeof(buf)) > 0;
+    }
+
+private:
+    const int mFd;
+};
+
+TEST_F(InputFFDeviceTest, sysfsLookupSavesCache) {
+    addDevice("event1", "gpio-keys");
+    addDevice("event4", "qti-haptics");
+    OpenWatch keys(mPaths.inputDir + "event1");
+    InputFFDevice ff(mPaths);
+
+    ASSERT_EQ(0, ff.on(100));
+    EXPECT_EQ(1u, plays("event4").size());
+    /* Found by name in sysfs, the other node is left alone */
+    EXPECT_FALSE(keys.opened());
+    EXPECT_EQ(mPaths.inputDir + "event4\nqti-haptics\n", cache());
+}
+
+TEST_F(InputFFDeviceTest, cachedDeviceIsUsed) {
+    addDevice("event2", "qti-haptics");
+    addDevice("event5", "qti-haptics");
+    writeCache("event5", "qti-haptics");
+    OpenWatch other(mPaths.inputDir + "event2");
+    InputFFDevice ff(mPaths);
+
+    ASSERT_EQ(0, ff.on(100));
+    EXPECT_EQ(1u, plays("event5").size());
+    EXPECT_FALSE(other.opened());
+}
+
+TEST_F(InputFFDeviceTest, staleCachedNodeIsNotOpened) {
+    /* The haptics device moved from event5 to event2 since the cache was saved */
+    addDevice("event2", "qti-haptics");
+    addDevice("event5", "gpio-keys");
+    writeCache("event5", "qti-haptics");
+    OpenWatch stale(mPaths.inputDir + "event5");
+    InputFFDevice ff(mPaths);
+
+    EXPECT_FALSE(stale.opened());
+    ASSERT_EQ(0, ff.on(100));
+    EXPECT_EQ(1u, plays("event2").size());
+    EXPECT_EQ(mPaths.inputDir + "event2\nqti-haptics\n", cache());
+}
+
+TEST_F(InputFFDeviceTest, cacheOutsideInputDirIsIgnored) {
+    addDevice("event2", "qti-haptics");
+    ASSERT_TRUE(::android::base::WriteStringToFile(
+            std::string(mDir.path) + "/elsewhere\nqti-haptics\n", mPaths.deviceCache));
+    InputFFDevice ff(mPaths);
+
+    ASSERT_EQ(0, ff.on(100));
+    EXPECT_EQ(1u, plays("event2").size());
+    EXPECT_EQ(mPaths.inputDir + "event2\nqti-haptics\n", cache());
+}
+
+TEST_F(InputFFDeviceTest, replayingLoadedEffectOnlyPlays) {
+    addDevice("event3", "qti-haptics");
+    InputFFDevice ff(mPaths);
+    long lengthMs = 0;
+
+    ASSERT_TRUE(ff.mSupportEffects);
+    ASSERT_EQ(0, ff.playEffect(static_cast<int>(Effect::CLICK), EffectStrength::STRONG,
+                               &lengthMs));
+    EXPECT_EQ(30, lengthMs);
+    lengthMs = 0;
+    ASSERT_EQ(0, ff.playEffect(static_cast<int>(Effect::CLICK), EffectStrength::STRONG,
+                               &lengthMs));
+    /* The length is remembered from the upload */
+    EXPECT_EQ(30, lengthMs);
+
+    EXPECT_EQ(1, gFake.uploads);
+    EXPECT_EQ(0, gFake.removals);
+    const std::vector<std::pair<int, int>> expected = {{0, 1}, {0, 1}};
+    EXPECT_EQ(expected, plays("event3"));
+}
+
+TEST_F(InputFFDeviceTest, otherEffectOfSameTypeIsUpdatedInPlace) {
+    addDevice("event3", "qti-haptics");
+    InputFFDevice ff(mPaths);
+    long lengthMs;
+
+    ASSERT_EQ(0, ff.playEffect(static_cast<int>(Effect::CLICK), EffectStrength::STRONG,
+                               &lengthMs));
+    ASSERT_EQ(0, ff.playEffect(static_cast<int>(Effect::TICK), EffectStrength::STRONG,
+                               &lengthMs));
+    /* A new strength is a new magnitude, so it is uploaded too */
+    ASSERT_EQ(0, ff.playEffect(static_cast<int>(Effect::TICK), EffectStrength::LIGHT,
+                               &lengthMs));
+
+    EXPECT_EQ(3, gFake.uploads);
+    EXPECT_EQ(0, gFake.removals);
+    EXPECT_EQ(1u, gFake.effects.size());
+}
+
+TEST_F(InputFFDeviceTest, typeChangeRemovesEffectFirst) {
+    addDevice("event3", "qti-haptics");
+    InputFFDevice ff(mPaths);
+    long lengthMs;
+
+    ASSERT_EQ(0, ff.playEffect(static_cast<int>(Effect::CLICK), EffectStrength::STRONG,
+                               &lengthMs));
+    /* Periodic to constant */
+    ASSERT_EQ(0, ff.on(100));
+    EXPECT_EQ(1, gFake.removals);
+    EXPECT_EQ(2, gFake.uploads);
+    /* Same constant effect, only played */
+    ASSERT_EQ(0, ff.on(100));
+    EXPECT_EQ(2, gFake.uploads);
+    /* Another length is the same type, updated in place */
+    ASSERT_EQ(0, ff.on(200));
+    EXPECT_EQ(3, gFake.uploads);
+    EXPECT_EQ(1, gFake.removals);
+    /* And back */
+    ASSERT_EQ(0, ff.playEffect(static_cast<int>(Effect::CLICK), EffectStrength::STRONG,
+                               &lengthMs));
+    EXPECT_EQ(4, gFake.uploads);
+    EXPECT_EQ(2, gFake.removals);
+    EXPECT_EQ(1u, gFake.effects.size());
+
+    ASSERT_EQ(0, ff.off());
+    std::vector<std::pair<int, int>> events = plays("event3");
+    ASSERT_EQ(6u, events.size());
+    /* off() stops the slot that was last played */
+    EXPECT_EQ(std::make_pair(gFake.effects.begin()->first, 0), events.back());
+}
+
+TEST_F(InputFFDeviceTest, failedUploadIsRetried) {
+    addDevice("event3", "qti-haptics");
+    InputFFDevice ff(mPaths);
+
+    gFake.failUploads = 1;
+    EXPECT_NE(0, ff.on(100));
+    EXPECT_TRUE(plays("event3").empty());
+    ASSERT_EQ(0, ff.on(100));
+    EXPECT_EQ(2, gFake.uploads);
+    EXPECT_EQ(1u, plays("event3").size());
+}
+
+TEST_F(InputFFDeviceTest, probedEffectIsNotUploadedAgain) {
+    addDevice("event3", "qti-haptics");
+    InputFFDevice ff(mPaths);
+    long lengthMs;
+
+    ASSERT_EQ(0, ff.probeEffect(static_cast<int>(Effect::THUD)));
+    EXPECT_EQ(30, ff.effectLengthMs(static_cast<int>(Effect::THUD)));
+    EXPECT_TRUE(plays("event3").empty());
+    ASSERT_EQ(0, ff.playEffect(static_cast<int>(Effect::THUD), EffectStrength::STRONG,
+                               &lengthMs));
+    EXPECT_EQ(1, gFake.uploads);
+    EXPECT_EQ(1u, plays("event3").size());
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
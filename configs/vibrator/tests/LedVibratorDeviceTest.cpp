@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "Vibrator.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+/* The LED class attributes, as plain files in a temporary directory */
+class LedVibratorDeviceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (const char *attr : {"activate", "state", "duration"})
+            ASSERT_TRUE(::android::base::WriteStringToFile("", path(attr)));
+    }
+
+    std::string path(const std::string &attr) { return std::string(mDir.path) + "/" + attr; }
+
+    /* The value last written, which is NUL terminated like the HAL writes it */
+    std::string value(const std::string &attr) {
+        std::string data;
+
+        EXPECT_TRUE(::android::base::ReadFileToString(path(attr), &data));
+        return data.substr(0, data.find_first_of(std::string("\n\0", 2)));
+    }
+
+    void mark(const std::string &attr) {
+        ASSERT_TRUE(::android::base::WriteStringToFile("x", path(attr)));
+    }
+
+    TemporaryDir mDir;
+};
+
+TEST_F(LedVibratorDeviceTest, onWritesAllAttributes) {
+    LedVibratorDevice led(mDir.path);
+
+    ASSERT_TRUE(led.mDetected);
+    ASSERT_EQ(0, led.on(100));
+    EXPECT_EQ("1", value("state"));
+    EXPECT_EQ("100", value("duration"));
+    EXPECT_EQ("1", value("activate"));
+
+    ASSERT_EQ(0, led.off());
+    EXPECT_EQ("0", value("activate"));
+}
+
+TEST_F(LedVibratorDeviceTest, unchangedAttributesAreNotRewritten) {
+    LedVibratorDevice led(mDir.path);
+
+    ASSERT_EQ(0, led.on(100));
+    mark("state");
+    mark("duration");
+    mark("activate");
+
+    ASSERT_EQ(0, led.on(100));
+    EXPECT_EQ("x", value("state"));
+    EXPECT_EQ("x", value("duration"));
+    EXPECT_EQ("1", value("activate"));
+
+    ASSERT_EQ(0, led.on(50));
+    EXPECT_EQ("x", value("state"));
+    EXPECT_EQ("50", value("duration"));
+}
+
+TEST_F(LedVibratorDeviceTest, attributesStayOpen) {
+    LedVibratorDevice led(mDir.path);
+
+    /* Writes still reach the files opened at construction */
+    ASSERT_EQ(0, unlink(path("state").c_str()));
+    ASSERT_EQ(0, unlink(path("duration").c_str()));
+    ASSERT_EQ(0, unlink(path("activate").c_str()));
+    EXPECT_EQ(0, led.on(100));
+    EXPECT_EQ(0, led.off());
+}
+
+TEST_F(LedVibratorDeviceTest, missingAttributeFailsAndIsRetried) {
+    ASSERT_EQ(0, unlink(path("duration").c_str()));
+    LedVibratorDevice led(mDir.path);
+
+    ASSERT_TRUE(led.mDetected);
+    EXPECT_EQ(-ENODEV, led.on(100));
+    /* The cached state was dropped, so it is written again */
+    mark("state");
+    EXPECT_EQ(-ENODEV, led.on(100));
+    EXPECT_EQ("1", value("state"));
+    EXPECT_EQ("", value("activate"));
+}
+
+TEST_F(LedVibratorDeviceTest, notDetectedWithoutActivate) {
+    ASSERT_EQ(0, unlink(path("activate").c_str()));
+    LedVibratorDevice led(mDir.path);
+
+    EXPECT_FALSE(led.mDetected);
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <aidl/android/hardware/vibrator/BnVibratorCallback.h>
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FakeFFDevice.h"
+#include "Vibrator.h"
+
+using std::chrono_literals::operator""ms;
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/* Play lengths the fake driver reports for the composition primitives */
+constexpr int CLICK_MS = 15;
+constexpr int THUD_MS = 25;
+constexpr int TICK_MS = 5;
+
+/* As in Vibrator.cpp */
+constexpr int LIGHT_MAGNITUDE = 0x3fff;
+constexpr int STRONG_MAGNITUDE = 0x7fff;
+constexpr auto AMPLITUDE_INTERVAL = 5ms;
+
+/* The FF_GAIN written for an amplitude */
+int gain(float amplitude) {
+    return LIGHT_MAGNITUDE +
+           (uint8_t)(amplitude * 0xff) * (STRONG_MAGNITUDE - LIGHT_MAGNITUDE) / 255;
+}
+
+/* Records when the HAL reported the vibration complete */
+class CompletionCallback : public BnVibratorCallback {
+public:
+    ndk::ScopedAStatus onComplete() override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mTimes.push_back(Clock::now());
+        mCond.notify_all();
+        return ndk::ScopedAStatus::ok();
+    }
+
+    bool waitFor(std::chrono::milliseconds timeout = 1000ms) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCond.wait_for(lock, timeout, [&] { return !mTimes.empty(); });
+    }
+
+    std::vector<Clock::time_point> times() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mTimes;
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<Clock::time_point> mTimes;
+};
+
+CompositeEffect step(int32_t delayMs, CompositePrimitive primitive, float scale = 1.0f) {
+    CompositeEffect e;
+
+    e.delayMs = delayMs;
+    e.primitive = primitive;
+    e.scale = scale;
+    return e;
+}
+
+}  // namespace
+
+class VibratorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::string dir = std::string(mDir.path) + "/sys/event0";
+
+        gFake.reset("qti-haptics");
+        gFake.lengthMs[static_cast<int>(Effect::CLICK)] = CLICK_MS;
+        gFake.lengthMs[static_cast<int>(Effect::THUD)] = THUD_MS;
+        gFake.lengthMs[static_cast<int>(Effect::TICK)] = TICK_MS;
+        mPaths.inputDir = std::string(mDir.path) + "/dev/";
+        mPaths.sysfsInputDir = std::string(mDir.path) + "/sys/";
+        mPaths.deviceCache = std::string(mDir.path) + "/ff_device";
+        ASSERT_EQ(0, mkdir(mPaths.inputDir.c_str(), 0755));
+        ASSERT_EQ(0, mkdir(mPaths.sysfsInputDir.c_str(), 0755));
+        ASSERT_EQ(0, mkdir(dir.c_str(), 0755));
+        ASSERT_EQ(0, mkdir((dir + "/device").c_str(), 0755));
+        ASSERT_TRUE(::android::base::WriteStringToFile("qti-haptics\n", dir + "/device/name"));
+        ASSERT_TRUE(::android::base::WriteStringToFile("", mPaths.inputDir + "event0"));
+    }
+
+    /* The HAL on the fake device, with the lengths set up for it probed */
+    std::shared_ptr<Vibrator> makeVibrator() {
+        auto vib = ndk::SharedRefBase::make<Vibrator>(mPaths, std::string(mDir.path) + "/led");
+
+        mProbed = gFake.events().size();
+        return vib;
+    }
+
+    /* The events of the kind that reached the device since makeVibrator() */
+    std::vector<FFEvent> events(FFEvent::Kind kind) {
+        std::vector<FFEvent> all = gFake.events(), result;
+
+        for (size_t i = mProbed; i < all.size(); i++) {
+            if (all[i].kind == kind)
+                result.push_back(all[i]);
+        }
+        return result;
+    }
+
+    /* Waits for count events of the kind since makeVibrator() */
+    bool waitFor(FFEvent::Kind kind, size_t count) {
+        std::vector<FFEvent> all = gFake.events();
+        size_t probed = 0;
+
+        for (size_t i = 0; i < mProbed; i++)
+            probed += all[i].kind == kind;
+        return gFake.waitFor(kind, probed + count);
+    }
+
+    /*
+     * Sets the amplitudes in a row once a write slot is free, so the first is
+     * written at once and the others are held. Returns false if this thread
+     * was too slow to set them all inside one interval.
+     */
+    bool setWithinInterval(const std::shared_ptr<Vibrator> &vib,
+                           const std::vector<float> &amplitudes) {
+        std::this_thread::sleep_for(AMPLITUDE_INTERVAL);
+        const auto first = Clock::now();
+
+        for (float amplitude : amplitudes)
+            EXPECT_TRUE(vib->setAmplitude(amplitude).isOk());
+        return Clock::now() < first + AMPLITUDE_INTERVAL;
+    }
+
+    /* The gains written since makeVibrator() */
+    std::vector<int> gains() {
+        std::vector<int> result;
+
+        for (const FFEvent &e : events(FFEvent::GAIN))
+            result.push_back(e.value);
+        return result;
+    }
+
+    /* Checks no two gains were written less than an interval apart */
+    void expectPaced() {
+        std::vector<FFEvent> written = events(FFEvent::GAIN);
+
+        /* Less a little for the time between taking the slot and writing */
+        for (size_t i = 1; i < written.size(); i++)
+            EXPECT_GE(written[i].time - written[i - 1].time, AMPLITUDE_INTERVAL - 1ms);
+    }
+
+    TemporaryDir mDir;
+    InputFFPaths mPaths;
+    size_t mProbed = 0;
+};
+
+TEST_F(VibratorTest, primitiveDurationIsProbedLength) {
+    auto vib = makeVibrator();
+    int32_t durationMs;
+
+    ASSERT_TRUE(vib->getPrimitiveDuration(CompositePrimitive::CLICK, &durationMs).isOk());
+    EXPECT_EQ(CLICK_MS, durationMs);
+    ASSERT_TRUE(vib->getPrimitiveDuration(CompositePrimitive::THUD, &durationMs).isOk());
+    EXPECT_EQ(THUD_MS, durationMs);
+    ASSERT_TRUE(vib->getPrimitiveDuration(CompositePrimitive::LIGHT_TICK, &durationMs).isOk());
+    EXPECT_EQ(TICK_MS, durationMs);
+    ASSERT_TRUE(vib->getPrimitiveDuration(CompositePrimitive::NOOP, &durationMs).isOk());
+    EXPECT_EQ(0, durationMs);
+    EXPECT_EQ(EX_UNSUPPORTED_OPERATION,
+              vib->getPrimitiveDuration(CompositePrimitive::SPIN, &durationMs).getExceptionCode());
+    /* Probing is all it takes, nothing was played */
+    EXPECT_TRUE(events(FFEvent::PLAY).empty());
+}
+
+TEST_F(VibratorTest, primitiveWithoutLengthIsUnsupported) {
+    gFake.lengthMs[static_cast<int>(Effect::THUD)] = 0;
+    auto vib = makeVibrator();
+    std::vector<CompositePrimitive> supported;
+    int32_t durationMs;
+
+    ASSERT_TRUE(vib->getSupportedPrimitives(&supported).isOk());
+    EXPECT_EQ(std::vector<CompositePrimitive>({CompositePrimitive::NOOP, CompositePrimitive::CLICK,
+                                               CompositePrimitive::LIGHT_TICK}),
+              supported);
+    EXPECT_EQ(EX_UNSUPPORTED_OPERATION,
+              vib->getPrimitiveDuration(CompositePrimitive::THUD, &durationMs).getExceptionCode());
+    EXPECT_EQ(EX_UNSUPPORTED_OPERATION,
+              vib->compose({step(0, CompositePrimitive::THUD)}, nullptr).getExceptionCode());
+}
+
+TEST_F(VibratorTest, invalidCompositionIsRejected) {
+    auto vib = makeVibrator();
+    std::vector<CompositeEffect> tooLong(128, step(0, CompositePrimitive::CLICK));
+
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT, vib->compose({}, nullptr).getExceptionCode());
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT, vib->compose(tooLong, nullptr).getExceptionCode());
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT,
+              vib->compose({step(-1, CompositePrimitive::CLICK)}, nullptr).getExceptionCode());
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT,
+              vib->compose({step(10001, CompositePrimitive::CLICK)}, nullptr).getExceptionCode());
+    EXPECT_EQ(EX_ILLEGAL_ARGUMENT,
+              vib->compose({step(0, CompositePrimitive::CLICK, 1.5f)}, nullptr)
+                      .getExceptionCode());
+    /* Checked up front: the valid first step is not played either */
+    EXPECT_EQ(EX_UNSUPPORTED_OPERATION,
+              vib->compose({step(0, CompositePrimitive::CLICK), step(0, CompositePrimitive::SPIN)},
+                           nullptr)
+                      .getExceptionCode());
+
+    std::this_thread::sleep_for(50ms);
+    EXPECT_TRUE(events(FFEvent::UPLOAD).empty());
+    EXPECT_TRUE(events(FFEvent::PLAY).empty());
+}
+
+TEST_F(VibratorTest, composePlaysStepsAtTheirOffsets) {
+    auto vib = makeVibrator();
+    auto callback = ndk::SharedRefBase::make<CompletionCallback>();
+    const auto start = Clock::now();
+
+    ASSERT_TRUE(vib->compose({step(0, CompositePrimitive::CLICK),
+                              step(20, CompositePrimitive::THUD, 0.5f),
+                              step(0, CompositePrimitive::NOOP),
+                              step(10, CompositePrimitive::LIGHT_TICK, 0.2f)},
+                             callback)
+                        .isOk());
+    ASSERT_TRUE(waitFor(FFEvent::PLAY, 3));
+    ASSERT_TRUE(callback->waitFor());
+
+    /* Each step starts once the delay after the previous one has ended */
+    const std::vector<std::chrono::milliseconds> offsets = {
+            0ms, 20ms + std::chrono::milliseconds(CLICK_MS),
+            30ms + std::chrono::milliseconds(CLICK_MS + THUD_MS)};
+    std::vector<FFEvent> uploads = events(FFEvent::UPLOAD), plays = events(FFEvent::PLAY);
+
+    ASSERT_EQ(3u, uploads.size());
+    EXPECT_EQ(static_cast<int>(Effect::CLICK), uploads[0].effectId);
+    EXPECT_EQ(static_cast<int>(Effect::THUD), uploads[1].effectId);
+    EXPECT_EQ(static_cast<int>(Effect::TICK), uploads[2].effectId);
+    ASSERT_EQ(3u, plays.size());
+    for (size_t i = 0; i < plays.size(); i++) {
+        EXPECT_EQ(1, plays[i].value);
+        EXPECT_GE(plays[i].time, start + offsets[i]);
+        EXPECT_LT(plays[i].time, start + offsets[i] + 50ms);
+        EXPECT_GE(plays[i].time, uploads[i].time);
+    }
+
+    /* Complete once the last step has played out, not as soon as it started */
+    ASSERT_EQ(1u, callback->times().size());
+    EXPECT_GE(callback->times()[0],
+              start + 30ms + std::chrono::milliseconds(CLICK_MS + THUD_MS + TICK_MS));
+}
+
+TEST_F(VibratorTest, offStopsComposition) {
+    auto vib = makeVibrator();
+    auto callback = ndk::SharedRefBase::make<CompletionCallback>();
+
+    ASSERT_TRUE(vib->compose({step(0, CompositePrimitive::CLICK),
+                              step(100, CompositePrimitive::THUD)},
+                             callback)
+                        .isOk());
+    ASSERT_TRUE(waitFor(FFEvent::PLAY, 1));
+    const auto off = Clock::now();
+    ASSERT_TRUE(vib->off().isOk());
+
+    /* The callback is not left waiting for the steps that will not play */
+    ASSERT_TRUE(callback->waitFor());
+    EXPECT_LT(callback->times()[0], off + 50ms);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(150 + CLICK_MS + THUD_MS));
+    std::vector<FFEvent> plays = events(FFEvent::PLAY);
+    ASSERT_EQ(2u, plays.size());
+    EXPECT_EQ(1, plays[0].value);
+    EXPECT_EQ(0, plays[1].value);
+    EXPECT_EQ(1u, events(FFEvent::UPLOAD).size());
+    EXPECT_EQ(1u, callback->times().size());
+}
+
+/*
+ * A step that came due while the HAL was busy already left the timer queue,
+ * so off() cannot cancel it and it must see the vibration was preempted.
+ */
+TEST_F(VibratorTest, offStopsStepAlreadyDue) {
+    auto vib = makeVibrator();
+
+    ASSERT_TRUE(vib->compose({step(0, CompositePrimitive::CLICK),
+                              step(30, CompositePrimitive::THUD)},
+                             nullptr)
+                        .isOk());
+    ASSERT_TRUE(waitFor(FFEvent::PLAY, 1));
+
+    /* The THUD step comes due while this holds the HAL in its FF_GAIN write */
+    gFake.gainStallMs = 100;
+    std::thread busy([&] { EXPECT_TRUE(vib->setAmplitude(0.5f).isOk()); });
+    ASSERT_TRUE(waitFor(FFEvent::GAIN, 1));
+    ASSERT_TRUE(vib->off().isOk());
+    busy.join();
+
+    std::this_thread::sleep_for(50ms);
+    std::vector<FFEvent> plays = events(FFEvent::PLAY);
+    ASSERT_FALSE(plays.empty());
+    EXPECT_EQ(0, plays.back().value);
+}
+
+TEST_F(VibratorTest, amplitudeWritesArePaced) {
+    auto vib = makeVibrator();
+    const auto end = Clock::now() + 50ms;
+    float amplitude = 0;
+
+    for (int i = 0; Clock::now() < end; i++) {
+        amplitude = (i % 250 + 1) / 250.0f;
+        ASSERT_TRUE(vib->setAmplitude(amplitude).isOk());
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    std::this_thread::sleep_for(2 * AMPLITUDE_INTERVAL);
+
+    expectPaced();
+    std::vector<int> written = gains();
+    ASSERT_GE(written.size(), 2u);
+    EXPECT_LE(written.size(), 50ms / AMPLITUDE_INTERVAL + 2);
+    /* The last value set is not lost to the pacing */
+    EXPECT_EQ(gain(amplitude), written.back());
+}
+
+TEST_F(VibratorTest, laterAmplitudeReplacesHeldOne) {
+    auto vib = makeVibrator();
+
+    if (!setWithinInterval(vib, {0.2f, 0.4f, 0.6f}))
+        GTEST_SKIP() << "Amplitudes not set inside one interval";
+    std::this_thread::sleep_for(2 * AMPLITUDE_INTERVAL);
+
+    EXPECT_EQ(std::vector<int>({gain(0.2f), gain(0.6f)}), gains());
+    expectPaced();
+}
+
+TEST_F(VibratorTest, repeatedAmplitudeIsNotWritten) {
+    auto vib = makeVibrator();
+
+    ASSERT_TRUE(vib->setAmplitude(0.5f).isOk());
+    std::this_thread::sleep_for(2 * AMPLITUDE_INTERVAL);
+    ASSERT_TRUE(vib->setAmplitude(0.5f).isOk());
+    std::this_thread::sleep_for(2 * AMPLITUDE_INTERVAL);
+    EXPECT_EQ(std::vector<int>({gain(0.5f)}), gains());
+
+    /* Nor is a held value that went back to the one written */
+    if (!setWithinInterval(vib, {0.5f, 0.7f, 0.5f}))
+        GTEST_SKIP() << "Amplitudes not set inside one interval";
+    std::this_thread::sleep_for(2 * AMPLITUDE_INTERVAL);
+    EXPECT_EQ(std::vector<int>({gain(0.5f)}), gains());
+}
+
+TEST_F(VibratorTest, heldAmplitudeIsWrittenBeforeUpload) {
+    auto vib = makeVibrator();
+    std::vector<FFEvent> uploads;
+    int32_t lengthMs;
+
+    if (!setWithinInterval(vib, {0.2f, 0.8f}))
+        GTEST_SKIP() << "Amplitudes not set inside one interval";
+    ASSERT_TRUE(vib->on(100, nullptr).isOk());
+    uploads = events(FFEvent::UPLOAD);
+    ASSERT_EQ(1u, uploads.size());
+    /* The constant effect already plays at the held amplitude */
+    EXPECT_EQ(gain(0.8f), uploads.back().value);
+    EXPECT_EQ(std::vector<int>({gain(0.2f), gain(0.8f)}), gains());
+    EXPECT_LE(events(FFEvent::GAIN).back().time, uploads.back().time);
+
+    if (!setWithinInterval(vib, {0.3f, 0.6f}))
+        GTEST_SKIP() << "Amplitudes not set inside one interval";
+    ASSERT_TRUE(vib->perform(Effect::CLICK, EffectStrength::MEDIUM, nullptr, &lengthMs).isOk());
+    uploads = events(FFEvent::UPLOAD);
+    ASSERT_EQ(2u, uploads.size());
+    EXPECT_EQ(4u, gains().size());
+    EXPECT_EQ(gain(0.6f), gains().back());
+    EXPECT_LE(events(FFEvent::GAIN).back().time, uploads.back().time);
+
+    if (!setWithinInterval(vib, {0.4f, 0.9f}))
+        GTEST_SKIP() << "Amplitudes not set inside one interval";
+    ASSERT_TRUE(vib->compose({step(0, CompositePrimitive::THUD)}, nullptr).isOk());
+    ASSERT_TRUE(waitFor(FFEvent::UPLOAD, 3));
+    uploads = events(FFEvent::UPLOAD);
+    EXPECT_EQ(6u, gains().size());
+    EXPECT_EQ(gain(0.9f), gains().back());
+    EXPECT_LE(events(FFEvent::GAIN).back().time, uploads.back().time);
+
+    /* Flushed, so not written again once its slot comes */
+    std::this_thread::sleep_for(2 * AMPLITUDE_INTERVAL);
+    EXPECT_EQ(6u, gains().size());
+}
+
+TEST_F(VibratorTest, heldAmplitudeIsDroppedAfterOff) {
+    auto vib = makeVibrator();
+
+    ASSERT_TRUE(vib->on(1000, nullptr).isOk());
+    if (!setWithinInterval(vib, {0.2f, 0.8f}))
+        GTEST_SKIP() << "Amplitudes not set inside one interval";
+    ASSERT_TRUE(vib->off().isOk());
+    std::this_thread::sleep_for(2 * AMPLITUDE_INTERVAL);
+
+    EXPECT_EQ(std::vector<int>({gain(0.2f)}), gains());
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
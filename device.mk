@@ -398,10 +398,8 @@ PRODUCT_PACKAGES += \
 
 # Power
 PRODUCT_PACKAGES += \
-    android.hardware.power-service.xiaomi-sm8250-libperfmgr
-
-PRODUCT_COPY_FILES += \
-    $(LOCAL_PATH)/configs/power/powerhint.json:$(TARGET_COPY_OUT_VENDOR)/etc/powerhint.json
+    android.hardware.power-service.xiaomi-sm8250-libperfmgr \
+    powerhint.json-xiaomi-sm8250
 
 # Public libraries
 PRODUCT_COPY_FILES += \
@@ -37,12 +37,15 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <linux/fs.h>
 #include <limits.h>
 #include <dirent.h>
 #include <linux/kernel.h>
+#include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #ifndef __STDC_FORMAT_MACROS
@@ -146,16 +149,10 @@ static int blk_rw(int fd, int rw, int64_t offset, uint8_t *buf, unsigned len)
 {
     int r;
 
-    if (lseek64(fd, offset, SEEK_SET) < 0) {
-        fprintf(stderr, "block dev lseek64 %" PRIi64 " failed: %s\n", offset,
-                strerror(errno));
-        return -1;
-    }
-
     if (rw)
-        r = write(fd, buf, len);
+        r = pwrite64(fd, buf, len, offset);
     else
-        r = read(fd, buf, len);
+        r = pread64(fd, buf, len, offset);
 
     if (r < 0) {
         fprintf(stderr, "block dev %s failed: %s\n", rw ? "write" : "read",
@@ -173,49 +170,179 @@ static int blk_rw(int fd, int rw, int64_t offset, uint8_t *buf, unsigned len)
     return r;
 }
 
+/**
+ *  ==========================================================================
+ *
+ *  \brief  Write one copy of the GPT (header and partition entries array)
+ *  and wait for it to reach the block dev
+ *
+ *  A copy torn by a crash fails its CRC checks and the other copy is used
+ *  instead, so the other copy must not be written before this returns.
+ *  The two regions go out in a single pwritev when they are adjacent.
+ *
+ *  \param [in] fd               block dev file descriptor
+ *  \param [in] header           GPT header, block_size bytes
+ *  \param [in] header_offset    block dev offset of the header [bytes]
+ *  \param [in] block_size       block dev logical block size [bytes]
+ *  \param [in] pentries         Partition entries array
+ *  \param [in] pentries_offset  block dev offset of the array [bytes]
+ *  \param [in] pentries_size    Partition entries array size [bytes]
+ *
+ *  \return  0 on success
+ *
+ *  ==========================================================================
+ */
+static int gpt_write_copy(int fd, uint8_t *header, int64_t header_offset,
+                          uint32_t block_size, uint8_t *pentries,
+                          int64_t pentries_offset, uint32_t pentries_size)
+{
+    struct iovec iov[2];
+    int64_t  offset[2];
+    unsigned i;
+    unsigned writes;
+
+    /* Backup copy: the array sits right before the header */
+    if (pentries_offset + pentries_size == header_offset) {
+        iov[0] = { pentries, pentries_size };
+        iov[1] = { header, block_size };
+        offset[0] = pentries_offset;
+        writes = 1;
+    /* Primary copy: the header sits right before the array */
+    } else if (header_offset + block_size == pentries_offset) {
+        iov[0] = { header, block_size };
+        iov[1] = { pentries, pentries_size };
+        offset[0] = header_offset;
+        writes = 1;
+    } else {
+        iov[0] = { header, block_size };
+        iov[1] = { pentries, pentries_size };
+        offset[0] = header_offset;
+        offset[1] = pentries_offset;
+        writes = 2;
+    }
+
+    for (i = 0; i < writes; i++) {
+        struct iovec *vec = &iov[i];
+        int      vec_count = writes == 1 ? 2 : 1;
+        int64_t  pos = offset[i];
+        ssize_t  r;
+
+        while (vec_count > 0) {
+            r = TEMP_FAILURE_RETRY(pwritev64(fd, vec, vec_count, pos));
+            if (r <= 0) {
+                fprintf(stderr, "block dev write %" PRIi64 " failed: %s\n",
+                        pos, r < 0 ? strerror(errno) : "short write");
+                return -1;
+            }
+            pos += r;
+            /* Skip what was written, for the rare short write */
+            while (vec_count > 0 && (size_t) r >= vec->iov_len) {
+                r -= vec->iov_len;
+                vec++;
+                vec_count--;
+            }
+            if (vec_count > 0) {
+                vec->iov_base = (uint8_t *) vec->iov_base + r;
+                vec->iov_len -= r;
+            }
+        }
+    }
 
+    if (fdatasync(fd) < 0) {
+        fprintf(stderr, "fdatasync failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+//Positions of the partition entries in an array, by name. Entries are
+//listed in table order, so a name's primary comes before its backup.
+struct gpt_name_index {
+    unordered_map<string, vector<uint32_t>> entries;
+};
 
 /**
  *  ==========================================================================
  *
- *  \brief  Search within GPT for partition entry with the given name
- *  or it's backup twin (name-bak).
+ *  \brief  Index the partition entries array by partition name
  *
- *  \param [in] ptn_name        Partition name to seek
  *  \param [in] pentries_start  Partition entries array start pointer
  *  \param [in] pentries_end    Partition entries array end pointer
  *  \param [in] pentry_size     Single partition entry size [bytes]
  *
- *  \return  First partition entry pointer that matches the name or NULL
+ *  \return  Index to be freed with delete, built in one pass over the array
  *
  *  ==========================================================================
  */
-static uint8_t *gpt_pentry_seek(const char *ptn_name,
-                                const uint8_t *pentries_start,
-                                const uint8_t *pentries_end,
-                                uint32_t pentry_size)
+static struct gpt_name_index *gpt_index_pentries(const uint8_t *pentries_start,
+                                                 const uint8_t *pentries_end,
+                                                 uint32_t pentry_size)
 {
-    char     *pentry_name;
-    unsigned  len = strlen(ptn_name);
+    struct gpt_name_index *index = new gpt_name_index;
+    const char *pentry_name;
+    uint32_t  pos = 0;
     unsigned  i;
     char      name8[MAX_GPT_NAME_SIZE] = {0}; // initialize with null
 
-    for (pentry_name = (char *) (pentries_start + PARTITION_NAME_OFFSET);
-         pentry_name < (char *) pentries_end;
-         pentry_name += pentry_size) {
+    for (pentry_name = (const char *) (pentries_start + PARTITION_NAME_OFFSET);
+         pentry_name < (const char *) pentries_end;
+         pentry_name += pentry_size, pos++) {
 
         /* Partition names in GPT are UTF-16 - ignoring UTF-16 2nd byte */
         for (i = 0; i < sizeof(name8) / 2; i++)
             name8[i] = pentry_name[i * 2];
         name8[i] = '\0';
 
-        if (!strncmp(ptn_name, name8, len)) {
-            if (name8[len] == 0 || !strcmp(&name8[len], BAK_PTN_NAME_EXT))
-                return (uint8_t *) (pentry_name - PARTITION_NAME_OFFSET);
+        if (name8[0] != '\0')
+            index->entries[name8].push_back(pos);
+    }
+
+    return index;
+}
+
+/**
+ *  ==========================================================================
+ *
+ *  \brief  Search within GPT for partition entry with the given name
+ *  or it's backup twin (name-bak).
+ *
+ *  \param [in] index           Index of the partition entries array
+ *  \param [in] ptn_name        Partition name to seek
+ *  \param [in] pentries_start  Partition entries array start pointer
+ *  \param [in] pentry_size     Single partition entry size [bytes]
+ *  \param [in] first           Position of the first entry to consider
+ *
+ *  \return  First partition entry pointer that matches the name or NULL
+ *
+ *  ==========================================================================
+ */
+static uint8_t *gpt_pentry_seek(const struct gpt_name_index *index,
+                                const char *ptn_name,
+                                const uint8_t *pentries_start,
+                                uint32_t pentry_size,
+                                uint32_t first)
+{
+    string    names[] = { ptn_name, string(ptn_name) + BAK_PTN_NAME_EXT };
+    uint32_t  found = UINT32_MAX;
+
+    for (const string& name : names) {
+        auto it = index->entries.find(name);
+        if (it == index->entries.end())
+            continue;
+        for (uint32_t pos : it->second) {
+            if (pos >= first) {
+                found = min(found, pos);
+                break;
+            }
         }
     }
 
-    return NULL;
+    if (found == UINT32_MAX)
+        return NULL;
+    return (uint8_t *) (pentries_start + (uint64_t) found * pentry_size);
 }
 
 
@@ -238,6 +365,11 @@ static int gpt_boot_chain_swap(const uint8_t *pentries_start,
                                 uint32_t pentry_size)
 {
     const char ptn_swap_list[][MAX_GPT_NAME_SIZE] = { PTN_SWAP_LIST };
+    //Swapping a pair only moves the entries of that one name, so the index
+    //stays valid for the names that come after it
+    struct gpt_name_index *index = gpt_index_pentries(pentries_start,
+                                                      pentries_end,
+                                                      pentry_size);
 
     int backup_not_found = 1;
     unsigned i;
@@ -253,13 +385,14 @@ static int gpt_boot_chain_swap(const uint8_t *pentries_start,
             || !strncmp(ptn_swap_list[i],PTN_MULTIIMGQTI,strlen(PTN_MULTIIMGQTI)))
             continue;
 
-        ptn_entry = gpt_pentry_seek(ptn_swap_list[i], pentries_start,
-                        pentries_end, pentry_size);
+        ptn_entry = gpt_pentry_seek(index, ptn_swap_list[i], pentries_start,
+                        pentry_size, 0);
         if (ptn_entry == NULL)
             continue;
 
-        ptn_bak_entry = gpt_pentry_seek(ptn_swap_list[i],
-                        ptn_entry + pentry_size, pentries_end, pentry_size);
+        ptn_bak_entry = gpt_pentry_seek(index, ptn_swap_list[i],
+                        pentries_start, pentry_size,
+                        (ptn_entry - pentries_start) / pentry_size + 1);
         if (ptn_bak_entry == NULL) {
             fprintf(stderr, "'%s' partition not backup - skip safe update\n",
                     ptn_swap_list[i]);
@@ -273,6 +406,7 @@ static int gpt_boot_chain_swap(const uint8_t *pentries_start,
         backup_not_found = 0;
     }
 
+    delete index;
     return backup_not_found;
 }
 
@@ -373,9 +507,10 @@ static int gpt2_set_boot_chain(int fd, enum boot_chain boot)
                                 pentry_size);
         if (r)
             goto EXIT;
+        crc = crc32(crc_zero, pentries, pentries_array_size);
     }
 
-    crc = crc32(crc_zero, pentries, pentries_array_size);
+    /* crc still holds the verified CRC when the entries were not swapped */
     PUT_4_BYTES(gpt_header + PARTITION_CRC_OFFSET, crc);
 
     /* header CRC is calculated with this field cleared */
@@ -383,12 +518,9 @@ static int gpt2_set_boot_chain(int fd, enum boot_chain boot)
     crc = crc32(crc_zero, gpt_header, gpt_header_size);
     PUT_4_BYTES(gpt_header + HEADER_CRC_OFFSET, crc);
 
-    /* Write the modified GPT header back to block dev */
-    r = blk_rw(fd, 1, gpt2_header_offset, gpt_header, blk_size);
-    if (!r)
-        /* Write the modified GPT partititon entries array back to block dev */
-        r = blk_rw(fd, 1, pentries_start_offset, pentries,
-                    pentries_array_size);
+    /* Write the modified GPT header and partition entries array back */
+    r = gpt_write_copy(fd, gpt_header, gpt2_header_offset, blk_size,
+                       pentries, pentries_start_offset, pentries_array_size);
 
 EXIT:
     if(gpt_header)
@@ -1121,40 +1253,6 @@ error:
         return 0;
 }
 
-//Write the GPT header present in the passed in buffer back to the
-//disk represented by fd
-static int gpt_set_header(uint8_t *gpt_header, int fd,
-                enum gpt_instance instance)
-{
-        uint32_t block_size = 0;
-        off64_t gpt_header_offset = 0;
-        if (!gpt_header || fd < 0) {
-                ALOGE("%s: Invalid arguments",
-                                __func__);
-                goto error;
-        }
-        block_size = gpt_get_block_size(fd);
-        if (block_size == 0) {
-                ALOGE("%s: Failed to get block size", __func__);
-                goto error;
-        }
-        if (instance == PRIMARY_GPT)
-                gpt_header_offset = block_size;
-        else
-                gpt_header_offset = lseek64(fd, 0, SEEK_END) - block_size;
-        if (gpt_header_offset <= 0) {
-                ALOGE("%s: Failed to get gpt header offset",__func__);
-                goto error;
-        }
-        if (blk_rw(fd, 1, gpt_header_offset, gpt_header, block_size)) {
-                ALOGE("%s: Failed to write back GPT header", __func__);
-                goto error;
-        }
-        return 0;
-error:
-        return -1;
-}
-
 //Read out the GPT header for the disk that contains the partition partname
 static uint8_t* gpt_get_header(const char *partname, enum gpt_instance instance)
 {
@@ -1273,43 +1371,6 @@ error:
         return NULL;
 }
 
-static int gpt_set_pentry_arr(uint8_t *hdr, int fd, uint8_t* arr)
-{
-        uint32_t block_size = 0;
-        uint64_t pentries_start = 0;
-        uint32_t pentry_size = 0;
-        uint32_t pentries_arr_size = 0;
-        int rc = 0;
-        if (!hdr || fd < 0 || !arr) {
-                ALOGE("%s: Invalid argument", __func__);
-                goto error;
-        }
-        block_size = gpt_get_block_size(fd);
-        if (!block_size) {
-                ALOGE("%s: Failed to get gpt block size for",
-                                __func__);
-                goto error;
-        }
-        pentries_start = GET_8_BYTES(hdr + PENTRIES_OFFSET) * block_size;
-        pentry_size = GET_4_BYTES(hdr + PENTRY_SIZE_OFFSET);
-        pentries_arr_size =
-                GET_4_BYTES(hdr + PARTITION_COUNT_OFFSET) * pentry_size;
-        rc = blk_rw(fd, 1,
-                        pentries_start,
-                        arr,
-                        pentries_arr_size);
-        if (rc) {
-                ALOGE("%s: Failed to read partition entry array",
-                                __func__);
-                goto error;
-        }
-        return 0;
-error:
-        return -1;
-}
-
-
-
 //Allocate a handle used by calls to the "gpt_disk" api's
 struct gpt_disk * gpt_disk_alloc()
 {
@@ -1337,6 +1398,8 @@ void gpt_disk_free(struct gpt_disk *disk)
                 free(disk->pentry_arr);
         if (disk->pentry_arr_bak)
                 free(disk->pentry_arr_bak);
+        delete disk->pentry_index;
+        delete disk->pentry_index_bak;
         free(disk);
         return;
 }
@@ -1410,6 +1473,15 @@ int gpt_disk_get_disk_info(const char *dev, struct gpt_disk *dsk)
                         PARTITION_CRC_OFFSET);
         disk->block_size = gpt_get_block_size(fd);
         close(fd);
+        //Lookups by name go through these instead of scanning the arrays
+        delete disk->pentry_index;
+        delete disk->pentry_index_bak;
+        disk->pentry_index = gpt_index_pentries(disk->pentry_arr,
+                        disk->pentry_arr + disk->pentry_arr_size,
+                        disk->pentry_size);
+        disk->pentry_index_bak = gpt_index_pentries(disk->pentry_arr_bak,
+                        disk->pentry_arr_bak + disk->pentry_arr_size,
+                        disk->pentry_size);
         disk->is_initialized = GPT_DISK_INIT_MAGIC;
         return 0;
 error:
@@ -1424,15 +1496,17 @@ uint8_t* gpt_disk_get_pentry(struct gpt_disk *disk,
                 enum gpt_instance instance)
 {
         uint8_t *ptn_arr = NULL;
+        struct gpt_name_index *index = NULL;
         if (!disk || !partname || disk->is_initialized != GPT_DISK_INIT_MAGIC) {
                 ALOGE("%s: Invalid argument",__func__);
                 goto error;
         }
         ptn_arr = (instance == PRIMARY_GPT) ?
                 disk->pentry_arr : disk->pentry_arr_bak;
-        return (gpt_pentry_seek(partname, ptn_arr,
-                        ptn_arr + disk->pentry_arr_size ,
-                        disk->pentry_size));
+        index = (instance == PRIMARY_GPT) ?
+                disk->pentry_index : disk->pentry_index_bak;
+        return (gpt_pentry_seek(index, partname, ptn_arr,
+                        disk->pentry_size, 0));
 error:
         return NULL;
 }
@@ -1481,11 +1555,12 @@ error:
 int gpt_disk_commit(struct gpt_disk *disk)
 {
         int fd = -1;
+        int64_t hdr_bak_offset = 0;
         if (!disk || (disk->is_initialized != GPT_DISK_INIT_MAGIC)){
                 ALOGE("%s: Invalid args", __func__);
                 goto error;
         }
-        fd = open(disk->devpath, O_RDWR | O_DSYNC);
+        fd = open(disk->devpath, O_RDWR);
         if (fd < 0) {
                 ALOGE("%s: Failed to open %s: %s",
                                 __func__,
@@ -1493,31 +1568,29 @@ int gpt_disk_commit(struct gpt_disk *disk)
                                 strerror(errno));
                 goto error;
         }
-        //Write the primary header
-        if(gpt_set_header(disk->hdr, fd, PRIMARY_GPT) != 0) {
-                ALOGE("%s: Failed to update primary GPT header",
-                                __func__);
+        hdr_bak_offset = lseek64(fd, 0, SEEK_END) - disk->block_size;
+        if (disk->block_size == 0 || hdr_bak_offset <= 0) {
+                ALOGE("%s: Failed to get gpt header offset", __func__);
                 goto error;
         }
-        //Write back the primary partition array
-        if (gpt_set_pentry_arr(disk->hdr, fd, disk->pentry_arr)) {
-                ALOGE("%s: Failed to write primary GPT partition arr",
-                                __func__);
+        //Each copy reaches the disk before the other one is touched, so
+        //a crash leaves at least one of them whole
+        if (gpt_write_copy(fd, disk->hdr, disk->block_size,
+                                disk->block_size, disk->pentry_arr,
+                                GET_8_BYTES(disk->hdr + PENTRIES_OFFSET) *
+                                disk->block_size,
+                                disk->pentry_arr_size)) {
+                ALOGE("%s: Failed to write primary GPT", __func__);
                 goto error;
         }
-        //Write back the secondary header
-        if(gpt_set_header(disk->hdr_bak, fd, SECONDARY_GPT) != 0) {
-                ALOGE("%s: Failed to update secondary GPT header",
-                                __func__);
-                goto error;
-        }
-        //Write back the secondary partition array
-        if (gpt_set_pentry_arr(disk->hdr_bak, fd, disk->pentry_arr_bak)) {
-                ALOGE("%s: Failed to write secondary GPT partition arr",
-                                __func__);
+        if (gpt_write_copy(fd, disk->hdr_bak, hdr_bak_offset,
+                                disk->block_size, disk->pentry_arr_bak,
+                                GET_8_BYTES(disk->hdr_bak + PENTRIES_OFFSET) *
+                                disk->block_size,
+                                disk->pentry_arr_size)) {
+                ALOGE("%s: Failed to write secondary GPT", __func__);
                 goto error;
         }
-        fsync(fd);
         close(fd);
         return 0;
 error:
@@ -109,6 +109,8 @@ enum boot_chain {
 	BACKUP_BOOT
 };
 
+struct gpt_name_index;
+
 struct gpt_disk {
 	//GPT primary header
 	uint8_t *hdr;
@@ -135,6 +137,9 @@ struct gpt_disk {
 	//Block size of disk
 	uint32_t block_size;
 	uint32_t is_initialized;
+	//Partition entries by name, for the primary and backup arrays
+	struct gpt_name_index *pentry_index;
+	struct gpt_name_index *pentry_index_bak;
 };
 
 /******************************************************************************
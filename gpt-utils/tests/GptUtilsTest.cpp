@@ -0,0 +1,590 @@
+/*
+ * Copyright (C) 2022 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * The helpers under test are static, so build them into this test. This
+ * comes first, as the file sets feature macros for the system headers.
+ */
+#include "../gpt-utils.cpp"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * The GPT images are plain files, so BLKSSZGET on them is answered here.
+ * The writes and syncs the code under test issues are logged, and writes
+ * can be cut short, with the test linked with -Wl,--wrap for each call.
+ */
+#ifdef __BIONIC__
+using IoctlRequest = int;
+#else
+using IoctlRequest = unsigned long;
+#endif
+
+namespace {
+
+constexpr uint32_t kBlockSize = 512;
+
+std::vector<std::string> gOps;
+/* Bytes one pwritev64() call writes at most */
+size_t gMaxWrite = SIZE_MAX;
+
+}  // namespace
+
+extern "C" int __real_ioctl(int fd, IoctlRequest request, ...);
+extern "C" ssize_t __real_pwritev64(int fd, const struct iovec *iov, int count, off64_t offset);
+extern "C" int __real_fdatasync(int fd);
+
+extern "C" int __wrap_ioctl(int fd, IoctlRequest request, ...) {
+    struct stat st;
+    uintptr_t arg;
+    va_list ap;
+
+    va_start(ap, request);
+    arg = va_arg(ap, uintptr_t);
+    va_end(ap);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || request != BLKSSZGET)
+        return __real_ioctl(fd, request, arg);
+    *reinterpret_cast<int *>(arg) = kBlockSize;
+    return 0;
+}
+
+extern "C" ssize_t __wrap_pwritev64(int fd, const struct iovec *iov, int count, off64_t offset) {
+    std::vector<struct iovec> vec(iov, iov + count);
+    size_t len = 0;
+
+    for (struct iovec &v : vec) {
+        v.iov_len = std::min(v.iov_len, gMaxWrite - len);
+        len += v.iov_len;
+    }
+    gOps.push_back("pwritev " + std::to_string(offset) + " " + std::to_string(len));
+    return __real_pwritev64(fd, vec.data(), count, offset);
+}
+
+extern "C" int __wrap_fdatasync(int fd) {
+    gOps.push_back("fdatasync");
+    return __real_fdatasync(fd);
+}
+
+namespace {
+
+const char *const kSwapNames[] = {PTN_SWAP_LIST};
+
+/* The linear scan the name index replaced, kept as the reference */
+uint8_t *ReferenceSeek(const char *ptn_name, const uint8_t *pentries_start,
+                       const uint8_t *pentries_end, uint32_t pentry_size) {
+    const char *pentry_name;
+    unsigned len = strlen(ptn_name);
+    unsigned i;
+    char name8[MAX_GPT_NAME_SIZE] = {0};
+
+    for (pentry_name = (const char *)(pentries_start + PARTITION_NAME_OFFSET);
+         pentry_name < (const char *)pentries_end; pentry_name += pentry_size) {
+        for (i = 0; i < sizeof(name8) / 2; i++) name8[i] = pentry_name[i * 2];
+        name8[i] = '\0';
+
+        if (!strncmp(ptn_name, name8, len)) {
+            if (name8[len] == 0 || !strcmp(&name8[len], BAK_PTN_NAME_EXT))
+                return (uint8_t *)(pentry_name - PARTITION_NAME_OFFSET);
+        }
+    }
+
+    return NULL;
+}
+
+/* gpt_boot_chain_swap() as it was before the index, on top of ReferenceSeek() */
+int ReferenceSwap(uint8_t *pentries_start, uint8_t *pentries_end, uint32_t pentry_size) {
+    int backup_not_found = 1;
+
+    for (const char *name : kSwapNames) {
+        uint8_t *ptn_entry;
+        uint8_t *ptn_bak_entry;
+        uint8_t ptn_swap[PTN_ENTRY_SIZE];
+
+        if ((gpt_utils_is_ufs_device() && !strncmp(name, PTN_XBL, strlen(PTN_XBL))) ||
+            !strncmp(name, PTN_MULTIIMGOEM, strlen(PTN_MULTIIMGOEM)) ||
+            !strncmp(name, PTN_MULTIIMGQTI, strlen(PTN_MULTIIMGQTI)))
+            continue;
+
+        ptn_entry = ReferenceSeek(name, pentries_start, pentries_end, pentry_size);
+        if (ptn_entry == NULL) continue;
+        ptn_bak_entry = ReferenceSeek(name, ptn_entry + pentry_size, pentries_end, pentry_size);
+        if (ptn_bak_entry == NULL) continue;
+
+        memcpy(ptn_swap, ptn_entry, PTN_ENTRY_SIZE);
+        memcpy(ptn_entry, ptn_bak_entry, PTN_ENTRY_SIZE);
+        memcpy(ptn_bak_entry, ptn_swap, PTN_ENTRY_SIZE);
+        backup_not_found = 0;
+    }
+
+    return backup_not_found;
+}
+
+/* A partition entries array with PTN_ENTRY_SIZE entries, named as given */
+class EntryTable {
+public:
+    explicit EntryTable(size_t count) : mData(count * PTN_ENTRY_SIZE) {}
+
+    void name(size_t pos, const std::string &name) {
+        uint8_t *entry = at(pos);
+
+        memset(entry + PARTITION_NAME_OFFSET, 0, MAX_GPT_NAME_SIZE);
+        for (size_t i = 0; i < name.size(); i++) entry[PARTITION_NAME_OFFSET + i * 2] = name[i];
+        /* Tags the entry, so a swap shows up in the bytes */
+        entry[TYPE_GUID_OFFSET] = pos;
+        entry[TYPE_GUID_OFFSET + 1] = pos >> 8;
+    }
+
+    uint8_t *at(size_t pos) { return begin() + pos * PTN_ENTRY_SIZE; }
+    uint8_t *begin() { return mData.data(); }
+    uint8_t *end() { return mData.data() + mData.size(); }
+    size_t count() const { return mData.size() / PTN_ENTRY_SIZE; }
+    const std::vector<uint8_t> &bytes() const { return mData; }
+
+private:
+    std::vector<uint8_t> mData;
+};
+
+/*
+ * Fills the table with the swap list and some A/B names. A name may show
+ * up with or without its "bak" twin, twice, or not at all, in any order,
+ * and there are names that only share a prefix with a listed one.
+ */
+EntryTable RandomTable(size_t count, uint32_t seed) {
+    const char *const kOtherNames[] = {"boot_a", "boot_b", "system", "vendor", "xblbak2",
+                                       "tzz", "abl_a", "dsp_b", "devcfgbakbak", "ta"};
+    std::mt19937 rng(seed);
+    std::vector<std::string> names;
+    EntryTable table(count);
+
+    for (const char *name : kSwapNames) {
+        switch (rng() % 6) {
+            case 0:
+                break;
+            case 1:
+                names.push_back(name);
+                break;
+            case 2:
+                names.push_back(std::string(name) + BAK_PTN_NAME_EXT);
+                break;
+            case 3:
+                names.push_back(name);
+                names.push_back(name);
+                names.push_back(std::string(name) + BAK_PTN_NAME_EXT);
+                break;
+            default:
+                names.push_back(name);
+                names.push_back(std::string(name) + BAK_PTN_NAME_EXT);
+                break;
+        }
+    }
+    for (const char *name : kOtherNames) names.push_back(name);
+    while (names.size() < count / 2) names.push_back("misc" + std::to_string(names.size()));
+
+    /* Scatter them over the table, leaving the other slots unnamed */
+    std::vector<size_t> slots(count);
+    for (size_t i = 0; i < count; i++) slots[i] = i;
+    std::shuffle(slots.begin(), slots.end(), rng);
+    for (size_t i = 0; i < names.size() && i < count; i++) table.name(slots[i], names[i]);
+
+    return table;
+}
+
+}  // namespace
+
+class GptLookupTest : public ::testing::TestWithParam<size_t> {};
+
+TEST_P(GptLookupTest, seekMatchesLinearScan) {
+    for (uint32_t seed = 1; seed <= 20; seed++) {
+        EntryTable table = RandomTable(GetParam(), seed);
+        struct gpt_name_index *index =
+                gpt_index_pentries(table.begin(), table.end(), PTN_ENTRY_SIZE);
+        std::vector<std::string> names(std::begin(kSwapNames), std::end(kSwapNames));
+
+        names.insert(names.end(), {"boot_a", "xblbak", "nosuch", "misc"});
+        for (const std::string &name : names) {
+            /*
+             * Walk the matches the way the backup twin is looked up, one
+             * past the previous match, and also try the cutoffs right on
+             * and right before each match
+             */
+            uint32_t first = 0;
+
+            while (true) {
+                uint8_t *expected = ReferenceSeek(name.c_str(), table.at(first), table.end(),
+                                                  PTN_ENTRY_SIZE);
+
+                SCOPED_TRACE(name + " seed " + std::to_string(seed) + " from " +
+                             std::to_string(first));
+                EXPECT_EQ(expected, gpt_pentry_seek(index, name.c_str(), table.begin(),
+                                                    PTN_ENTRY_SIZE, first));
+                if (expected == NULL) break;
+
+                uint32_t pos = (expected - table.begin()) / PTN_ENTRY_SIZE;
+                EXPECT_EQ(expected, gpt_pentry_seek(index, name.c_str(), table.begin(),
+                                                    PTN_ENTRY_SIZE, pos));
+                if (pos > first) {
+                    EXPECT_EQ(expected, gpt_pentry_seek(index, name.c_str(), table.begin(),
+                                                        PTN_ENTRY_SIZE, pos - 1));
+                }
+                first = pos + 1;
+            }
+        }
+        delete index;
+    }
+}
+
+TEST_P(GptLookupTest, bootChainSwapMatchesLinearScan) {
+    for (uint32_t seed = 1; seed <= 20; seed++) {
+        EntryTable table = RandomTable(GetParam(), seed);
+        EntryTable expected = table;
+
+        SCOPED_TRACE("seed " + std::to_string(seed));
+        EXPECT_EQ(ReferenceSwap(expected.begin(), expected.end(), PTN_ENTRY_SIZE),
+                  gpt_boot_chain_swap(table.begin(), table.end(), PTN_ENTRY_SIZE));
+        EXPECT_EQ(expected.bytes(), table.bytes());
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Tables, GptLookupTest, ::testing::Values(128, 256, 1024));
+
+TEST(GptLookupTest, firstMatchWinsOverBackupTwin) {
+    EntryTable table(128);
+    table.name(3, "tzbak");
+    table.name(7, "tz");
+    table.name(9, "tzbak");
+    struct gpt_name_index *index = gpt_index_pentries(table.begin(), table.end(), PTN_ENTRY_SIZE);
+
+    /* Either name counts, whichever comes first */
+    EXPECT_EQ(table.at(3), gpt_pentry_seek(index, "tz", table.begin(), PTN_ENTRY_SIZE, 0));
+    EXPECT_EQ(table.at(7), gpt_pentry_seek(index, "tz", table.begin(), PTN_ENTRY_SIZE, 4));
+    EXPECT_EQ(table.at(9), gpt_pentry_seek(index, "tz", table.begin(), PTN_ENTRY_SIZE, 8));
+    EXPECT_EQ(nullptr, gpt_pentry_seek(index, "tz", table.begin(), PTN_ENTRY_SIZE, 10));
+    /* Only an exact name or name-bak matches */
+    EXPECT_EQ(nullptr, gpt_pentry_seek(index, "t", table.begin(), PTN_ENTRY_SIZE, 0));
+    delete index;
+}
+
+namespace {
+
+std::string Write(uint64_t offset, size_t len) {
+    return "pwritev " + std::to_string(offset) + " " + std::to_string(len);
+}
+
+void Put8(uint8_t *ptr, uint64_t value) {
+    for (int i = 0; i < 8; i++) ptr[i] = value >> (i * 8);
+}
+
+/*
+ * A disk image holding both GPT copies. The blocks outside of them are
+ * filled with a pattern, so a stray write shows up in the bytes.
+ */
+class GptImage {
+public:
+    static constexpr uint32_t kEntries = 128;
+    static constexpr uint32_t kArraySize = kEntries * PTN_ENTRY_SIZE;
+    static constexpr uint64_t kLastLba = 127;
+
+    GptImage(uint64_t primaryArrayLba, uint64_t backupArrayLba)
+        : mData((kLastLba + 1) * kBlockSize) {
+        EntryTable table(kEntries);
+        size_t pos = 0;
+
+        for (size_t i = 0; i < mData.size(); i++) mData[i] = i * 7 + 1;
+        /* Each listed name, then the backup twins in the same order */
+        for (const char *name : kSwapNames) table.name(pos++, name);
+        for (const char *name : kSwapNames) table.name(pos++, std::string(name) + BAK_PTN_NAME_EXT);
+        table.name(pos++, "boot_a");
+        table.name(pos++, "boot_b");
+
+        setupCopy(1, kLastLba, primaryArrayLba, table);
+        setupCopy(kLastLba, 1, backupArrayLba, table);
+        seal();
+    }
+
+    uint8_t *header(enum gpt_instance gpt) {
+        return block(gpt == PRIMARY_GPT ? 1 : kLastLba);
+    }
+
+    uint8_t *entries(enum gpt_instance gpt) {
+        return block(GET_8_BYTES(header(gpt) + PENTRIES_OFFSET));
+    }
+
+    uint8_t *entry(enum gpt_instance gpt, const char *name) {
+        return ReferenceSeek(name, entries(gpt), entries(gpt) + kArraySize, PTN_ENTRY_SIZE);
+    }
+
+    uint64_t offset(const uint8_t *ptr) const { return ptr - mData.data(); }
+
+    /* Recomputes the CRCs of both copies, the way the headers expect them */
+    void seal() {
+        for (enum gpt_instance gpt : {PRIMARY_GPT, SECONDARY_GPT}) {
+            uint8_t *hdr = header(gpt);
+            uint32_t crc = crc32(0L, entries(gpt), kArraySize);
+
+            PUT_4_BYTES(hdr + PARTITION_CRC_OFFSET, crc);
+            PUT_4_BYTES(hdr + HEADER_CRC_OFFSET, 0);
+            crc = crc32(0L, hdr, GET_4_BYTES(hdr + HEADER_SIZE_OFFSET));
+            PUT_4_BYTES(hdr + HEADER_CRC_OFFSET, crc);
+        }
+    }
+
+    void writeTo(int fd) const {
+        ASSERT_EQ(0, ftruncate(fd, 0));
+        ASSERT_EQ((ssize_t)mData.size(), pwrite(fd, mData.data(), mData.size(), 0));
+    }
+
+    const std::vector<uint8_t> &bytes() const { return mData; }
+
+private:
+    uint8_t *block(uint64_t lba) { return mData.data() + lba * kBlockSize; }
+
+    void setupCopy(uint64_t lba, uint64_t otherLba, uint64_t arrayLba, EntryTable &table) {
+        uint8_t *hdr = block(lba);
+
+        memset(hdr, 0, kBlockSize);
+        memcpy(hdr, GPT_SIGNATURE, strlen(GPT_SIGNATURE));
+        PUT_4_BYTES(hdr + HEADER_SIZE_OFFSET, 92);
+        Put8(hdr + PRIMARY_HEADER_OFFSET, lba);
+        Put8(hdr + BACKUP_HEADER_OFFSET, otherLba);
+        Put8(hdr + PENTRIES_OFFSET, arrayLba);
+        PUT_4_BYTES(hdr + PARTITION_COUNT_OFFSET, kEntries);
+        PUT_4_BYTES(hdr + PENTRY_SIZE_OFFSET, PTN_ENTRY_SIZE);
+        memcpy(block(arrayLba), table.begin(), kArraySize);
+    }
+
+    std::vector<uint8_t> mData;
+};
+
+}  // namespace
+
+class GptImageTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        gOps.clear();
+        gMaxWrite = SIZE_MAX;
+    }
+
+    void TearDown() override { gMaxWrite = SIZE_MAX; }
+
+    std::vector<uint8_t> contents() {
+        std::vector<uint8_t> data(lseek64(mFile.fd, 0, SEEK_END));
+
+        EXPECT_EQ((ssize_t)data.size(), pread(mFile.fd, data.data(), data.size(), 0));
+        return data;
+    }
+
+    /* What gpt_disk_get_disk_info() reads, but from the image file */
+    struct gpt_disk *loadDisk() {
+        struct gpt_disk *disk = gpt_disk_alloc();
+
+        disk->hdr = (uint8_t *)malloc(kBlockSize);
+        disk->hdr_bak = (uint8_t *)malloc(kBlockSize);
+        EXPECT_EQ(0, blk_rw(mFile.fd, 0, kBlockSize, disk->hdr, kBlockSize));
+        EXPECT_EQ(0, blk_rw(mFile.fd, 0, GptImage::kLastLba * kBlockSize, disk->hdr_bak,
+                            kBlockSize));
+        disk->pentry_arr = gpt_get_pentry_arr(disk->hdr, mFile.fd);
+        disk->pentry_arr_bak = gpt_get_pentry_arr(disk->hdr_bak, mFile.fd);
+        disk->pentry_size = PTN_ENTRY_SIZE;
+        disk->pentry_arr_size = GptImage::kArraySize;
+        disk->block_size = gpt_get_block_size(mFile.fd);
+        disk->pentry_index = gpt_index_pentries(disk->pentry_arr,
+                                                disk->pentry_arr + disk->pentry_arr_size,
+                                                disk->pentry_size);
+        disk->pentry_index_bak = gpt_index_pentries(disk->pentry_arr_bak,
+                                                    disk->pentry_arr_bak + disk->pentry_arr_size,
+                                                    disk->pentry_size);
+        strlcpy(disk->devpath, mFile.path, sizeof(disk->devpath));
+        disk->is_initialized = GPT_DISK_INIT_MAGIC;
+        return disk;
+    }
+
+    /* Marks boot_b active in both copies, then commits them with gpt_disk_commit() */
+    void commitActiveSlot(GptImage &image) {
+        image.writeTo(mFile.fd);
+        struct gpt_disk *disk = loadDisk();
+
+        for (enum gpt_instance gpt : {PRIMARY_GPT, SECONDARY_GPT}) {
+            uint8_t *entry = gpt_disk_get_pentry(disk, "boot_b", gpt);
+
+            ASSERT_NE(nullptr, entry);
+            entry[AB_FLAG_OFFSET] = AB_SLOT_ACTIVE_VAL;
+            image.entry(gpt, "boot_b")[AB_FLAG_OFFSET] = AB_SLOT_ACTIVE_VAL;
+        }
+        image.seal();
+        ASSERT_EQ(0, gpt_disk_update_crc(disk));
+        ASSERT_EQ(0, gpt_disk_commit(disk));
+        gpt_disk_free(disk);
+    }
+
+    TemporaryFile mFile;
+};
+
+TEST_F(GptImageTest, writeCopyPrimaryIsOneWrite) {
+    GptImage image(2, GptImage::kLastLba - 32);
+    GptImage update = image;
+
+    update.entry(PRIMARY_GPT, "tz")[AB_FLAG_OFFSET] = AB_SLOT_ACTIVE_VAL;
+    update.seal();
+    image.writeTo(mFile.fd);
+    ASSERT_EQ(0, gpt_write_copy(mFile.fd, update.header(PRIMARY_GPT), kBlockSize, kBlockSize,
+                                update.entries(PRIMARY_GPT), 2 * kBlockSize,
+                                GptImage::kArraySize));
+
+    /* Only the primary copy changed, in one call */
+    std::vector<uint8_t> expected = image.bytes();
+    memcpy(&expected[kBlockSize], update.header(PRIMARY_GPT), kBlockSize);
+    memcpy(&expected[2 * kBlockSize], update.entries(PRIMARY_GPT), GptImage::kArraySize);
+    EXPECT_EQ(expected, contents());
+    EXPECT_EQ(std::vector<std::string>({Write(kBlockSize, kBlockSize + GptImage::kArraySize),
+                                        "fdatasync"}),
+              gOps);
+}
+
+TEST_F(GptImageTest, writeCopyBackupIsOneWrite) {
+    GptImage image(2, GptImage::kLastLba - 32);
+    GptImage update = image;
+    const uint64_t arrayOffset = (GptImage::kLastLba - 32) * kBlockSize;
+
+    update.entry(SECONDARY_GPT, "tz")[AB_FLAG_OFFSET] = AB_SLOT_ACTIVE_VAL;
+    update.seal();
+    image.writeTo(mFile.fd);
+    ASSERT_EQ(0, gpt_write_copy(mFile.fd, update.header(SECONDARY_GPT),
+                                GptImage::kLastLba * kBlockSize, kBlockSize,
+                                update.entries(SECONDARY_GPT), arrayOffset,
+                                GptImage::kArraySize));
+
+    /* The array goes first, as it sits before the header */
+    std::vector<uint8_t> expected = image.bytes();
+    memcpy(&expected[GptImage::kLastLba * kBlockSize], update.header(SECONDARY_GPT), kBlockSize);
+    memcpy(&expected[arrayOffset], update.entries(SECONDARY_GPT), GptImage::kArraySize);
+    EXPECT_EQ(expected, contents());
+    EXPECT_EQ(std::vector<std::string>({Write(arrayOffset, GptImage::kArraySize + kBlockSize),
+                                        "fdatasync"}),
+              gOps);
+}
+
+TEST_F(GptImageTest, writeCopyNotAdjacentIsTwoWrites) {
+    /* Arrays a few blocks away from their headers, with filler in between */
+    GptImage image(5, GptImage::kLastLba - 40);
+    GptImage update = image;
+
+    update.entry(PRIMARY_GPT, "tz")[AB_FLAG_OFFSET] = AB_SLOT_ACTIVE_VAL;
+    update.seal();
+    image.writeTo(mFile.fd);
+    ASSERT_EQ(0, gpt_write_copy(mFile.fd, update.header(PRIMARY_GPT), kBlockSize, kBlockSize,
+                                update.entries(PRIMARY_GPT), 5 * kBlockSize,
+                                GptImage::kArraySize));
+
+    std::vector<uint8_t> expected = image.bytes();
+    memcpy(&expected[kBlockSize], update.header(PRIMARY_GPT), kBlockSize);
+    memcpy(&expected[5 * kBlockSize], update.entries(PRIMARY_GPT), GptImage::kArraySize);
+    EXPECT_EQ(expected, contents());
+    EXPECT_EQ(std::vector<std::string>({Write(kBlockSize, kBlockSize),
+                                        Write(5 * kBlockSize, GptImage::kArraySize),
+                                        "fdatasync"}),
+              gOps);
+}
+
+TEST_F(GptImageTest, writeCopyFinishesShortWrites) {
+    for (uint64_t arrayLba : {2, 5}) {
+        GptImage image(arrayLba, GptImage::kLastLba - 32);
+        GptImage update = image;
+
+        SCOPED_TRACE("array at LBA " + std::to_string(arrayLba));
+        update.entry(PRIMARY_GPT, "tz")[AB_FLAG_OFFSET] = AB_SLOT_ACTIVE_VAL;
+        update.seal();
+        image.writeTo(mFile.fd);
+        gOps.clear();
+        /* Not a divisor of the block size, so writes end mid iovec */
+        gMaxWrite = 300;
+        ASSERT_EQ(0, gpt_write_copy(mFile.fd, update.header(PRIMARY_GPT), kBlockSize, kBlockSize,
+                                    update.entries(PRIMARY_GPT), arrayLba * kBlockSize,
+                                    GptImage::kArraySize));
+        gMaxWrite = SIZE_MAX;
+
+        EXPECT_EQ(update.bytes(), contents());
+        /* Each call picks up where the last one stopped */
+        std::vector<std::pair<uint64_t, size_t>> regions = {
+                {kBlockSize, kBlockSize + GptImage::kArraySize}};
+        if (arrayLba != 2)
+            regions = {{kBlockSize, kBlockSize}, {arrayLba * kBlockSize, GptImage::kArraySize}};
+        std::vector<std::string> expected;
+        for (auto [offset, len] : regions) {
+            for (size_t done = 0; done < len; done += 300)
+                expected.push_back(Write(offset + done, std::min<size_t>(300, len - done)));
+        }
+        expected.push_back("fdatasync");
+        EXPECT_EQ(expected, gOps);
+    }
+}
+
+TEST_F(GptImageTest, commitWritesPrimaryThenBackup) {
+    GptImage image(2, GptImage::kLastLba - 32);
+
+    commitActiveSlot(image);
+    EXPECT_EQ(image.bytes(), contents());
+    EXPECT_EQ(std::vector<std::string>(
+                      {Write(kBlockSize, kBlockSize + GptImage::kArraySize), "fdatasync",
+                       Write((GptImage::kLastLba - 32) * kBlockSize,
+                             GptImage::kArraySize + kBlockSize),
+                       "fdatasync"}),
+              gOps);
+}
+
+TEST_F(GptImageTest, commitNotAdjacentWritesPrimaryThenBackup) {
+    GptImage image(5, GptImage::kLastLba - 40);
+
+    commitActiveSlot(image);
+    EXPECT_EQ(image.bytes(), contents());
+    EXPECT_EQ(std::vector<std::string>(
+                      {Write(kBlockSize, kBlockSize), Write(5 * kBlockSize, GptImage::kArraySize),
+                       "fdatasync", Write(GptImage::kLastLba * kBlockSize, kBlockSize),
+                       Write((GptImage::kLastLba - 40) * kBlockSize, GptImage::kArraySize),
+                       "fdatasync"}),
+              gOps);
+}
+
+TEST_F(GptImageTest, setBootChainRewritesBackupCopy) {
+    for (enum boot_chain boot : {NORMAL_BOOT, BACKUP_BOOT}) {
+        GptImage image(2, GptImage::kLastLba - 32);
+
+        SCOPED_TRACE("boot chain " + std::to_string(boot));
+        /* A stale backup array, which is replaced with the primary one */
+        image.entry(SECONDARY_GPT, "abl")[AB_FLAG_OFFSET] = AB_SLOT_ACTIVE_VAL;
+        image.seal();
+        image.writeTo(mFile.fd);
+        gOps.clear();
+        ASSERT_EQ(0, gpt2_set_boot_chain(mFile.fd, boot));
+
+        memcpy(image.entries(SECONDARY_GPT), image.entries(PRIMARY_GPT), GptImage::kArraySize);
+        if (boot == BACKUP_BOOT) {
+            uint8_t *entries = image.entries(SECONDARY_GPT);
+            ASSERT_EQ(0, ReferenceSwap(entries, entries + GptImage::kArraySize, PTN_ENTRY_SIZE));
+        }
+        image.seal();
+        EXPECT_EQ(image.bytes(), contents());
+        EXPECT_EQ(std::vector<std::string>({Write((GptImage::kLastLba - 32) * kBlockSize,
+                                                  GptImage::kArraySize + kBlockSize),
+                                            "fdatasync"}),
+                  gOps);
+    }
+}
+
+TEST_F(GptImageTest, setBootChainKeepsImageOnBadPrimaryCrc) {
+    GptImage image(2, GptImage::kLastLba - 32);
+
+    image.entry(PRIMARY_GPT, "abl")[AB_FLAG_OFFSET] = AB_SLOT_ACTIVE_VAL;
+    image.writeTo(mFile.fd);
+    EXPECT_NE(0, gpt2_set_boot_chain(mFile.fd, BACKUP_BOOT));
+    EXPECT_EQ(image.bytes(), contents());
+    EXPECT_TRUE(gOps.empty());
+}
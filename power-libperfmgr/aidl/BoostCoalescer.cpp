@@ -0,0 +1,135 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "BoostCoalescer.h"
+
+#include <android-base/properties.h>
+
+#include <string_view>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::chrono_literals::operator""ms;
+
+constexpr std::string_view kWindowProperty("vendor.powerhal.boost.coalesce_window_ms");
+
+const BoostCoalescerConfig BoostCoalescerConfig::DEFAULT{
+        .window = 10ms,
+};
+
+BoostCoalescerConfig BoostCoalescerConfig::ReadFromSystemProperties() {
+    BoostCoalescerConfig config = DEFAULT;
+    config.window = std::chrono::milliseconds(::android::base::GetUintProperty<uint32_t>(
+            kWindowProperty.data(), DEFAULT.window.count(), 1000));
+    return config;
+}
+
+bool BoostCoalescerConfig::operator==(const BoostCoalescerConfig &other) const {
+    return window == other.window;
+}
+
+std::ostream &operator<<(std::ostream &stream, const BoostCoalescerConfig &config) {
+    stream << "BoostCoalescerConfig(";
+    stream << "window=" << config.window.count() << "ms";
+    stream << ")";
+    return stream;
+}
+
+BoostCoalescer::BoostCoalescer(BoostCoalescerConfig config, std::vector<std::string> slotNames)
+    : mConfig(config), mSlots(slotNames.size()) {
+    for (size_t i = 0; i < slotNames.size(); i++) {
+        mSlots[i].name = std::move(slotNames[i]);
+    }
+}
+
+bool BoostCoalescer::AcceptBoost(size_t slotIndex, int32_t durationMs, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (slotIndex >= mSlots.size()) {
+        return true;
+    }
+    Slot *slot = &mSlots[slotIndex];
+    if (mConfig.window.count() == 0) {
+        return Count(slot, true);
+    }
+    if (durationMs < 0) {
+        slot->deadline.reset();
+        slot->untimed = false;
+        return Count(slot, true);
+    }
+    if (durationMs == 0) {
+        const bool accepted = !slot->untimed;
+        slot->deadline.reset();
+        slot->untimed = true;
+        return Count(slot, accepted);
+    }
+    // A timed request replaces an untimed one in HintManager, so that always goes through.
+    const Clock::time_point deadline = now + std::chrono::milliseconds(durationMs);
+    if (!slot->untimed && slot->deadline && now < *slot->deadline &&
+        deadline <= *slot->deadline + mConfig.window) {
+        return Count(slot, false);
+    }
+    slot->deadline = deadline;
+    slot->untimed = false;
+    return Count(slot, true);
+}
+
+bool BoostCoalescer::AcceptEvent(size_t slotIndex, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (slotIndex >= mSlots.size()) {
+        return true;
+    }
+    Slot *slot = &mSlots[slotIndex];
+    if (slot->lastEvent && now < *slot->lastEvent + mConfig.window) {
+        return Count(slot, false);
+    }
+    slot->lastEvent = now;
+    return Count(slot, true);
+}
+
+bool BoostCoalescer::Count(Slot *slot, bool accepted) {
+    if (accepted) {
+        slot->numAccepted++;
+    } else {
+        slot->numCoalesced++;
+    }
+    return accepted;
+}
+
+void BoostCoalescer::DumpToStream(std::ostream &stream) const {
+    std::lock_guard<std::mutex> lock(mLock);
+    stream << "Boost coalescing, window " << mConfig.window.count() << "ms:\n";
+    for (const Slot &slot : mSlots) {
+        if (slot.numAccepted == 0 && slot.numCoalesced == 0) {
+            continue;
+        }
+        stream << "  " << slot.name << ": accepted " << slot.numAccepted << ", coalesced "
+               << slot.numCoalesced << "\n";
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
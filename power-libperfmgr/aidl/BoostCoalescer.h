@@ -0,0 +1,89 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+struct BoostCoalescerConfig {
+    static BoostCoalescerConfig ReadFromSystemProperties();
+    static const BoostCoalescerConfig DEFAULT;
+
+    // A timed boost that would move the deadline of the one already forwarded by no more than
+    // this is merged into it, and events repeating within it are dropped. 0 forwards everything.
+    std::chrono::milliseconds window;
+
+    bool operator==(const BoostCoalescerConfig &other) const;
+};
+
+std::ostream &operator<<(std::ostream &os, const BoostCoalescerConfig &config);
+
+// Filters high-rate boost requests before they reach HintManager or the Looper. Each slot tracks
+// the deadline it last forwarded; requests that are already covered, up to the configured window,
+// are counted as coalesced and dropped. Thread-safe.
+class BoostCoalescer {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // One slot per entry of |slotNames|, which are only used for the dump.
+    BoostCoalescer(BoostCoalescerConfig config, std::vector<std::string> slotNames);
+
+    // Returns whether the boost must be forwarded. |durationMs| follows Power::setBoost():
+    // positive for a timed boost, 0 for an untimed one and negative to end it.
+    bool AcceptBoost(size_t slot, int32_t durationMs, Clock::time_point now);
+    // For requests without a duration of their own: forwarded at most once per window.
+    bool AcceptEvent(size_t slot, Clock::time_point now);
+
+    void DumpToStream(std::ostream &stream) const;
+
+  private:
+    struct Slot {
+        std::string name;
+        // Deadline of the last forwarded timed boost.
+        std::optional<Clock::time_point> deadline;
+        // An untimed boost is in effect until ended.
+        bool untimed = false;
+        std::optional<Clock::time_point> lastEvent;
+        uint64_t numAccepted = 0;
+        uint64_t numCoalesced = 0;
+    };
+
+    bool Count(Slot *slot, bool accepted);
+
+    const BoostCoalescerConfig mConfig;
+    mutable std::mutex mLock;
+    std::vector<Slot> mSlots;  // protected by mLock
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,372 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+#define ATRACE_TAG (ATRACE_TAG_POWER | ATRACE_TAG_HAL)
+
+#include "BoostController.h"
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <inttypes.h>
+#include <log/log.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringPrintf;
+
+constexpr std::string_view kDefaultControllerProperty("vendor.powerhal.adpf.controller");
+constexpr std::string_view kControllerOverridesProperty(
+        "vendor.powerhal.adpf.controller.overrides");
+
+namespace {
+
+static inline int64_t ns_to_100us(int64_t ns) {
+    return ns / 100000;
+}
+
+constexpr size_t kNumFuzzySets = 5;
+// Centers of the NB, NS, ZE, PS and PB sets for the relative error and its change.
+constexpr std::array<double, kNumFuzzySets> kErrorCenters = {-0.5, -0.2, 0.0, 0.2, 0.5};
+constexpr std::array<double, kNumFuzzySets> kErrorChangeCenters = {-0.4, -0.15, 0.0, 0.15, 0.4};
+// uclamp.min step, indexed by [error set][error change set]. Overruns that are still growing get
+// the steepest boost, and the release is gentler than the boost so a single light frame doesn't
+// undo it.
+constexpr std::array<std::array<double, kNumFuzzySets>, kNumFuzzySets> kFuzzyRules = {{
+        {-48, -40, -32, -24, -16},
+        {-24, -16, -8, -4, 0},
+        {-8, -4, 0, 4, 8},
+        {0, 8, 16, 24, 32},
+        {24, 40, 64, 96, 128},
+}};
+// Relative errors beyond this are clipped before inference.
+constexpr double kFuzzyErrorLow = -1.0;
+constexpr double kFuzzyErrorHigh = 2.0;
+
+// Triangular memberships over the given centers, saturating at both ends. Adjacent sets overlap so
+// at most two are non-zero and they sum to 1.
+std::array<double, kNumFuzzySets> Memberships(double x,
+                                              const std::array<double, kNumFuzzySets> &centers) {
+    std::array<double, kNumFuzzySets> mu{};
+    if (x <= centers.front()) {
+        mu.front() = 1.0;
+        return mu;
+    }
+    if (x >= centers.back()) {
+        mu.back() = 1.0;
+        return mu;
+    }
+    for (size_t i = 0; i + 1 < kNumFuzzySets; i++) {
+        if (x <= centers[i + 1]) {
+            mu[i] = (centers[i + 1] - x) / (centers[i + 1] - centers[i]);
+            mu[i + 1] = 1.0 - mu[i];
+            break;
+        }
+    }
+    return mu;
+}
+
+}  // namespace
+
+int64_t PidBoostController::ComputeOutput(const std::vector<WorkDuration> &actualDurations,
+                                          std::chrono::nanoseconds targetDuration,
+                                          const BoostControllerParams &params) {
+    uint64_t samplingWindowP = params.samplingWindowP;
+    uint64_t samplingWindowI = params.samplingWindowI;
+    uint64_t samplingWindowD = params.samplingWindowD;
+    int64_t targetDurationNanos = (int64_t)targetDuration.count();
+    int64_t length = actualDurations.size();
+    int64_t p_start =
+            samplingWindowP == 0 || samplingWindowP > length ? 0 : length - samplingWindowP;
+    int64_t i_start =
+            samplingWindowI == 0 || samplingWindowI > length ? 0 : length - samplingWindowI;
+    int64_t d_start =
+            samplingWindowD == 0 || samplingWindowD > length ? 0 : length - samplingWindowD;
+    int64_t dt = ns_to_100us(targetDurationNanos);
+    int64_t err_sum = 0;
+    int64_t derivative_sum = 0;
+    for (int64_t i = std::min({p_start, i_start, d_start}); i < length; i++) {
+        int64_t actualDurationNanos = actualDurations[i].durationNanos;
+        if (std::abs(actualDurationNanos) > targetDurationNanos * 20) {
+            ALOGW("The actual duration is way far from the target (%" PRId64 " >> %" PRId64 ")",
+                  actualDurationNanos, targetDurationNanos);
+        }
+        // PID control algorithm
+        int64_t error = ns_to_100us(actualDurationNanos - targetDurationNanos);
+        if (i >= d_start) {
+            derivative_sum += error - mPreviousError;
+        }
+        if (i >= p_start) {
+            err_sum += error;
+        }
+        if (i >= i_start) {
+            mIntegralError = mIntegralError + error * dt;
+            mIntegralError = std::min(params.pidIHighDivI, mIntegralError);
+            mIntegralError = std::max(params.pidILowDivI, mIntegralError);
+        }
+        mPreviousError = error;
+    }
+    int64_t pOut = static_cast<int64_t>((err_sum > 0 ? params.pidPo : params.pidPu) * err_sum /
+                                        (length - p_start));
+    int64_t iOut = static_cast<int64_t>(params.pidI * mIntegralError);
+    int64_t dOut = static_cast<int64_t>((derivative_sum > 0 ? params.pidDo : params.pidDu) *
+                                        derivative_sum / dt / (length - d_start));
+
+    int64_t output = pOut + iOut + dOut;
+    if (ATRACE_ENABLED()) {
+        const char *idstr = mIdString.c_str();
+        std::string sz = StringPrintf("adpf.%s-pid.err", idstr);
+        ATRACE_INT(sz.c_str(), err_sum / (length - p_start));
+        sz = StringPrintf("adpf.%s-pid.integral", idstr);
+        ATRACE_INT(sz.c_str(), mIntegralError);
+        sz = StringPrintf("adpf.%s-pid.derivative", idstr);
+        ATRACE_INT(sz.c_str(), derivative_sum / dt / (length - d_start));
+        sz = StringPrintf("adpf.%s-pid.pOut", idstr);
+        ATRACE_INT(sz.c_str(), pOut);
+        sz = StringPrintf("adpf.%s-pid.iOut", idstr);
+        ATRACE_INT(sz.c_str(), iOut);
+        sz = StringPrintf("adpf.%s-pid.dOut", idstr);
+        ATRACE_INT(sz.c_str(), dOut);
+        sz = StringPrintf("adpf.%s-pid.output", idstr);
+        ATRACE_INT(sz.c_str(), output);
+    }
+    return output;
+}
+
+int PidBoostController::Update(const std::vector<WorkDuration> &actualDurations,
+                               std::chrono::nanoseconds targetDuration, int currentUclampMin,
+                               const BoostControllerParams &params) {
+    const int64_t output = ComputeOutput(actualDurations, targetDuration, params);
+    return std::clamp(currentUclampMin + static_cast<int>(output), params.uclampMinLow,
+                      params.uclampMinHigh);
+}
+
+void PidBoostController::Rescale(double periodScale, const BoostControllerParams &from,
+                                 const BoostControllerParams &to) {
+    // Errors are absolute times and shrink with the frame period. The integral is rescaled so its
+    // share of the output stays the same under the new gain.
+    mPreviousError = static_cast<int64_t>(mPreviousError * periodScale);
+    if (to.pidI != 0) {
+        mIntegralError = static_cast<int64_t>(mIntegralError * from.pidI / to.pidI);
+    }
+    mIntegralError = std::clamp(mIntegralError, to.pidILowDivI, to.pidIHighDivI);
+}
+
+int FeedForwardBoostController::Update(const std::vector<WorkDuration> &actualDurations,
+                                       std::chrono::nanoseconds targetDuration,
+                                       int currentUclampMin, const BoostControllerParams &params) {
+    // The feed-forward offset sits on top of the PID-controlled value and is replaced, not
+    // accumulated, on every report.
+    const int64_t output = mPid.ComputeOutput(actualDurations, targetDuration, params);
+    const int base = std::clamp(currentUclampMin - mFeedForward + static_cast<int>(output),
+                                params.uclampMinLow, params.uclampMinHigh);
+    const int next = std::clamp(
+            base + static_cast<int>(mPredictor.Update(actualDurations, targetDuration)),
+            params.uclampMinLow, params.uclampMinHigh);
+    mFeedForward = next - base;
+    if (ATRACE_ENABLED()) {
+        std::string sz = StringPrintf("adpf.%s-ff.output", mIdString.c_str());
+        ATRACE_INT(sz.c_str(), mFeedForward);
+    }
+    return next;
+}
+
+void FeedForwardBoostController::Rescale(double periodScale, const BoostControllerParams &from,
+                                         const BoostControllerParams &to) {
+    // The predictor works on durations relative to the target and is unaffected.
+    mPid.Rescale(periodScale, from, to);
+}
+
+int FuzzyBoostController::Update(const std::vector<WorkDuration> &actualDurations,
+                                 std::chrono::nanoseconds targetDuration, int currentUclampMin,
+                                 const BoostControllerParams &params) {
+    if (actualDurations.empty() || targetDuration.count() <= 0) {
+        return std::clamp(currentUclampMin, params.uclampMinLow, params.uclampMinHigh);
+    }
+    double error = 0;
+    for (const auto &d : actualDurations) {
+        error += static_cast<double>(d.durationNanos - targetDuration.count()) /
+                 targetDuration.count();
+    }
+    error = std::clamp(error / actualDurations.size(), kFuzzyErrorLow, kFuzzyErrorHigh);
+    const double step = Infer(error, error - mPreviousError);
+    mPreviousError = error;
+    return std::clamp(currentUclampMin + static_cast<int>(step), params.uclampMinLow,
+                      params.uclampMinHigh);
+}
+
+double FuzzyBoostController::Infer(double error, double errorChange) {
+    const auto errorMu = Memberships(error, kErrorCenters);
+    const auto changeMu = Memberships(errorChange, kErrorChangeCenters);
+    double weightedSum = 0;
+    double weightSum = 0;
+    for (size_t i = 0; i < kNumFuzzySets; i++) {
+        for (size_t j = 0; j < kNumFuzzySets; j++) {
+            const double w = std::min(errorMu[i], changeMu[j]);
+            weightedSum += w * kFuzzyRules[i][j];
+            weightSum += w;
+        }
+    }
+    return weightSum > 0 ? weightedSum / weightSum : 0;
+}
+
+std::optional<BoostControllerType> ParseBoostControllerType(const std::string &name) {
+    for (auto type : {BoostControllerType::PID, BoostControllerType::PID_FEED_FORWARD,
+                      BoostControllerType::FUZZY}) {
+        if (name == BoostControllerTypeName(type)) {
+            return type;
+        }
+    }
+    return std::nullopt;
+}
+
+const char *BoostControllerTypeName(BoostControllerType type) {
+    switch (type) {
+        case BoostControllerType::PID:
+            return "pid";
+        case BoostControllerType::PID_FEED_FORWARD:
+            return "pid_ff";
+        case BoostControllerType::FUZZY:
+            return "fuzzy";
+    }
+    return "unknown";
+}
+
+const BoostControllerConfig BoostControllerConfig::DEFAULT{
+        .defaultType = BoostControllerType::PID,
+        .uidOverrides = {},
+        .packageOverrides = {},
+};
+
+BoostControllerConfig BoostControllerConfig::ReadFromSystemProperties() {
+    BoostControllerConfig config = DEFAULT;
+    // Setting vendor.powerhal.adpf.ff.enabled predates the controller selection and still picks
+    // the feed-forward controller when no default is given.
+    if (WorkloadPredictorConfig::ReadFromSystemProperties().enabled) {
+        config.defaultType = BoostControllerType::PID_FEED_FORWARD;
+    }
+    const std::string defaultName = ::android::base::GetProperty(kDefaultControllerProperty.data(),
+                                                                 "");
+    if (!defaultName.empty()) {
+        const auto type = ParseBoostControllerType(defaultName);
+        if (type) {
+            config.defaultType = *type;
+        } else {
+            LOG(ERROR) << "Unknown ADPF controller in " << kDefaultControllerProperty << ": "
+                       << defaultName;
+        }
+    }
+    const std::string overrides =
+            ::android::base::GetProperty(kControllerOverridesProperty.data(), "");
+    if (!overrides.empty() && !config.ParseOverrides(overrides)) {
+        LOG(ERROR) << "Failed to parse " << kControllerOverridesProperty << ": " << overrides;
+    }
+    return config;
+}
+
+bool BoostControllerConfig::ParseOverrides(const std::string &input) {
+    std::unordered_map<int32_t, BoostControllerType> uids;
+    std::unordered_map<std::string, BoostControllerType> packages;
+    for (const auto &entry : ::android::base::Split(input, ",")) {
+        const std::string trimmed = ::android::base::Trim(entry);
+        if (trimmed.empty()) {
+            continue;
+        }
+        const size_t colon = trimmed.rfind(':');
+        if (colon == std::string::npos || colon == 0) {
+            return false;
+        }
+        const std::string key = trimmed.substr(0, colon);
+        const auto type = ParseBoostControllerType(trimmed.substr(colon + 1));
+        if (!type) {
+            return false;
+        }
+        int32_t uid;
+        if (::android::base::ParseInt(key, &uid, 0)) {
+            uids[uid] = *type;
+        } else {
+            packages[key] = *type;
+        }
+    }
+    uidOverrides = std::move(uids);
+    packageOverrides = std::move(packages);
+    return true;
+}
+
+BoostControllerType BoostControllerConfig::Select(int32_t uid,
+                                                  const std::string &packageName) const {
+    if (const auto it = uidOverrides.find(uid); it != uidOverrides.end()) {
+        return it->second;
+    }
+    if (const auto it = packageOverrides.find(packageName); it != packageOverrides.end()) {
+        return it->second;
+    }
+    return defaultType;
+}
+
+bool BoostControllerConfig::operator==(const BoostControllerConfig &other) const {
+    return defaultType == other.defaultType && uidOverrides == other.uidOverrides &&
+           packageOverrides == other.packageOverrides;
+}
+
+std::ostream &operator<<(std::ostream &stream, const BoostControllerConfig &config) {
+    stream << "BoostControllerConfig(";
+    stream << "defaultType=" << BoostControllerTypeName(config.defaultType) << ", ";
+    stream << "uidOverrides=[";
+    for (const auto &[uid, type] : config.uidOverrides) {
+        stream << uid << ":" << BoostControllerTypeName(type) << ",";
+    }
+    stream << "], packageOverrides=[";
+    for (const auto &[package, type] : config.packageOverrides) {
+        stream << package << ":" << BoostControllerTypeName(type) << ",";
+    }
+    stream << "])";
+    return stream;
+}
+
+std::unique_ptr<IBoostController> CreateBoostController(BoostControllerType type,
+                                                        const std::string &idstr) {
+    switch (type) {
+        case BoostControllerType::PID_FEED_FORWARD:
+            return std::make_unique<FeedForwardBoostController>(
+                    idstr, WorkloadPredictorConfig::ReadFromSystemProperties());
+        case BoostControllerType::FUZZY:
+            return std::make_unique<FuzzyBoostController>();
+        case BoostControllerType::PID:
+            break;
+    }
+    return std::make_unique<PidBoostController>(idstr);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
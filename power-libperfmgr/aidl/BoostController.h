@@ -0,0 +1,173 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/power/WorkDuration.h>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "WorkloadPredictor.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::aidl::android::hardware::power::WorkDuration;
+
+// The subset of AdpfConfig the controllers consume. Kept separate so the controllers don't depend
+// on libperfmgr and can be exercised on their own.
+struct BoostControllerParams {
+    double pidPo;
+    double pidPu;
+    double pidI;
+    int64_t pidIHighDivI;
+    int64_t pidILowDivI;
+    double pidDo;
+    double pidDu;
+    uint64_t samplingWindowP;
+    uint64_t samplingWindowI;
+    uint64_t samplingWindowD;
+    int uclampMinLow;
+    int uclampMinHigh;
+};
+
+// Turns the reported work durations of a hint session into its next uclamp.min. One instance is
+// owned by each PowerHintSession, which serializes the calls, so implementations keep their
+// per-session state without locking.
+class IBoostController {
+  public:
+    virtual ~IBoostController() {}
+    // Returns the uclamp.min to apply next, clamped to [uclampMinLow, uclampMinHigh].
+    virtual int Update(const std::vector<WorkDuration> &actualDurations,
+                       std::chrono::nanoseconds targetDuration, int currentUclampMin,
+                       const BoostControllerParams &params) = 0;
+    // Called when the display refresh rate changes. Target durations are multiplied by
+    // |periodScale| and the profile changes from |from| to |to|; implementations carry their state
+    // over so the next Update() continues where the old regime left off.
+    virtual void Rescale(double /*periodScale*/, const BoostControllerParams & /*from*/,
+                         const BoostControllerParams & /*to*/) {}
+    virtual const char *GetName() const = 0;
+};
+
+// The PID loop the HAL has always used. The output is added to the current uclamp.min.
+class PidBoostController : public IBoostController {
+  public:
+    explicit PidBoostController(std::string idstr) : mIdString(std::move(idstr)) {}
+    int Update(const std::vector<WorkDuration> &actualDurations,
+               std::chrono::nanoseconds targetDuration, int currentUclampMin,
+               const BoostControllerParams &params) override;
+    void Rescale(double periodScale, const BoostControllerParams &from,
+                 const BoostControllerParams &to) override;
+    const char *GetName() const override { return "pid"; }
+
+    // Runs one step of the loop and returns the raw output, in uclamp units.
+    int64_t ComputeOutput(const std::vector<WorkDuration> &actualDurations,
+                          std::chrono::nanoseconds targetDuration,
+                          const BoostControllerParams &params);
+
+  private:
+    const std::string mIdString;
+    int64_t mIntegralError = 0;
+    int64_t mPreviousError = 0;
+};
+
+// PID with the WorkloadPredictor offset on top, see WorkloadPredictorConfig.
+class FeedForwardBoostController : public IBoostController {
+  public:
+    FeedForwardBoostController(std::string idstr, WorkloadPredictorConfig config)
+        : mPid(idstr), mPredictor(config), mIdString(std::move(idstr)) {}
+    int Update(const std::vector<WorkDuration> &actualDurations,
+               std::chrono::nanoseconds targetDuration, int currentUclampMin,
+               const BoostControllerParams &params) override;
+    void Rescale(double periodScale, const BoostControllerParams &from,
+                 const BoostControllerParams &to) override;
+    const char *GetName() const override { return "pid_ff"; }
+
+  private:
+    PidBoostController mPid;
+    WorkloadPredictor mPredictor;
+    const std::string mIdString;
+    // Offset included in the uclamp.min returned by the last Update().
+    int mFeedForward = 0;
+};
+
+// Table-driven fuzzy controller. The relative error of the last frame and its change since the
+// previous report are each mapped onto five triangular sets (negative big to positive big), and the
+// 5x5 rule table gives the uclamp.min step for every pair. The step is the firing-strength weighted
+// average of the table entries. Needs no tuning or rescaling per target duration since both inputs
+// are relative.
+class FuzzyBoostController : public IBoostController {
+  public:
+    int Update(const std::vector<WorkDuration> &actualDurations,
+               std::chrono::nanoseconds targetDuration, int currentUclampMin,
+               const BoostControllerParams &params) override;
+    const char *GetName() const override { return "fuzzy"; }
+
+    // Returns the uclamp.min step for the given error and error change, both relative to target.
+    static double Infer(double error, double errorChange);
+
+  private:
+    double mPreviousError = 0;
+};
+
+enum class BoostControllerType {
+    PID,
+    PID_FEED_FORWARD,
+    FUZZY,
+};
+
+std::optional<BoostControllerType> ParseBoostControllerType(const std::string &name);
+const char *BoostControllerTypeName(BoostControllerType type);
+
+// Selects the controller of each session. Overrides are matched by uid first, then by package
+// name, and everything else gets the default.
+struct BoostControllerConfig {
+    static BoostControllerConfig ReadFromSystemProperties();
+    static const BoostControllerConfig DEFAULT;
+
+    // Parses "<uid|package>:<controller>" entries separated by commas into the override maps.
+    // Returns false and leaves the maps untouched on a malformed entry.
+    bool ParseOverrides(const std::string &input);
+    BoostControllerType Select(int32_t uid, const std::string &packageName) const;
+
+    BoostControllerType defaultType;
+    std::unordered_map<int32_t, BoostControllerType> uidOverrides;
+    std::unordered_map<std::string, BoostControllerType> packageOverrides;
+
+    bool operator==(const BoostControllerConfig &other) const;
+};
+
+std::ostream &operator<<(std::ostream &os, const BoostControllerConfig &config);
+
+std::unique_ptr<IBoostController> CreateBoostController(BoostControllerType type,
+                                                        const std::string &idstr);
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
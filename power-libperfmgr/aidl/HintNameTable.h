@@ -0,0 +1,91 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/binder_enums.h>
+#include <perfmgr/HintManager.h>
+
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// The name of every Mode or Boost value and whether powerhint.json has a hint for it, resolved
+// once at startup. Lookups index a vector by the enum value, so setMode() and setBoost() neither
+// build nor hash a string. HintManager only takes names, so the interned string is what gets
+// passed on to it.
+template <typename E>
+class HintNameTable {
+  public:
+    HintNameTable() {
+        for (E value : ndk::enum_range<E>()) {
+            const size_t index = static_cast<size_t>(value);
+            if (index >= mEntries.size()) {
+                mEntries.resize(index + 1);
+            }
+            mEntries[index].name = toString(value);
+        }
+    }
+
+    // Looks up which names powerhint.json supports, which parses it on first use. Every value is
+    // unsupported until then. Not thread-safe, call it before any lookups from other threads.
+    void ResolveSupport() {
+        std::shared_ptr<::android::perfmgr::HintManager> hm =
+                ::android::perfmgr::HintManager::GetInstance();
+        for (Entry &entry : mEntries) {
+            entry.supported = hm->IsHintSupported(entry.name);
+        }
+    }
+
+    const std::string &Name(E value) const { return Lookup(value).name; }
+    bool IsSupported(E value) const { return Lookup(value).supported; }
+    // All names, indexed by enum value.
+    std::vector<std::string> Names() const {
+        std::vector<std::string> names;
+        for (const Entry &entry : mEntries) {
+            names.push_back(entry.name);
+        }
+        return names;
+    }
+
+  private:
+    struct Entry {
+        std::string name;
+        bool supported = false;
+    };
+
+    // Values newer than the HAL's interface version fall back to an unsupported entry.
+    const Entry &Lookup(E value) const {
+        static const Entry kUnknown = {"UNKNOWN", false};
+        const size_t index = static_cast<size_t>(value);
+        return index < mEntries.size() ? mEntries[index] : kUnknown;
+    }
+
+    std::vector<Entry> mEntries;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -21,14 +21,21 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android/binder_ibinder_platform.h>
 #include <perfmgr/HintManager.h>
 #include <utils/Log.h>
 
+#include <cmath>
 #include <mutex>
+#include <optional>
+#include <sstream>
 
 #include "PowerHintSession.h"
 #include "PowerSessionManager.h"
+#include "StartupTimer.h"
+#include "adaptivecpu/CpuLoadReaderProcStat.h"
 #include "disp-power/DisplayLowPower.h"
 
 #define TARGET_TAP_TO_WAKE_NODE "/sys/touchpanel/double_tap"
@@ -41,19 +48,67 @@ namespace impl {
 namespace pixel {
 
 using ::aidl::google::hardware::power::impl::pixel::PowerHintSession;
+using ::android::perfmgr::AdpfConfig;
 using ::android::perfmgr::HintManager;
 
 constexpr char kPowerHalStateProp[] = "vendor.powerhal.state";
 constexpr char kPowerHalAudioProp[] = "vendor.powerhal.audio";
 constexpr char kPowerHalRenderingProp[] = "vendor.powerhal.rendering";
+// dumpsys argument selecting the packed ADPF session stats instead of the text dump.
+constexpr std::string_view kDumpAdpfBinaryArg("--adpf-binary");
+
+namespace {
+
+// Samples what InteractionHandler steps its boost tier on. Only called from the
+// PowerHintMonitor thread.
+class InteractionLoadSampler {
+  public:
+    InteractionLoadSampler() : mInitialized(mCpuLoadReader.Init()), mLastDeadlineMisses(0) {}
+
+    std::optional<InteractionLoad> operator()() {
+        const uint64_t misses = PowerSessionManager::getInstance()->getDeadlineMisses();
+        const bool sessionsMissing = misses != mLastDeadlineMisses;
+        mLastDeadlineMisses = misses;
+        std::array<double, NUM_CPU_CORES> idleTimes;
+        if (!mInitialized || !mCpuLoadReader.GetRecentCpuLoads(&idleTimes)) {
+            return std::nullopt;
+        }
+        double maxUtilization = 0;
+        for (double idle : idleTimes) {
+            // NaN when no time passed on the core, which counts as idle.
+            if (!std::isnan(idle)) {
+                maxUtilization = std::max(maxUtilization, 1.0 - idle);
+            }
+        }
+        return InteractionLoad{.sessionsMissing = sessionsMissing,
+                               .maxCpuUtilization = maxUtilization};
+    }
+
+  private:
+    CpuLoadReaderProcStat mCpuLoadReader;
+    const bool mInitialized;
+    uint64_t mLastDeadlineMisses;
+};
+
+}  // namespace
 
 Power::Power(std::shared_ptr<DisplayLowPower> dlpw, std::shared_ptr<AdaptiveCpu> adaptiveCpu)
     : mDisplayLowPower(dlpw),
       mAdaptiveCpu(adaptiveCpu),
       mInteractionHandler(nullptr),
-      mSustainedPerfModeOn(false) {
+      mSustainedPerfModeOn(false),
+      mBoostCoalescer(BoostCoalescerConfig::ReadFromSystemProperties(), mBoostNames.Names()) {
     mInteractionHandler = std::make_unique<InteractionHandler>();
-    mInteractionHandler->Init();
+    mInteractionHandler->SetLoadProvider(
+            [sampler = std::make_shared<InteractionLoadSampler>()] { return (*sampler)(); });
+}
+
+void Power::finishStartup() {
+    mModeNames.ResolveSupport();
+    mBoostNames.ResolveSupport();
+    PowerSessionManager::getInstance()->setAppSessionActivityListener(
+            [dlpw = mDisplayLowPower](bool active) { dlpw->SetSessionsActive(active); });
+    mInteractionHandler->Init(PowerHintMonitor::getInstance()->getLooper());
 
     std::string state = ::android::base::GetProperty(kPowerHalStateProp, "");
     if (state == "SUSTAINED_PERFORMANCE") {
@@ -78,20 +133,26 @@ Power::Power(std::shared_ptr<DisplayLowPower> dlpw, std::shared_ptr<AdaptiveCpu>
 }
 
 ndk::ScopedAStatus Power::setMode(Mode type, bool enabled) {
-    LOG(DEBUG) << "Power setMode: " << toString(type) << " to: " << enabled;
-    if (HintManager::GetInstance()->GetAdpfProfile() &&
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs > 0) {
-        PowerSessionManager::getInstance()->updateHintMode(toString(type), enabled);
+    const std::string &name = mModeNames.Name(type);
+    LOG(DEBUG) << "Power setMode: " << name << " to: " << enabled;
+    std::shared_ptr<AdpfConfig> adpfConfig = PowerSessionManager::getInstance()->getAdpfProfile();
+    if (adpfConfig && adpfConfig->mReportingRateLimitNs > 0) {
+        PowerSessionManager::getInstance()->updateHintMode(name, enabled);
+    }
+    // Also applies the DISPLAY_INACTIVE hint below.
+    if (type == Mode::DISPLAY_INACTIVE) {
+        mDisplayLowPower->SetDisplayInactive(enabled);
     }
     switch (type) {
         case Mode::DOUBLE_TAP_TO_WAKE:
             ::android::base::WriteStringToFile(enabled ? "1" : "0", TARGET_TAP_TO_WAKE_NODE, true);
             break;
         case Mode::LOW_POWER:
+            mDisplayLowPower->SetLowPowerMode(enabled);
             break;
         case Mode::SUSTAINED_PERFORMANCE:
             if (enabled) {
-                HintManager::GetInstance()->DoHint("SUSTAINED_PERFORMANCE");
+                HintManager::GetInstance()->DoHint(name);
             }
             mSustainedPerfModeOn = true;
             break;
@@ -115,10 +176,13 @@ ndk::ScopedAStatus Power::setMode(Mode type, bool enabled) {
         case Mode::GAME_LOADING:
             [[fallthrough]];
         default:
+            if (!mModeNames.IsSupported(type)) {
+                break;
+            }
             if (enabled) {
-                HintManager::GetInstance()->DoHint(toString(type));
+                HintManager::GetInstance()->DoHint(name);
             } else {
-                HintManager::GetInstance()->EndHint(toString(type));
+                HintManager::GetInstance()->EndHint(name);
             }
             break;
     }
@@ -127,28 +191,30 @@ ndk::ScopedAStatus Power::setMode(Mode type, bool enabled) {
 }
 
 ndk::ScopedAStatus Power::isModeSupported(Mode type, bool *_aidl_return) {
-    bool supported = HintManager::GetInstance()->IsHintSupported(toString(type));
+    bool supported = mModeNames.IsSupported(type);
     // LOW_POWER and DOUBLE_TAP_TO_WAKE handled insides PowerHAL specifically
     if (type == Mode::LOW_POWER || type == Mode::DOUBLE_TAP_TO_WAKE) {
         supported = true;
     }
-    LOG(INFO) << "Power mode " << toString(type) << " isModeSupported: " << supported;
+    LOG(INFO) << "Power mode " << mModeNames.Name(type) << " isModeSupported: " << supported;
     *_aidl_return = supported;
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Power::setBoost(Boost type, int32_t durationMs) {
-    LOG(DEBUG) << "Power setBoost: " << toString(type) << " duration: " << durationMs;
-    if (HintManager::GetInstance()->GetAdpfProfile() &&
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs > 0) {
-        PowerSessionManager::getInstance()->updateHintBoost(toString(type), durationMs);
+    const std::string &name = mBoostNames.Name(type);
+    LOG(DEBUG) << "Power setBoost: " << name << " duration: " << durationMs;
+    std::shared_ptr<AdpfConfig> adpfConfig = PowerSessionManager::getInstance()->getAdpfProfile();
+    if (adpfConfig && adpfConfig->mReportingRateLimitNs > 0) {
+        PowerSessionManager::getInstance()->updateHintBoost(name, durationMs);
     }
     switch (type) {
         case Boost::INTERACTION:
             if (mSustainedPerfModeOn) {
                 break;
             }
-            mInteractionHandler->Acquire(durationMs);
+            mInteractionHandler->Acquire(durationMs,
+                                         PowerSessionManager::getInstance()->getForegroundUid());
             break;
         case Boost::DISPLAY_UPDATE_IMMINENT:
             [[fallthrough]];
@@ -157,16 +223,19 @@ ndk::ScopedAStatus Power::setBoost(Boost type, int32_t durationMs) {
         case Boost::AUDIO_LAUNCH:
             [[fallthrough]];
         default:
-            if (mSustainedPerfModeOn) {
+            if (mSustainedPerfModeOn || !mBoostNames.IsSupported(type)) {
+                break;
+            }
+            if (!mBoostCoalescer.AcceptBoost(static_cast<size_t>(type), durationMs,
+                                             BoostCoalescer::Clock::now())) {
                 break;
             }
             if (durationMs > 0) {
-                HintManager::GetInstance()->DoHint(toString(type),
-                                                   std::chrono::milliseconds(durationMs));
+                HintManager::GetInstance()->DoHint(name, std::chrono::milliseconds(durationMs));
             } else if (durationMs == 0) {
-                HintManager::GetInstance()->DoHint(toString(type));
+                HintManager::GetInstance()->DoHint(name);
             } else {
-                HintManager::GetInstance()->EndHint(toString(type));
+                HintManager::GetInstance()->EndHint(name);
             }
             break;
     }
@@ -175,8 +244,8 @@ ndk::ScopedAStatus Power::setBoost(Boost type, int32_t durationMs) {
 }
 
 ndk::ScopedAStatus Power::isBoostSupported(Boost type, bool *_aidl_return) {
-    bool supported = HintManager::GetInstance()->IsHintSupported(toString(type));
-    LOG(INFO) << "Power boost " << toString(type) << " isBoostSupported: " << supported;
+    bool supported = mBoostNames.IsSupported(type);
+    LOG(INFO) << "Power boost " << mBoostNames.Name(type) << " isBoostSupported: " << supported;
     *_aidl_return = supported;
     return ndk::ScopedAStatus::ok();
 }
@@ -185,8 +254,8 @@ ndk::ScopedAStatus Power::createHintSession(int32_t tgid, int32_t uid,
                                             const std::vector<int32_t> &threadIds,
                                             int64_t durationNanos,
                                             std::shared_ptr<IPowerHintSession> *_aidl_return) {
-    if (!HintManager::GetInstance()->GetAdpfProfile() ||
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs <= 0) {
+    std::shared_ptr<AdpfConfig> adpfConfig = PowerSessionManager::getInstance()->getAdpfProfile();
+    if (!adpfConfig || adpfConfig->mReportingRateLimitNs <= 0) {
         *_aidl_return = nullptr;
         return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
     }
@@ -197,14 +266,15 @@ ndk::ScopedAStatus Power::createHintSession(int32_t tgid, int32_t uid,
     }
     std::shared_ptr<IPowerHintSession> session = ndk::SharedRefBase::make<PowerHintSession>(
             mAdaptiveCpu, tgid, uid, threadIds, durationNanos);
+    // Reports are served at the same priority as setBoost(), ahead of the rest of the pool work.
+    AIBinder_setMinSchedulerPolicy(session->asBinder().get(), SCHED_NORMAL, -20);
     *_aidl_return = session;
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Power::getHintSessionPreferredRate(int64_t *outNanoseconds) {
-    *outNanoseconds = HintManager::GetInstance()->GetAdpfProfile()
-                              ? HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs
-                              : 0;
+    std::shared_ptr<AdpfConfig> adpfConfig = PowerSessionManager::getInstance()->getAdpfProfile();
+    *outNanoseconds = adpfConfig ? adpfConfig->mReportingRateLimitNs : 0;
     if (*outNanoseconds <= 0) {
         return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
     }
@@ -212,6 +282,33 @@ ndk::ScopedAStatus Power::getHintSessionPreferredRate(int64_t *outNanoseconds) {
     return ndk::ScopedAStatus::ok();
 }
 
+binder_status_t Power::dump(int fd, const char **args, uint32_t numArgs) {
+    for (uint32_t i = 0; i < numArgs; i++) {
+        if (kDumpAdpfBinaryArg == args[i]) {
+            PowerSessionManager::getInstance()->dumpBinaryToFd(fd);
+            fsync(fd);
+            return STATUS_OK;
+        }
+    }
+
+    std::ostringstream dumpBuf;
+    dumpBuf << "SustainedPerformanceMode: " << (mSustainedPerfModeOn ? "true" : "false") << "\n";
+    mBoostCoalescer.DumpToStream(dumpBuf);
+    mDisplayLowPower->DumpToStream(dumpBuf);
+    StartupTimer::GetInstance().DumpToStream(dumpBuf);
+    const std::string buf = dumpBuf.str();
+    if (!::android::base::WriteStringToFd(buf, fd)) {
+        PLOG(ERROR) << "Failed to dump state to fd";
+    }
+    // Dump nodes through libperfmgr
+    mInteractionHandler->DumpToFd(fd);
+    HintManager::GetInstance()->DumpToFd(fd);
+    PowerSessionManager::getInstance()->dumpToFd(fd);
+    mAdaptiveCpu->DumpToFd(fd);
+    fsync(fd);
+    return STATUS_OK;
+}
+
 }  // namespace pixel
 }  // namespace impl
 }  // namespace power
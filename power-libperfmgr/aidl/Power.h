@@ -22,6 +22,8 @@
 #include <memory>
 #include <thread>
 
+#include "BoostCoalescer.h"
+#include "HintNameTable.h"
 #include "adaptivecpu/AdaptiveCpu.h"
 #include "disp-power/DisplayLowPower.h"
 #include "disp-power/InteractionHandler.h"
@@ -40,6 +42,9 @@ using ::aidl::android::hardware::power::Mode;
 class Power : public ::aidl::android::hardware::power::BnPower {
   public:
     Power(std::shared_ptr<DisplayLowPower> dlpw, std::shared_ptr<AdaptiveCpu> adaptiveCpu);
+    // The part of the setup that can wait until the service is registered, including everything
+    // that needs powerhint.json. Must be called before the binder threads start serving calls.
+    void finishStartup();
     ndk::ScopedAStatus setMode(Mode type, bool enabled) override;
     ndk::ScopedAStatus isModeSupported(Mode type, bool *_aidl_return) override;
     ndk::ScopedAStatus setBoost(Boost type, int32_t durationMs) override;
@@ -49,12 +54,17 @@ class Power : public ::aidl::android::hardware::power::BnPower {
                                          int64_t durationNanos,
                                          std::shared_ptr<IPowerHintSession> *_aidl_return) override;
     ndk::ScopedAStatus getHintSessionPreferredRate(int64_t *outNanoseconds) override;
+    binder_status_t dump(int fd, const char **args, uint32_t numArgs) override;
 
   private:
     std::shared_ptr<DisplayLowPower> mDisplayLowPower;
     std::shared_ptr<AdaptiveCpu> mAdaptiveCpu;
     std::unique_ptr<InteractionHandler> mInteractionHandler;
     std::atomic<bool> mSustainedPerfModeOn;
+    // Resolved by finishStartup().
+    HintNameTable<Mode> mModeNames;
+    HintNameTable<Boost> mBoostNames;
+    BoostCoalescer mBoostCoalescer;
 };
 
 }  // namespace pixel
@@ -37,6 +37,7 @@ namespace power {
 namespace impl {
 namespace pixel {
 
+using ::android::perfmgr::AdpfConfig;
 using ::android::perfmgr::HintManager;
 
 ndk::ScopedAStatus PowerExt::setMode(const std::string &mode, bool enabled) {
@@ -47,8 +48,8 @@ ndk::ScopedAStatus PowerExt::setMode(const std::string &mode, bool enabled) {
     } else {
         HintManager::GetInstance()->EndHint(mode);
     }
-    if (HintManager::GetInstance()->GetAdpfProfile() &&
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs > 0) {
+    std::shared_ptr<AdpfConfig> adpfConfig = PowerSessionManager::getInstance()->getAdpfProfile();
+    if (adpfConfig && adpfConfig->mReportingRateLimitNs > 0) {
         PowerSessionManager::getInstance()->updateHintMode(mode, enabled);
     }
 
@@ -69,8 +70,8 @@ ndk::ScopedAStatus PowerExt::isModeSupported(const std::string &mode, bool *_aid
 
 ndk::ScopedAStatus PowerExt::setBoost(const std::string &boost, int32_t durationMs) {
     LOG(DEBUG) << "PowerExt setBoost: " << boost << " duration: " << durationMs;
-    if (HintManager::GetInstance()->GetAdpfProfile() &&
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs > 0) {
+    std::shared_ptr<AdpfConfig> adpfConfig = PowerSessionManager::getInstance()->getAdpfProfile();
+    if (adpfConfig && adpfConfig->mReportingRateLimitNs > 0) {
         PowerSessionManager::getInstance()->updateHintBoost(boost, durationMs);
     }
 
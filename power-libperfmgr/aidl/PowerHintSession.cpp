@@ -19,12 +19,14 @@
 
 #include "PowerHintSession.h"
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parsedouble.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <perfmgr/AdpfConfig.h>
 #include <private/android_filesystem_config.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <time.h>
 #include <utils/Trace.h>
@@ -48,75 +50,34 @@ using std::chrono::nanoseconds;
 
 namespace {
 
-static inline int64_t ns_to_100us(int64_t ns) {
-    return ns / 100000;
-}
-
-static int64_t convertWorkDurationToBoostByPid(std::shared_ptr<AdpfConfig> adpfConfig,
-                                               nanoseconds targetDuration,
-                                               const std::vector<WorkDuration> &actualDurations,
-                                               int64_t *integral_error, int64_t *previous_error,
-                                               const std::string &idstr) {
-    uint64_t samplingWindowP = adpfConfig->mSamplingWindowP;
-    uint64_t samplingWindowI = adpfConfig->mSamplingWindowI;
-    uint64_t samplingWindowD = adpfConfig->mSamplingWindowD;
-    int64_t targetDurationNanos = (int64_t)targetDuration.count();
-    int64_t length = actualDurations.size();
-    int64_t p_start =
-            samplingWindowP == 0 || samplingWindowP > length ? 0 : length - samplingWindowP;
-    int64_t i_start =
-            samplingWindowI == 0 || samplingWindowI > length ? 0 : length - samplingWindowI;
-    int64_t d_start =
-            samplingWindowD == 0 || samplingWindowD > length ? 0 : length - samplingWindowD;
-    int64_t dt = ns_to_100us(targetDurationNanos);
-    int64_t err_sum = 0;
-    int64_t derivative_sum = 0;
-    for (int64_t i = std::min({p_start, i_start, d_start}); i < length; i++) {
-        int64_t actualDurationNanos = actualDurations[i].durationNanos;
-        if (std::abs(actualDurationNanos) > targetDurationNanos * 20) {
-            ALOGW("The actual duration is way far from the target (%" PRId64 " >> %" PRId64 ")",
-                  actualDurationNanos, targetDurationNanos);
-        }
-        // PID control algorithm
-        int64_t error = ns_to_100us(actualDurationNanos - targetDurationNanos);
-        if (i >= d_start) {
-            derivative_sum += error - (*previous_error);
-        }
-        if (i >= p_start) {
-            err_sum += error;
-        }
-        if (i >= i_start) {
-            *integral_error = *integral_error + error * dt;
-            *integral_error = std::min(adpfConfig->getPidIHighDivI(), *integral_error);
-            *integral_error = std::max(adpfConfig->getPidILowDivI(), *integral_error);
-        }
-        *previous_error = error;
-    }
-    int64_t pOut = static_cast<int64_t>((err_sum > 0 ? adpfConfig->mPidPo : adpfConfig->mPidPu) *
-                                        err_sum / (length - p_start));
-    int64_t iOut = static_cast<int64_t>(adpfConfig->mPidI * (*integral_error));
-    int64_t dOut =
-            static_cast<int64_t>((derivative_sum > 0 ? adpfConfig->mPidDo : adpfConfig->mPidDu) *
-                                 derivative_sum / dt / (length - d_start));
+BoostControllerParams makeControllerParams(const AdpfConfig &adpfConfig) {
+    return BoostControllerParams{
+            .pidPo = adpfConfig.mPidPo,
+            .pidPu = adpfConfig.mPidPu,
+            .pidI = adpfConfig.mPidI,
+            .pidIHighDivI = adpfConfig.getPidIHighDivI(),
+            .pidILowDivI = adpfConfig.getPidILowDivI(),
+            .pidDo = adpfConfig.mPidDo,
+            .pidDu = adpfConfig.mPidDu,
+            .samplingWindowP = adpfConfig.mSamplingWindowP,
+            .samplingWindowI = adpfConfig.mSamplingWindowI,
+            .samplingWindowD = adpfConfig.mSamplingWindowD,
+            .uclampMinLow = static_cast<int>(adpfConfig.mUclampMinLow),
+            .uclampMinHigh = static_cast<int>(adpfConfig.mUclampMinHigh),
+    };
+}
 
-    int64_t output = pOut + iOut + dOut;
-    if (ATRACE_ENABLED()) {
-        std::string sz = StringPrintf("adpf.%s-pid.err", idstr.c_str());
-        ATRACE_INT(sz.c_str(), err_sum / (length - p_start));
-        sz = StringPrintf("adpf.%s-pid.integral", idstr.c_str());
-        ATRACE_INT(sz.c_str(), *integral_error);
-        sz = StringPrintf("adpf.%s-pid.derivative", idstr.c_str());
-        ATRACE_INT(sz.c_str(), derivative_sum / dt / (length - d_start));
-        sz = StringPrintf("adpf.%s-pid.pOut", idstr.c_str());
-        ATRACE_INT(sz.c_str(), pOut);
-        sz = StringPrintf("adpf.%s-pid.iOut", idstr.c_str());
-        ATRACE_INT(sz.c_str(), iOut);
-        sz = StringPrintf("adpf.%s-pid.dOut", idstr.c_str());
-        ATRACE_INT(sz.c_str(), dOut);
-        sz = StringPrintf("adpf.%s-pid.output", idstr.c_str());
-        ATRACE_INT(sz.c_str(), output);
-    }
-    return output;
+// The process name of an app is its package name, optionally followed by ":<process>".
+std::string getPackageName(int32_t tgid) {
+    std::string cmdline;
+    if (!::android::base::ReadFileToString(StringPrintf("/proc/%" PRId32 "/cmdline", tgid),
+                                           &cmdline)) {
+        ALOGW("Failed to read the package name of %" PRId32 ", only uid overrides apply: %s",
+              tgid, strerror(errno));
+        return "";
+    }
+    cmdline = cmdline.c_str();
+    return cmdline.substr(0, cmdline.find(':'));
 }
 
 }  // namespace
@@ -126,14 +87,21 @@ PowerHintSession::PowerHintSession(std::shared_ptr<AdaptiveCpu> adaptiveCpu, int
                                    int64_t durationNanos)
     : mAdaptiveCpu(adaptiveCpu) {
     mDescriptor = new AppHintDesc(tgid, uid, threadIds);
+    const BoostControllerConfig controllerConfig =
+            BoostControllerConfig::ReadFromSystemProperties();
+    const std::string packageName =
+            controllerConfig.packageOverrides.empty() ? "" : getPackageName(tgid);
+    mController = CreateBoostController(controllerConfig.Select(uid, packageName), getIdString());
     mDescriptor->duration = std::chrono::nanoseconds(durationNanos);
+    mControllerProfile = PowerSessionManager::getInstance()->getAdpfProfile();
     mStaleTimerHandler = sp<StaleTimerHandler>(new StaleTimerHandler(this));
     mEarlyBoostHandler = sp<EarlyBoostHandler>(new EarlyBoostHandler(this));
     mPowerManagerHandler = PowerSessionManager::getInstance();
     mLastUpdatedTime.store(std::chrono::steady_clock::now());
     mLastStartedTimeNs =
             std::chrono::duration_cast<std::chrono::nanoseconds>(
-                    (std::chrono::steady_clock::now() - mDescriptor->duration).time_since_epoch())
+                    (std::chrono::steady_clock::now() - mDescriptor->duration.load())
+                            .time_since_epoch())
                     .count();
     mLastDurationNs = durationNanos;
     mWorkPeriodNs = durationNanos;
@@ -141,13 +109,13 @@ PowerHintSession::PowerHintSession(std::shared_ptr<AdaptiveCpu> adaptiveCpu, int
     if (ATRACE_ENABLED()) {
         const std::string idstr = getIdString();
         std::string sz = StringPrintf("adpf.%s-target", idstr.c_str());
-        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.count());
+        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.load().count());
         sz = StringPrintf("adpf.%s-active", idstr.c_str());
         ATRACE_INT(sz.c_str(), mDescriptor->is_active.load());
     }
     PowerSessionManager::getInstance()->addPowerSession(this);
     // init boost
-    setSessionUclampMin(HintManager::GetInstance()->GetAdpfProfile()->mUclampMinInit);
+    setSessionUclampMin(PowerSessionManager::getInstance()->getAdpfProfile()->mUclampMinInit);
     ALOGV("PowerHintSession created: %s", mDescriptor->toString().c_str());
 }
 
@@ -200,6 +168,7 @@ int PowerHintSession::setSessionUclampMin(int32_t min) {
         mStaleTimerHandler->updateTimer();
     }
     PowerSessionManager::getInstance()->setUclampMin(this, min);
+    mStats.RecordUclampMin(min);
 
     if (ATRACE_ENABLED()) {
         const std::string idstr = getIdString();
@@ -220,6 +189,18 @@ void PowerHintSession::dumpToStream(std::ostream &stream) {
     stream << ", " << isTimeout() << ")";
 }
 
+void PowerHintSession::dumpStatsToStream(std::ostream &stream) {
+    stream << "  Controller: " << mController->GetName() << "\n";
+    mStats.DumpToStream(stream);
+}
+
+void PowerHintSession::getStatsRecord(SessionStatsRecord *record) {
+    record->tgid = mDescriptor->tgid;
+    record->uid = mDescriptor->uid;
+    record->targetDurationNs = mDescriptor->duration.load().count();
+    mStats.ToRecord(record);
+}
+
 ndk::ScopedAStatus PowerHintSession::pause() {
     if (mSessionClosed) {
         ALOGE("Error: session is dead");
@@ -286,15 +267,18 @@ ndk::ScopedAStatus PowerHintSession::updateTargetWorkDuration(int64_t targetDura
         ALOGE("Error: targetDurationNanos(%" PRId64 ") should bigger than 0", targetDurationNanos);
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
     }
-    targetDurationNanos =
-            targetDurationNanos * HintManager::GetInstance()->GetAdpfProfile()->mTargetTimeFactor;
+    targetDurationNanos = targetDurationNanos *
+                          PowerSessionManager::getInstance()->getAdpfProfile()->mTargetTimeFactor;
     ALOGV("update target duration: %" PRId64 " ns", targetDurationNanos);
 
-    mDescriptor->duration = std::chrono::nanoseconds(targetDurationNanos);
+    {
+        std::lock_guard<std::mutex> guard(mControllerLock);
+        mDescriptor->duration = std::chrono::nanoseconds(targetDurationNanos);
+    }
     if (ATRACE_ENABLED()) {
         const std::string idstr = getIdString();
         std::string sz = StringPrintf("adpf.%s-target", idstr.c_str());
-        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.count());
+        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.load().count());
     }
 
     return ndk::ScopedAStatus::ok();
@@ -306,7 +290,7 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
         ALOGE("Error: session is dead");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
-    if (mDescriptor->duration.count() == 0LL) {
+    if (mDescriptor->duration.load().count() == 0LL) {
         ALOGE("Expect to call updateTargetWorkDuration() first.");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
@@ -318,8 +302,10 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
         ALOGE("Error: shouldn't report duration during pause state.");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
-    std::shared_ptr<AdpfConfig> adpfConfig = HintManager::GetInstance()->GetAdpfProfile();
     mDescriptor->update_count++;
+    if (isAppSession()) {
+        PowerSessionManager::getInstance()->setForegroundUid(mDescriptor->uid);
+    }
     bool isFirstFrame = isTimeout();
     if (ATRACE_ENABLED()) {
         const std::string idstr = getIdString();
@@ -328,12 +314,21 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
         sz = StringPrintf("adpf.%s-actl_last", idstr.c_str());
         ATRACE_INT(sz.c_str(), actualDurations.back().durationNanos);
         sz = StringPrintf("adpf.%s-target", idstr.c_str());
-        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.count());
+        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.load().count());
         sz = StringPrintf("adpf.%s-hint.count", idstr.c_str());
         ATRACE_INT(sz.c_str(), mDescriptor->update_count);
         sz = StringPrintf("adpf.%s-hint.overtime", idstr.c_str());
         ATRACE_INT(sz.c_str(),
-                   actualDurations.back().durationNanos - mDescriptor->duration.count() > 0);
+                   actualDurations.back().durationNanos - mDescriptor->duration.load().count() > 0);
+    }
+
+    uint64_t misses = 0;
+    for (const WorkDuration &d : actualDurations) {
+        mStats.RecordWorkDuration(d.durationNanos, mDescriptor->duration.load().count());
+        misses += d.durationNanos > mDescriptor->duration.load().count();
+    }
+    if (misses > 0) {
+        PowerSessionManager::getInstance()->addDeadlineMisses(misses);
     }
 
     mLastUpdatedTime.store(std::chrono::steady_clock::now());
@@ -341,23 +336,50 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
         updateUniveralBoostMode();
     }
 
-    if (!adpfConfig->mPidOn) {
-        setSessionUclampMin(adpfConfig->mUclampMinHigh);
-        return ndk::ScopedAStatus::ok();
-    }
-    int64_t output = convertWorkDurationToBoostByPid(
-            adpfConfig, mDescriptor->duration, actualDurations, &(mDescriptor->integral_error),
-            &(mDescriptor->previous_error), getIdString());
-
     /* apply to all the threads in the group */
-    int next_min = std::min(static_cast<int>(adpfConfig->mUclampMinHigh),
-                            mDescriptor->current_min + static_cast<int>(output));
-    next_min = std::max(static_cast<int>(adpfConfig->mUclampMinLow), next_min);
-    setSessionUclampMin(next_min);
+    int next_min;
+    bool pidOn;
+    bool earlyBoostOn = false;
+    time_point<steady_clock> earlyBoostTime;
+    {
+        // A refresh-rate switch rescales the target, the controller, the work period estimate and
+        // uclamp.min together under this lock, so this report sees all of them either before the
+        // switch or after it.
+        std::lock_guard<std::mutex> guard(mControllerLock);
+        const AdpfConfig &adpfConfig = *mControllerProfile;
+        pidOn = adpfConfig.mPidOn;
+        if (!pidOn) {
+            next_min = adpfConfig.mUclampMinHigh;
+        } else {
+            next_min = mController->Update(actualDurations, mDescriptor->duration,
+                                           mDescriptor->current_min,
+                                           makeControllerParams(adpfConfig));
+            mStats.RecordUclampDelta(next_min - mDescriptor->current_min);
+            earlyBoostOn = adpfConfig.mEarlyBoostOn;
+            if (earlyBoostOn) {
+                updateWorkPeriod(actualDurations);
+                earlyBoostTime = getEarlyBoostTime(adpfConfig);
+            }
+        }
+        mStats.RecordUclampMin(next_min);
+        std::lock_guard<std::mutex> sessionGuard(mSessionLock);
+        mDescriptor->current_min = next_min;
+    }
+    // Applied outside mControllerLock, which is taken under the PowerSessionManager lock during a
+    // switch. A rescale in between may have re-clamped uclamp.min, so this applies the session's
+    // current value rather than next_min.
+    PowerSessionManager::getInstance()->applyUclampMin(this);
+    if (ATRACE_ENABLED()) {
+        const std::string idstr = getIdString();
+        std::string sz = StringPrintf("adpf.%s-min", idstr.c_str());
+        ATRACE_INT(sz.c_str(), next_min);
+    }
     mStaleTimerHandler->updateTimer(getStaleTime());
-    if (HintManager::GetInstance()->GetAdpfProfile()->mEarlyBoostOn) {
-        updateWorkPeriod(actualDurations);
-        mEarlyBoostHandler->updateTimer(getEarlyBoostTime());
+    if (!pidOn) {
+        return ndk::ScopedAStatus::ok();
+    }
+    if (earlyBoostOn) {
+        mEarlyBoostHandler->updateTimer(earlyBoostTime);
     }
 
     mAdaptiveCpu->ReportWorkDurations(actualDurations, mDescriptor->duration);
@@ -368,9 +390,9 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
 std::string AppHintDesc::toString() const {
     std::string out =
             StringPrintf("session %" PRIxPTR "\n", reinterpret_cast<uintptr_t>(this) & 0xffff);
-    const int64_t durationNanos = duration.count();
+    const int64_t durationNanos = duration.load().count();
     out.append(StringPrintf("  duration: %" PRId64 " ns\n", durationNanos));
-    out.append(StringPrintf("  uclamp.min: %d \n", current_min));
+    out.append(StringPrintf("  uclamp.min: %d \n", current_min.load()));
     out.append(StringPrintf("  uid: %d, tgid: %d\n", uid, tgid));
 
     out.append("  threadIds: [");
@@ -402,6 +424,8 @@ const std::vector<int> &PowerHintSession::getTidList() const {
 void PowerHintSession::setStale() {
     // Reset to default uclamp value.
     PowerSessionManager::getInstance()->setUclampMin(this, 0);
+    mStats.RecordStaleTransition();
+    mStats.RecordUclampMin(0);
     // Deliver a task to check if all sessions are inactive.
     updateUniveralBoostMode();
     if (ATRACE_ENABLED()) {
@@ -422,10 +446,12 @@ void PowerHintSession::wakeup() {
                                        isTimeout());
         ATRACE_NAME(tag.c_str());
     }
-    std::shared_ptr<AdpfConfig> adpfConfig = HintManager::GetInstance()->GetAdpfProfile();
-    int min = std::max(mDescriptor->current_min, static_cast<int>(adpfConfig->mUclampMinInit));
+    std::shared_ptr<AdpfConfig> adpfConfig = PowerSessionManager::getInstance()->getAdpfProfile();
+    int min = std::max(mDescriptor->current_min.load(),
+                       static_cast<int>(adpfConfig->mUclampMinInit));
     mDescriptor->current_min = min;
     PowerSessionManager::getInstance()->setUclampMinLocked(this, min);
+    mStats.RecordUclampMin(min);
     mStaleTimerHandler->updateTimer();
 
     if (ATRACE_ENABLED()) {
@@ -435,6 +461,43 @@ void PowerHintSession::wakeup() {
     }
 }
 
+void PowerHintSession::rescaleForRefreshRate(double periodScale,
+                                             const std::shared_ptr<AdpfConfig> &to) {
+    int min;
+    time_point<steady_clock> earlyBoostTime;
+    {
+        std::lock_guard<std::mutex> guard(mControllerLock);
+        mDescriptor->duration = nanoseconds(
+                static_cast<int64_t>(mDescriptor->duration.load().count() * periodScale));
+        mController->Rescale(periodScale, makeControllerParams(*mControllerProfile),
+                             makeControllerParams(*to));
+        mControllerProfile = to;
+        mWorkPeriodNs = static_cast<int64_t>(mWorkPeriodNs * periodScale);
+        mLastDurationNs = static_cast<int64_t>(mLastDurationNs * periodScale);
+        earlyBoostTime = getEarlyBoostTime(*to);
+        min = std::clamp(mDescriptor->current_min.load(), static_cast<int>(to->mUclampMinLow),
+                         static_cast<int>(to->mUclampMinHigh));
+        std::lock_guard<std::mutex> sessionGuard(mSessionLock);
+        mDescriptor->current_min = min;
+    }
+    if (ATRACE_ENABLED()) {
+        const std::string idstr = getIdString();
+        std::string sz = StringPrintf("adpf.%s-target", idstr.c_str());
+        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.load().count());
+    }
+    // Stale and paused sessions keep their reset uclamp.min and pick up the new range on their
+    // next report.
+    if (mSessionClosed || !isActive() || isTimeout()) {
+        return;
+    }
+    PowerSessionManager::getInstance()->setUclampMinLocked(this, min);
+    mStats.RecordUclampMin(min);
+    mStaleTimerHandler->updateTimer(getStaleTime());
+    if (to->mEarlyBoostOn) {
+        mEarlyBoostHandler->updateTimer(earlyBoostTime);
+    }
+}
+
 void PowerHintSession::updateWorkPeriod(const std::vector<WorkDuration> &actualDurations) {
     if (actualDurations.size() == 0)
         return;
@@ -445,7 +508,7 @@ void PowerHintSession::updateWorkPeriod(const std::vector<WorkDuration> &actualD
     const WorkDuration &current = actualDurations.back();
     int64_t curr_start = current.timeStampNanos - current.durationNanos;
     int64_t period = curr_start - mLastStartedTimeNs;
-    if (period > 0 && period < mDescriptor->duration.count() * 2) {
+    if (period > 0 && period < mDescriptor->duration.load().count() * 2) {
         // Accounting workload period with moving average for the last 10 workload.
         mWorkPeriodNs = 0.9 * mWorkPeriodNs + 0.1 * period;
         if (ATRACE_ENABLED()) {
@@ -458,10 +521,10 @@ void PowerHintSession::updateWorkPeriod(const std::vector<WorkDuration> &actualD
     mLastDurationNs = current.durationNanos;
 }
 
-time_point<steady_clock> PowerHintSession::getEarlyBoostTime() {
-    std::shared_ptr<AdpfConfig> adpfConfig = HintManager::GetInstance()->GetAdpfProfile();
+// Reads the work period estimate, so called with mControllerLock held.
+time_point<steady_clock> PowerHintSession::getEarlyBoostTime(const AdpfConfig &adpfConfig) {
     int64_t earlyBoostTimeoutNs =
-            (int64_t)mDescriptor->duration.count() * adpfConfig->mEarlyBoostTimeFactor;
+            (int64_t)mDescriptor->duration.load().count() * adpfConfig.mEarlyBoostTimeFactor;
     time_point<steady_clock> nextStartTime =
             mLastUpdatedTime.load() + nanoseconds(mWorkPeriodNs - mLastDurationNs);
     return nextStartTime + nanoseconds(earlyBoostTimeoutNs);
@@ -470,16 +533,16 @@ time_point<steady_clock> PowerHintSession::getEarlyBoostTime() {
 time_point<steady_clock> PowerHintSession::getStaleTime() {
     return mLastUpdatedTime.load() +
            nanoseconds(static_cast<int64_t>(
-                   mDescriptor->duration.count() *
-                   HintManager::GetInstance()->GetAdpfProfile()->mStaleTimeFactor));
+                   mDescriptor->duration.load().count() *
+                   PowerSessionManager::getInstance()->getAdpfProfile()->mStaleTimeFactor));
 }
 
 void PowerHintSession::StaleTimerHandler::updateTimer() {
     time_point<steady_clock> staleTime =
             std::chrono::steady_clock::now() +
             nanoseconds(static_cast<int64_t>(
-                    mSession->mDescriptor->duration.count() *
-                    HintManager::GetInstance()->GetAdpfProfile()->mStaleTimeFactor));
+                    mSession->mDescriptor->duration.load().count() *
+                    PowerSessionManager::getInstance()->getAdpfProfile()->mStaleTimeFactor));
     updateTimer(staleTime);
 }
 
@@ -569,8 +632,11 @@ void PowerHintSession::EarlyBoostHandler::handleMessage(const Message &) {
         PowerHintMonitor::getInstance()->getLooper()->sendMessageDelayed(
                 next, mSession->mEarlyBoostHandler, NULL);
     } else {
-        std::shared_ptr<AdpfConfig> adpfConfig = HintManager::GetInstance()->GetAdpfProfile();
+        std::shared_ptr<AdpfConfig> adpfConfig =
+                PowerSessionManager::getInstance()->getAdpfProfile();
         PowerSessionManager::getInstance()->setUclampMin(mSession, adpfConfig->mUclampMinHigh);
+        mSession->mStats.RecordEarlyBoost();
+        mSession->mStats.RecordUclampMin(adpfConfig->mUclampMinHigh);
         mIsMonitoring.store(false);
         if (ATRACE_ENABLED()) {
             const std::string idstr = mSession->getIdString();
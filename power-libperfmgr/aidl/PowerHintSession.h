@@ -18,12 +18,15 @@
 
 #include <aidl/android/hardware/power/BnPowerHintSession.h>
 #include <aidl/android/hardware/power/WorkDuration.h>
+#include <perfmgr/AdpfConfig.h>
 #include <utils/Looper.h>
 #include <utils/Thread.h>
 
 #include <mutex>
 #include <unordered_map>
 
+#include "BoostController.h"
+#include "SessionStats.h"
 #include "adaptivecpu/AdaptiveCpu.h"
 
 namespace aidl {
@@ -35,6 +38,7 @@ namespace pixel {
 
 using aidl::android::hardware::power::BnPowerHintSession;
 using aidl::android::hardware::power::WorkDuration;
+using ::android::perfmgr::AdpfConfig;
 using ::android::Message;
 using ::android::MessageHandler;
 using ::android::sp;
@@ -48,24 +52,21 @@ struct AppHintDesc {
         : tgid(tgid),
           uid(uid),
           threadIds(std::move(threadIds)),
-          duration(0LL),
+          duration(nanoseconds(0)),
           current_min(0),
           is_active(true),
-          update_count(0),
-          integral_error(0),
-          previous_error(0) {}
+          update_count(0) {}
     std::string toString() const;
     const int32_t tgid;
     const int32_t uid;
     const std::vector<int> threadIds;
-    nanoseconds duration;
-    int current_min;
+    // Read by other sessions and the PowerHintMonitor thread, hence atomic.
+    std::atomic<nanoseconds> duration;
+    std::atomic<int> current_min;
     // status
     std::atomic<bool> is_active;
     // pid
     uint64_t update_count;
-    int64_t integral_error;
-    int64_t previous_error;
 };
 
 class PowerHintSession : public BnPowerHintSession {
@@ -88,9 +89,15 @@ class PowerHintSession : public BnPowerHintSession {
     const std::vector<int> &getTidList() const;
     int getUclampMin();
     void dumpToStream(std::ostream &stream);
+    void dumpStatsToStream(std::ostream &stream);
+    void getStatsRecord(SessionStatsRecord *record);
+
+    // Moves the session to a new display refresh rate and its profile |to|, scaling its target and
+    // timers by |periodScale|. Called with the PowerSessionManager lock held.
+    void rescaleForRefreshRate(double periodScale, const std::shared_ptr<AdpfConfig> &to);
 
     void updateWorkPeriod(const std::vector<WorkDuration> &actualDurations);
-    time_point<steady_clock> getEarlyBoostTime();
+    time_point<steady_clock> getEarlyBoostTime(const AdpfConfig &adpfConfig);
     time_point<steady_clock> getStaleTime();
 
   private:
@@ -139,6 +146,15 @@ class PowerHintSession : public BnPowerHintSession {
     sp<EarlyBoostHandler> mEarlyBoostHandler;
     std::atomic<time_point<steady_clock>> mLastUpdatedTime;
     sp<MessageHandler> mPowerManagerHandler;
+    SessionStats mStats;
+    // Picks the next uclamp.min from the reported durations, see BoostControllerConfig.
+    std::unique_ptr<IBoostController> mController;
+    // Serializes controller updates and target changes with refresh-rate rescaling. Guards
+    // mControllerProfile and the work period estimate below.
+    std::mutex mControllerLock;
+    // The profile the controller state was built for. PowerSessionManager switches its own
+    // profile before rescaling each session, so reports use this one instead.
+    std::shared_ptr<AdpfConfig> mControllerProfile;
     std::mutex mSessionLock;
     std::atomic<bool> mSessionClosed = false;
     // These 3 variables are for earlyboost work period estimation.
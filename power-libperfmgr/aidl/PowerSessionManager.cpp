@@ -51,7 +51,7 @@ struct sched_attr {
 };
 
 static int sched_setattr(int pid, struct sched_attr *attr, unsigned int flags) {
-    if (!HintManager::GetInstance()->GetAdpfProfile()->mUclampMinOn) {
+    if (!PowerSessionManager::getInstance()->getAdpfProfile()->mUclampMinOn) {
         ALOGV("PowerSessionManager:%s: skip", __func__);
         return 0;
     }
@@ -78,17 +78,73 @@ static void set_uclamp_min(int tid, int min) {
 
 void PowerSessionManager::updateHintMode(const std::string &mode, bool enabled) {
     ALOGV("PowerSessionManager::updateHintMode: mode: %s, enabled: %d", mode.c_str(), enabled);
-    if (enabled && mode.compare(0, 8, "REFRESH_") == 0) {
-        if (mode.compare("REFRESH_120FPS") == 0) {
-            mDisplayRefreshRate = 120;
-        } else if (mode.compare("REFRESH_90FPS") == 0) {
-            mDisplayRefreshRate = 90;
-        } else if (mode.compare("REFRESH_60FPS") == 0) {
-            mDisplayRefreshRate = 60;
+    if (!enabled) {
+        return;
+    }
+    const std::optional<RefreshRateId> id = toRefreshRateId(mode);
+    if (id) {
+        switchRefreshRate(*id);
+    }
+}
+
+std::optional<RefreshRateId> PowerSessionManager::toRefreshRateId(const std::string &mode) {
+    static const std::unordered_map<std::string, RefreshRateId> kRefreshModes = {
+            {"REFRESH_60FPS", RefreshRateId::FPS_60},
+            {"REFRESH_90FPS", RefreshRateId::FPS_90},
+            {"REFRESH_120FPS", RefreshRateId::FPS_120},
+    };
+    const auto it = kRefreshModes.find(mode);
+    if (it == kRefreshModes.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::array<PowerSessionManager::RefreshProfile, kNumRefreshRates>
+PowerSessionManager::loadRefreshProfiles() {
+    std::array<RefreshProfile, kNumRefreshRates> profiles = {{
+            {"REFRESH_60FPS", 60, nullptr},
+            {"REFRESH_90FPS", 90, nullptr},
+            {"REFRESH_120FPS", 120, nullptr},
+    }};
+    std::shared_ptr<HintManager> hm = HintManager::GetInstance();
+    std::shared_ptr<AdpfConfig> initial = hm->GetAdpfProfile();
+    if (!initial) {
+        return profiles;
+    }
+    // HintManager only exposes the active profile, so select each one in turn to collect them.
+    for (RefreshProfile &profile : profiles) {
+        if (hm->SetAdpfProfile(profile.mode)) {
+            profile.config = hm->GetAdpfProfile();
         }
     }
-    if (HintManager::GetInstance()->GetAdpfProfile()) {
-        HintManager::GetInstance()->SetAdpfProfile(mode);
+    hm->SetAdpfProfile(initial->mName);
+    return profiles;
+}
+
+void PowerSessionManager::switchRefreshRate(RefreshRateId id) {
+    ATRACE_CALL();
+    std::lock_guard<std::mutex> guard(mLock);
+    if (id == mRefreshRateId) {
+        return;
+    }
+    const RefreshProfile &from = mRefreshProfiles[static_cast<size_t>(mRefreshRateId)];
+    const RefreshProfile &to = mRefreshProfiles[static_cast<size_t>(id)];
+    // Without a profile the sessions stay scaled for the current rate, so keep it as the one the
+    // next switch scales from.
+    if (!to.config) {
+        return;
+    }
+    mRefreshRateId = id;
+    mDisplayRefreshRate = to.rate;
+    std::atomic_store(&mAdpfProfile, to.config);
+    // Only kept in sync for its dump; the HAL reads the profile through getAdpfProfile().
+    HintManager::GetInstance()->SetAdpfProfile(to.mode);
+    // Sessions are rescaled while holding mLock, so none of them runs a frame against a mix of
+    // the old and new rate.
+    const double periodScale = static_cast<double>(from.rate) / to.rate;
+    for (PowerHintSession *s : mSessions) {
+        s->rescaleForRefreshRate(periodScale, to.config);
     }
 }
 
@@ -96,7 +152,8 @@ void PowerSessionManager::updateHintBoost(const std::string &boost, int32_t dura
     ATRACE_CALL();
     ALOGV("PowerSessionManager::updateHintBoost: boost: %s, durationMs: %d", boost.c_str(),
           durationMs);
-    if (boost.compare("DISPLAY_UPDATE_IMMINENT") == 0) {
+    if (boost.compare("DISPLAY_UPDATE_IMMINENT") == 0 &&
+        mWakeupCoalescer.AcceptEvent(0, BoostCoalescer::Clock::now())) {
         PowerHintMonitor::getInstance()->getLooper()->sendMessage(mWakeupHandler, NULL);
     }
 }
@@ -157,6 +214,11 @@ void PowerSessionManager::setUclampMin(PowerHintSession *session, int val) {
     setUclampMinLocked(session, val);
 }
 
+void PowerSessionManager::applyUclampMin(PowerHintSession *session) {
+    std::lock_guard<std::mutex> guard(mLock);
+    setUclampMinLocked(session, session->getUclampMin());
+}
+
 void PowerSessionManager::setUclampMinLocked(PowerHintSession *session, int val) {
     for (auto t : session->getTidList()) {
         // Get thex max uclamp.min across sessions which include the tid.
@@ -199,6 +261,9 @@ void PowerSessionManager::handleMessage(const Message &) {
     } else {
         enableSystemTopAppBoost();
     }
+    if (mAppSessionActivityListener) {
+        mAppSessionActivityListener(active.value());
+    }
 }
 
 void PowerSessionManager::WakeupHandler::handleMessage(const Message &) {
@@ -220,13 +285,38 @@ void PowerSessionManager::dumpToFd(int fd) {
             }
         }
         dump_buf << "]\n";
+        s->dumpStatsToStream(dump_buf);
     }
     dump_buf << "========== End PowerSessionManager ADPF list ==========\n";
+    mWakeupCoalescer.DumpToStream(dump_buf);
     if (!::android::base::WriteStringToFd(dump_buf.str(), fd)) {
         ALOGE("Failed to dump one of session list to fd:%d", fd);
     }
 }
 
+void PowerSessionManager::dumpBinaryToFd(int fd) {
+    std::vector<SessionStatsRecord> records;
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        records.resize(mSessions.size());
+        size_t i = 0;
+        for (PowerHintSession *s : mSessions) {
+            s->getStatsRecord(&records[i++]);
+        }
+    }
+    SessionStatsHeader header = {
+            .magic = kSessionStatsMagic,
+            .version = kSessionStatsVersion,
+            .numRecords = static_cast<uint16_t>(std::min<size_t>(records.size(), UINT16_MAX)),
+            .recordSize = sizeof(SessionStatsRecord),
+    };
+    if (!::android::base::WriteFully(fd, &header, sizeof(header)) ||
+        !::android::base::WriteFully(fd, records.data(),
+                                     header.numRecords * sizeof(SessionStatsRecord))) {
+        ALOGE("Failed to dump session stats records to fd:%d", fd);
+    }
+}
+
 void PowerSessionManager::enableSystemTopAppBoost() {
     if (HintManager::GetInstance()->IsHintSupported(kDisableBoostHintName)) {
         ALOGV("PowerSessionManager::enableSystemTopAppBoost!!");
@@ -20,10 +20,14 @@
 #include <perfmgr/HintManager.h>
 #include <utils/Looper.h>
 
+#include <array>
+#include <atomic>
+#include <functional>
 #include <mutex>
 #include <optional>
 #include <unordered_set>
 
+#include "BoostCoalescer.h"
 #include "PowerHintSession.h"
 
 namespace aidl {
@@ -37,23 +41,52 @@ using ::android::Looper;
 using ::android::Message;
 using ::android::MessageHandler;
 using ::android::Thread;
+using ::android::perfmgr::AdpfConfig;
 using ::android::perfmgr::HintManager;
 
 constexpr char kPowerHalAdpfDisableTopAppBoost[] = "vendor.powerhal.adpf.disable.hint";
 
+// Display refresh rates that have an AdpfConfig profile named after their REFRESH_* mode.
+enum class RefreshRateId : uint32_t {
+    FPS_60 = 0,
+    FPS_90,
+    FPS_120,
+};
+constexpr size_t kNumRefreshRates = 3;
+
 class PowerSessionManager : public MessageHandler {
   public:
     // current hint info
     void updateHintMode(const std::string &mode, bool enabled);
     void updateHintBoost(const std::string &boost, int32_t durationMs);
     int getDisplayRefreshRate();
+    // Uid of the app session that reported most recently, a stand-in for the foreground app
+    // since the HAL is not told which app that is. -1 before any app session reported.
+    int32_t getForegroundUid() const { return mForegroundUid; }
+    void setForegroundUid(int32_t uid) { mForegroundUid = uid; }
+    // Running count of reported work durations over their session's target, across sessions.
+    uint64_t getDeadlineMisses() const { return mDeadlineMisses; }
+    void addDeadlineMisses(uint64_t misses) { mDeadlineMisses += misses; }
+    // Called on the looper thread when the first app session becomes active or the last one goes
+    // idle. Must be set before sessions are created.
+    void setAppSessionActivityListener(std::function<void(bool)> listener) {
+        mAppSessionActivityListener = std::move(listener);
+    }
     // monitoring session status
     void addPowerSession(PowerHintSession *session);
     void removePowerSession(PowerHintSession *session);
     void setUclampMin(PowerHintSession *session, int min);
     void setUclampMinLocked(PowerHintSession *session, int min);
+    // Applies the session's current uclamp.min, read under the lock so that a refresh-rate switch
+    // in progress cannot be overwritten with a value computed before it.
+    void applyUclampMin(PowerHintSession *session);
     void handleMessage(const Message &message) override;
     void dumpToFd(int fd);
+    // Writes a SessionStatsHeader followed by one SessionStatsRecord per live session.
+    void dumpBinaryToFd(int fd);
+    // The active AdpfConfig. HintManager::GetAdpfProfile() is not safe against a concurrent
+    // refresh-rate switch, so binder threads read it from here.
+    std::shared_ptr<AdpfConfig> getAdpfProfile() const { return std::atomic_load(&mAdpfProfile); }
 
     // Singleton
     static sp<PowerSessionManager> getInstance() {
@@ -62,6 +95,13 @@ class PowerSessionManager : public MessageHandler {
     }
 
   private:
+    struct RefreshProfile {
+        const char *mode;
+        int rate;
+        // Null if powerhint.json has no profile for this rate.
+        std::shared_ptr<AdpfConfig> config;
+    };
+
     class WakeupHandler : public MessageHandler {
       public:
         WakeupHandler() {}
@@ -70,6 +110,9 @@ class PowerSessionManager : public MessageHandler {
 
   private:
     void wakeSessions();
+    static std::optional<RefreshRateId> toRefreshRateId(const std::string &mode);
+    static std::array<RefreshProfile, kNumRefreshRates> loadRefreshProfiles();
+    void switchRefreshRate(RefreshRateId id);
     std::optional<bool> isAnyAppSessionActive();
     void disableSystemTopAppBoost();
     void enableSystemTopAppBoost();
@@ -79,18 +122,35 @@ class PowerSessionManager : public MessageHandler {
     std::unordered_map<int, int> mTidRefCountMap;      // protected by mLock
     std::unordered_map<int, std::unordered_set<PowerHintSession *>> mTidSessionListMap;
     sp<WakeupHandler> mWakeupHandler;
+    // Drops DISPLAY_UPDATE_IMMINENT wakeups arriving faster than sessions can go stale again.
+    BoostCoalescer mWakeupCoalescer;
     bool mActive;  // protected by mLock
+    std::function<void(bool)> mAppSessionActivityListener;
     /**
      * mLock to pretect the above data objects opertions.
      **/
     std::mutex mLock;
-    int mDisplayRefreshRate;
+    std::atomic<int> mDisplayRefreshRate;
+    std::atomic<int32_t> mForegroundUid;
+    std::atomic<uint64_t> mDeadlineMisses;
+    // Resolved once at startup, indexed by RefreshRateId.
+    const std::array<RefreshProfile, kNumRefreshRates> mRefreshProfiles;
+    RefreshRateId mRefreshRateId;  // protected by mLock
+    // Accessed with std::atomic_load/std::atomic_store.
+    std::shared_ptr<AdpfConfig> mAdpfProfile;
     // Singleton
     PowerSessionManager()
         : kDisableBoostHintName(::android::base::GetProperty(kPowerHalAdpfDisableTopAppBoost,
                                                              "ADPF_DISABLE_TA_BOOST")),
+          mWakeupCoalescer(BoostCoalescerConfig::ReadFromSystemProperties(),
+                           {"DISPLAY_UPDATE_IMMINENT wakeup"}),
           mActive(false),
-          mDisplayRefreshRate(60) {
+          mDisplayRefreshRate(60),
+          mForegroundUid(-1),
+          mDeadlineMisses(0),
+          mRefreshProfiles(loadRefreshProfiles()),
+          mRefreshRateId(RefreshRateId::FPS_60),
+          mAdpfProfile(HintManager::GetInstance()->GetAdpfProfile()) {
         mWakeupHandler = sp<WakeupHandler>(new WakeupHandler());
     }
     PowerSessionManager(PowerSessionManager const &) = delete;
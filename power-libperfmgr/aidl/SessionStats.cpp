@@ -0,0 +1,144 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "SessionStats.h"
+
+#include <algorithm>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace {
+
+template <size_t N>
+size_t FindBucket(const std::array<int64_t, N> &bounds, int64_t value) {
+    return std::upper_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+}
+
+}  // namespace
+
+SessionStats::SessionStats() : mBandStartTime(steady_clock::now()) {}
+
+size_t SessionStats::UclampBand(int min) {
+    return std::min<size_t>(std::max(min, 0) / kUclampBandWidth, kNumUclampBands - 1);
+}
+
+void SessionStats::RecordWorkDuration(int64_t actualDurationNs, int64_t targetDurationNs) {
+    if (targetDurationNs <= 0) {
+        return;
+    }
+    const int64_t ratioPct = actualDurationNs * 100 / targetDurationNs;
+    std::lock_guard<std::mutex> guard(mLock);
+    mNumReports++;
+    mRatioHistogram[FindBucket(kRatioBucketBoundsPct, ratioPct)]++;
+}
+
+void SessionStats::RecordUclampDelta(int64_t delta) {
+    std::lock_guard<std::mutex> guard(mLock);
+    mUclampDeltaHistogram[FindBucket(kUclampDeltaBucketBounds, delta)]++;
+}
+
+void SessionStats::RecordUclampMin(int min) {
+    const size_t band = UclampBand(min);
+    const auto now = steady_clock::now();
+    std::lock_guard<std::mutex> guard(mLock);
+    mBandTimes[mCurrentBand] += now - mBandStartTime;
+    mBandStartTime = now;
+    mCurrentBand = band;
+}
+
+void SessionStats::RecordEarlyBoost() {
+    std::lock_guard<std::mutex> guard(mLock);
+    mNumEarlyBoosts++;
+}
+
+void SessionStats::RecordStaleTransition() {
+    std::lock_guard<std::mutex> guard(mLock);
+    mNumStaleTransitions++;
+}
+
+std::array<std::chrono::nanoseconds, kNumUclampBands> SessionStats::GetBandTimesLocked() const {
+    auto bandTimes = mBandTimes;
+    bandTimes[mCurrentBand] += steady_clock::now() - mBandStartTime;
+    return bandTimes;
+}
+
+void SessionStats::DumpToStream(std::ostream &stream) const {
+    std::lock_guard<std::mutex> guard(mLock);
+    stream << "  Reports: " << mNumReports << ", EarlyBoosts: " << mNumEarlyBoosts
+           << ", StaleTransitions: " << mNumStaleTransitions << "\n";
+
+    stream << "  Actual/Target(%):";
+    for (size_t i = 0; i < mRatioHistogram.size(); i++) {
+        stream << (i < kRatioBucketBoundsPct.size()
+                           ? " <" + std::to_string(kRatioBucketBoundsPct[i])
+                           : " >=" + std::to_string(kRatioBucketBoundsPct.back()))
+               << ":" << mRatioHistogram[i];
+    }
+    stream << "\n";
+
+    stream << "  UclampDelta:";
+    for (size_t i = 0; i < mUclampDeltaHistogram.size(); i++) {
+        stream << (i < kUclampDeltaBucketBounds.size()
+                           ? " <" + std::to_string(kUclampDeltaBucketBounds[i])
+                           : " >=" + std::to_string(kUclampDeltaBucketBounds.back()))
+               << ":" << mUclampDeltaHistogram[i];
+    }
+    stream << "\n";
+
+    stream << "  UclampMinBand(ms):";
+    const auto bandTimes = GetBandTimesLocked();
+    for (size_t i = 0; i < bandTimes.size(); i++) {
+        stream << " " << i * kUclampBandWidth << "-" << (i + 1) * kUclampBandWidth - 1 << ":"
+               << duration_cast<milliseconds>(bandTimes[i]).count();
+    }
+    stream << "\n";
+}
+
+void SessionStats::ToRecord(SessionStatsRecord *record) const {
+    std::lock_guard<std::mutex> guard(mLock);
+    record->numReports = mNumReports;
+    // Element-wise copies, the record is packed and its arrays may be unaligned.
+    for (size_t i = 0; i < mRatioHistogram.size(); i++) {
+        record->ratioHistogram[i] = mRatioHistogram[i];
+    }
+    for (size_t i = 0; i < mUclampDeltaHistogram.size(); i++) {
+        record->uclampDeltaHistogram[i] = mUclampDeltaHistogram[i];
+    }
+    const auto bandTimes = GetBandTimesLocked();
+    for (size_t i = 0; i < bandTimes.size(); i++) {
+        record->uclampBandTimeMs[i] = duration_cast<milliseconds>(bandTimes[i]).count();
+    }
+    record->numEarlyBoosts = mNumEarlyBoosts;
+    record->numStaleTransitions = mNumStaleTransitions;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Upper bounds (exclusive) of the actual/target ratio buckets, in percent. The last bucket holds
+// everything at or above 200% of the target.
+constexpr std::array<int64_t, 8> kRatioBucketBoundsPct = {50, 75, 90, 100, 110, 125, 150, 200};
+// Upper bounds (exclusive) of the buckets for the change in uclamp.min applied per report, after
+// clamping to the profile's range. The <1 bucket only holds 0, the common case at either limit.
+constexpr std::array<int64_t, 8> kUclampDeltaBucketBounds = {-128, -32, -8, 0, 1, 8, 32, 128};
+// uclamp.min is split into equally sized bands of this width.
+constexpr int kUclampBandWidth = 128;
+constexpr size_t kNumUclampBands = 1024 / kUclampBandWidth;
+
+// Fixed layout written by PowerSessionManager::dumpBinaryToFd(). Bump kSessionStatsVersion
+// whenever this changes.
+constexpr uint32_t kSessionStatsMagic = 0x46504441;  // "ADPF"
+constexpr uint16_t kSessionStatsVersion = 2;
+
+struct __attribute__((packed)) SessionStatsHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t numRecords;
+    uint32_t recordSize;
+};
+
+struct __attribute__((packed)) SessionStatsRecord {
+    int32_t tgid;
+    int32_t uid;
+    int64_t targetDurationNs;
+    uint64_t numReports;
+    uint32_t ratioHistogram[kRatioBucketBoundsPct.size() + 1];
+    uint32_t uclampDeltaHistogram[kUclampDeltaBucketBounds.size() + 1];
+    uint64_t uclampBandTimeMs[kNumUclampBands];
+    uint32_t numEarlyBoosts;
+    uint32_t numStaleTransitions;
+};
+
+// Per-session telemetry for ADPF. All storage is fixed-size, so recording never allocates.
+// Methods may be called from binder threads and from the PowerHintMonitor looper concurrently.
+class SessionStats {
+  public:
+    SessionStats();
+
+    // Records a single reported work duration against the target it was reported for.
+    void RecordWorkDuration(int64_t actualDurationNs, int64_t targetDurationNs);
+    void RecordUclampDelta(int64_t delta);
+    // Records that the effective uclamp.min of the session changed. Time spent in the previous
+    // band is accounted up to now.
+    void RecordUclampMin(int min);
+    void RecordEarlyBoost();
+    void RecordStaleTransition();
+
+    void DumpToStream(std::ostream &stream) const;
+    void ToRecord(SessionStatsRecord *record) const;
+
+  private:
+    static size_t UclampBand(int min);
+    // Returns the per-band residency including the time spent in the current band so far.
+    std::array<std::chrono::nanoseconds, kNumUclampBands> GetBandTimesLocked() const;
+
+    mutable std::mutex mLock;
+    uint64_t mNumReports = 0;
+    std::array<uint32_t, kRatioBucketBoundsPct.size() + 1> mRatioHistogram{};
+    std::array<uint32_t, kUclampDeltaBucketBounds.size() + 1> mUclampDeltaHistogram{};
+    std::array<std::chrono::nanoseconds, kNumUclampBands> mBandTimes{};
+    size_t mCurrentBand = 0;
+    std::chrono::steady_clock::time_point mBandStartTime;
+    uint32_t mNumEarlyBoosts = 0;
+    uint32_t mNumStaleTransitions = 0;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
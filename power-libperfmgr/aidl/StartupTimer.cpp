@@ -0,0 +1,61 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "StartupTimer.h"
+
+#include <android-base/logging.h>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+StartupTimer &StartupTimer::GetInstance() {
+    static StartupTimer instance;
+    return instance;
+}
+
+void StartupTimer::Record(const std::string &name, Clock::time_point start, Clock::time_point end) {
+    Entry entry = {
+            .name = name,
+            .start = std::chrono::duration_cast<std::chrono::microseconds>(start - mOrigin),
+            .duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start),
+    };
+    LOG(INFO) << "Startup phase " << name << " took " << entry.duration.count() << "us (at +"
+              << entry.start.count() << "us)";
+    std::lock_guard<std::mutex> lock(mLock);
+    mEntries.push_back(std::move(entry));
+}
+
+void StartupTimer::DumpToStream(std::ostream &stream) {
+    std::lock_guard<std::mutex> lock(mLock);
+    stream << "Startup phases:\n";
+    for (const Entry &entry : mEntries) {
+        stream << "  " << entry.name << ": " << entry.duration.count() << "us at +"
+               << entry.start.count() << "us\n";
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
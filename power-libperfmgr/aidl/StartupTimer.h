@@ -0,0 +1,78 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Records how long each phase of the service startup took, so boot time regressions can be traced
+// to a phase. Phases are logged as they end and kept for the dump. Thread-safe, phases on the init
+// thread overlap those on the main thread.
+class StartupTimer {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // Times the enclosing scope as the phase |name|.
+    class Phase {
+      public:
+        explicit Phase(std::string name) : mName(std::move(name)), mStart(Clock::now()) {}
+        ~Phase() { StartupTimer::GetInstance().Record(mName, mStart, Clock::now()); }
+        Phase(const Phase &) = delete;
+        Phase &operator=(const Phase &) = delete;
+
+      private:
+        const std::string mName;
+        const Clock::time_point mStart;
+    };
+
+    // The first call sets the origin phases are timed from, so make it first thing in main().
+    static StartupTimer &GetInstance();
+
+    void Record(const std::string &name, Clock::time_point start, Clock::time_point end);
+    void DumpToStream(std::ostream &stream);
+
+  private:
+    struct Entry {
+        std::string name;
+        // Since the timer was created, by the first statement of main().
+        std::chrono::microseconds start;
+        std::chrono::microseconds duration;
+    };
+
+    StartupTimer() : mOrigin(Clock::now()) {}
+
+    const Clock::time_point mOrigin;
+    std::mutex mLock;
+    std::vector<Entry> mEntries;  // protected by mLock
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
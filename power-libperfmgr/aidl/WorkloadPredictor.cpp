@@ -0,0 +1,191 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "WorkloadPredictor.h"
+
+#include <android-base/logging.h>
+#include <android-base/parsedouble.h>
+#include <android-base/properties.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string_view>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+constexpr std::string_view kEnabledProperty("vendor.powerhal.adpf.ff.enabled");
+constexpr std::string_view kSeasonPeriodProperty("vendor.powerhal.adpf.ff.period");
+constexpr std::string_view kGainProperty("vendor.powerhal.adpf.ff.gain");
+constexpr std::string_view kMaxOutputProperty("vendor.powerhal.adpf.ff.max_output");
+
+// Smoothing factor for the per-model error averages.
+constexpr double kErrorAlpha = 0.1;
+// Reported durations far outside the target are clipped so a single hitch doesn't dominate the fit.
+constexpr double kMaxNormalizedDuration = 4.0;
+// Frames of history needed before the AR(2) model is trusted.
+constexpr size_t kMinArHistory = 8;
+// Predicted deviations from the average smaller than this are treated as noise.
+constexpr double kDeadband = 0.05;
+
+const WorkloadPredictorConfig WorkloadPredictorConfig::DEFAULT{
+        .enabled = false,
+        .seasonPeriod = 0,
+        .gain = 512.0,
+        .maxOutput = 256,
+};
+
+WorkloadPredictorConfig WorkloadPredictorConfig::ReadFromSystemProperties() {
+    WorkloadPredictorConfig config = DEFAULT;
+    config.enabled = ::android::base::GetBoolProperty(kEnabledProperty.data(), DEFAULT.enabled);
+    config.seasonPeriod = ::android::base::GetUintProperty<uint32_t>(
+            kSeasonPeriodProperty.data(), DEFAULT.seasonPeriod, kPredictorHistorySize - 1);
+    if (!::android::base::ParseDouble(
+                ::android::base::GetProperty(kGainProperty.data(), "").c_str(), &config.gain,
+                0.0)) {
+        config.gain = DEFAULT.gain;
+    }
+    config.maxOutput = ::android::base::GetIntProperty<int64_t>(kMaxOutputProperty.data(),
+                                                                DEFAULT.maxOutput, 0, 1024);
+    return config;
+}
+
+bool WorkloadPredictorConfig::operator==(const WorkloadPredictorConfig &other) const {
+    return enabled == other.enabled && seasonPeriod == other.seasonPeriod && gain == other.gain &&
+           maxOutput == other.maxOutput;
+}
+
+std::ostream &operator<<(std::ostream &stream, const WorkloadPredictorConfig &config) {
+    stream << "WorkloadPredictorConfig(";
+    stream << "enabled=" << config.enabled << ", ";
+    stream << "seasonPeriod=" << config.seasonPeriod << ", ";
+    stream << "gain=" << config.gain << ", ";
+    stream << "maxOutput=" << config.maxOutput;
+    stream << ")";
+    return stream;
+}
+
+int64_t WorkloadPredictor::Update(const std::vector<WorkDuration> &actualDurations,
+                                  std::chrono::nanoseconds targetDuration) {
+    if (targetDuration.count() <= 0) {
+        return 0;
+    }
+    // The reported frames already ran with the previous offset applied. Add back the change it was
+    // sized to cause, so the history describes the load rather than the load after our own boost.
+    const double compensation = mConfig.gain > 0 ? mOutput / mConfig.gain : 0;
+    for (const auto &d : actualDurations) {
+        const double normalized = std::clamp(
+                static_cast<double>(d.durationNanos) / targetDuration.count() + compensation, 0.0,
+                kMaxNormalizedDuration);
+        // Score both models on the frame they were predicting before it enters the history.
+        if (mCount >= kMinArHistory) {
+            mArError += kErrorAlpha * (std::abs(PredictAr() - normalized) - mArError);
+        }
+        if (mConfig.seasonPeriod > 0 && mCount >= mConfig.seasonPeriod) {
+            mSeasonalError +=
+                    kErrorAlpha * (std::abs(PredictSeasonal() - normalized) - mSeasonalError);
+        }
+        Push(normalized);
+    }
+    if (mCount == 0) {
+        return 0;
+    }
+    // The feed-forward level tracks how far the next frame is expected to be from the recent
+    // average.
+    const double deviation = Predict() - Mean();
+    if (std::abs(deviation) < kDeadband) {
+        mOutput = 0;
+        return mOutput;
+    }
+    const int64_t output = static_cast<int64_t>(mConfig.gain * deviation);
+    mOutput = std::clamp(output, -mConfig.maxOutput, mConfig.maxOutput);
+    return mOutput;
+}
+
+double WorkloadPredictor::Predict() const {
+    const bool haveAr = mCount >= kMinArHistory;
+    // Needs a full period scored before the seasonal error is meaningful.
+    const bool haveSeasonal = mConfig.seasonPeriod > 0 && mCount >= 2 * mConfig.seasonPeriod;
+    if (haveSeasonal && (!haveAr || mSeasonalError < mArError)) {
+        return PredictSeasonal();
+    }
+    if (haveAr) {
+        return PredictAr();
+    }
+    return mCount > 0 ? At(0) : 1.0;
+}
+
+void WorkloadPredictor::Push(double normalizedDuration) {
+    mHistory[mNext] = normalizedDuration;
+    mNext = (mNext + 1) % kPredictorHistorySize;
+    mCount = std::min(mCount + 1, kPredictorHistorySize);
+}
+
+double WorkloadPredictor::At(size_t age) const {
+    return mHistory[(mNext + kPredictorHistorySize - 1 - age) % kPredictorHistorySize];
+}
+
+double WorkloadPredictor::Mean() const {
+    double mean = 0;
+    for (size_t i = 0; i < mCount; i++) {
+        mean += At(i);
+    }
+    return mCount > 0 ? mean / mCount : 1.0;
+}
+
+double WorkloadPredictor::PredictAr() const {
+    const double mean = Mean();
+
+    // Autocovariances at lag 0, 1 and 2.
+    double r0 = 0, r1 = 0, r2 = 0;
+    for (size_t i = 0; i < mCount; i++) {
+        const double x = At(i) - mean;
+        r0 += x * x;
+        if (i + 1 < mCount) {
+            r1 += x * (At(i + 1) - mean);
+        }
+        if (i + 2 < mCount) {
+            r2 += x * (At(i + 2) - mean);
+        }
+    }
+    const double denom = r0 * r0 - r1 * r1;
+    if (r0 <= 0 || std::abs(denom) < 1e-12) {
+        return mean;
+    }
+    // Yule-Walker solution for the AR(2) coefficients.
+    const double a1 = r1 * (r0 - r2) / denom;
+    const double a2 = (r0 * r2 - r1 * r1) / denom;
+    const double prediction = mean + a1 * (At(0) - mean) + a2 * (At(1) - mean);
+    return std::clamp(prediction, 0.0, kMaxNormalizedDuration);
+}
+
+double WorkloadPredictor::PredictSeasonal() const {
+    // The next frame repeats the one seasonPeriod frames before it.
+    return At(mConfig.seasonPeriod - 1);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/power/WorkDuration.h>
+
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::aidl::android::hardware::power::WorkDuration;
+
+// Number of normalized durations kept per session, which also bounds the seasonal period.
+constexpr size_t kPredictorHistorySize = 64;
+
+struct WorkloadPredictorConfig {
+    static WorkloadPredictorConfig ReadFromSystemProperties();
+    static const WorkloadPredictorConfig DEFAULT;
+
+    // Makes the feed-forward controller the default for sessions when no controller is
+    // configured, see BoostControllerConfig.
+    bool enabled;
+    // Length in frames of a repeating load pattern, 0 to only use the AR(2) model. Must be below
+    // kPredictorHistorySize.
+    uint32_t seasonPeriod;
+    // uclamp units added per unit of predicted change in actual/target.
+    double gain;
+    // Bound on the absolute feed-forward output, in uclamp units.
+    int64_t maxOutput;
+
+    bool operator==(const WorkloadPredictorConfig &other) const;
+};
+
+std::ostream &operator<<(std::ostream &os, const WorkloadPredictorConfig &config);
+
+// Short-horizon predictor over the session's normalized work durations (actual / target).
+// Two models run side by side: an AR(2) model fitted with Yule-Walker over the history window, and
+// a seasonal naive model that repeats the value seen one period ago. The model with the lower
+// recent error is used for the prediction. The feed-forward term is proportional to how far the
+// prediction is above or below the recent average, so it boosts ahead of a spike the PID has not
+// seen yet and backs off again before the following lull.
+// Not thread-safe; PowerHintSession calls it from reportActualWorkDuration only.
+class WorkloadPredictor {
+  public:
+    explicit WorkloadPredictor(WorkloadPredictorConfig config) : mConfig(config) {}
+
+    const WorkloadPredictorConfig &GetConfig() const { return mConfig; }
+
+    // Feeds the batch into the history and returns the feed-forward offset, in uclamp units. The
+    // offset is applied on top of the PID-controlled uclamp.min and replaces the previous offset
+    // rather than accumulating into the PID state.
+    int64_t Update(const std::vector<WorkDuration> &actualDurations,
+                   std::chrono::nanoseconds targetDuration);
+
+    // Predicted actual/target of the next frame. 1.0 when there is not enough history.
+    double Predict() const;
+
+  private:
+    void Push(double normalizedDuration);
+    double At(size_t age) const;
+    double Mean() const;
+    double PredictAr() const;
+    double PredictSeasonal() const;
+
+    const WorkloadPredictorConfig mConfig;
+    std::array<double, kPredictorHistorySize> mHistory{};
+    size_t mNext = 0;
+    size_t mCount = 0;
+    // Exponentially weighted absolute errors of each model, used to pick between them.
+    double mArError = 0;
+    double mSeasonalError = 0;
+    // Offset returned by the last Update().
+    int64_t mOutput = 0;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
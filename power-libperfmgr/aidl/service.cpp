@@ -28,6 +28,7 @@
 #include "Power.h"
 #include "PowerExt.h"
 #include "PowerSessionManager.h"
+#include "StartupTimer.h"
 #include "adaptivecpu/AdaptiveCpu.h"
 #include "disp-power/DisplayLowPower.h"
 
@@ -37,53 +38,87 @@ using aidl::google::hardware::power::impl::pixel::Power;
 using aidl::google::hardware::power::impl::pixel::PowerExt;
 using aidl::google::hardware::power::impl::pixel::PowerHintMonitor;
 using aidl::google::hardware::power::impl::pixel::PowerSessionManager;
+using aidl::google::hardware::power::impl::pixel::StartupTimer;
 using ::android::perfmgr::HintManager;
 
 constexpr std::string_view kPowerHalInitProp("vendor.powerhal.init");
+constexpr std::string_view kPowerHalBinderThreadsProp("vendor.powerhal.binder.threads");
+// Enough that a burst of session reports doesn't hold up an INTERACTION boost.
+constexpr uint32_t kDefaultBinderThreads = 3;
 
 int main() {
-    // Parse config but do not start the looper
-    std::shared_ptr<HintManager> hm = HintManager::GetInstance();
-    if (!hm) {
-        LOG(FATAL) << "HintManager Init failed";
+    // Sets the origin of the startup phases.
+    StartupTimer::GetInstance();
+
+    std::shared_ptr<DisplayLowPower> dlpw;
+    std::shared_ptr<AdaptiveCpu> adaptiveCpu;
+    std::shared_ptr<Power> pw;
+    std::shared_ptr<PowerExt> pwExt;
+    // Pool threads on top of the main thread joining below; 0 serializes every call as before.
+    const uint32_t binderThreads = ::android::base::GetUintProperty<uint32_t>(
+            kPowerHalBinderThreadsProp.data(), kDefaultBinderThreads);
+    {
+        StartupTimer::Phase phase("create_services");
+        dlpw = std::make_shared<DisplayLowPower>();
+        ABinderProcess_setThreadPoolMaxThreadCount(binderThreads);
+        adaptiveCpu = std::make_shared<AdaptiveCpu>();
+
+        // core service
+        pw = ndk::SharedRefBase::make<Power>(dlpw, adaptiveCpu);
+        ndk::SpAIBinder pwBinder = pw->asBinder();
+        AIBinder_setMinSchedulerPolicy(pwBinder.get(), SCHED_NORMAL, -20);
+
+        // extension service
+        pwExt = ndk::SharedRefBase::make<PowerExt>(dlpw, adaptiveCpu);
+        auto pwExtBinder = pwExt->asBinder();
+        AIBinder_setMinSchedulerPolicy(pwExtBinder.get(), SCHED_NORMAL, -20);
+
+        // attach the extension to the same binder we will be registering
+        CHECK(STATUS_OK == AIBinder_setExtension(pwBinder.get(), pwExt->asBinder().get()));
     }
 
-    std::shared_ptr<DisplayLowPower> dlpw = std::make_shared<DisplayLowPower>();
-
-    // single thread
-    ABinderProcess_setThreadPoolMaxThreadCount(0);
-
-    std::shared_ptr<AdaptiveCpu> adaptiveCpu = std::make_shared<AdaptiveCpu>();
-
-    // core service
-    std::shared_ptr<Power> pw = ndk::SharedRefBase::make<Power>(dlpw, adaptiveCpu);
-    ndk::SpAIBinder pwBinder = pw->asBinder();
-    AIBinder_setMinSchedulerPolicy(pwBinder.get(), SCHED_NORMAL, -20);
-
-    // extension service
-    std::shared_ptr<PowerExt> pwExt = ndk::SharedRefBase::make<PowerExt>(dlpw, adaptiveCpu);
-    auto pwExtBinder = pwExt->asBinder();
-    AIBinder_setMinSchedulerPolicy(pwExtBinder.get(), SCHED_NORMAL, -20);
-
-    // attach the extension to the same binder we will be registering
-    CHECK(STATUS_OK == AIBinder_setExtension(pwBinder.get(), pwExt->asBinder().get()));
-
-    const std::string instance = std::string() + Power::descriptor + "/default";
-    binder_status_t status = AServiceManager_addService(pw->asBinder().get(), instance.c_str());
-    CHECK(status == STATUS_OK);
+    {
+        // Clients waiting for the service are released here. Their calls queue in the driver
+        // until the thread pool below starts reading them, so the rest of the setup can follow.
+        StartupTimer::Phase phase("register");
+        const std::string instance = std::string() + Power::descriptor + "/default";
+        binder_status_t status = AServiceManager_addService(pw->asBinder().get(), instance.c_str());
+        CHECK(status == STATUS_OK);
+    }
     LOG(INFO) << "Pixel Power HAL AIDL Service with Extension is started.";
 
-    if (HintManager::GetInstance()->GetAdpfProfile()) {
+    std::shared_ptr<HintManager> hm;
+    {
+        // Parse config but do not start the looper
+        StartupTimer::Phase phase("parse_config");
+        hm = HintManager::GetInstance();
+    }
+    if (!hm) {
+        LOG(FATAL) << "HintManager Init failed";
+    }
+
+    {
+        StartupTimer::Phase phase("finish_startup");
+        // Hosts the ADPF session timers, the INTERACTION idle wait and the pps daemon connection.
         PowerHintMonitor::getInstance()->start();
+        pw->finishStartup();
+        // Doesn't wait for init; the client keeps retrying until the daemon is up.
+        dlpw->Init(PowerHintMonitor::getInstance()->getLooper());
     }
 
     std::thread initThread([&]() {
-        ::android::base::WaitForProperty(kPowerHalInitProp.data(), "1");
+        {
+            StartupTimer::Phase phase("wait_init_prop");
+            ::android::base::WaitForProperty(kPowerHalInitProp.data(), "1");
+        }
+        StartupTimer::Phase phase("start_hint_manager");
         HintManager::GetInstance()->Start();
-        dlpw->Init();
     });
     initThread.detach();
 
+    if (binderThreads > 0) {
+        ABinderProcess_startThreadPool();
+    }
     ABinderProcess_joinThreadPool();
 
     // should not reach
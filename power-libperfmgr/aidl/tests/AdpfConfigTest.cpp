@@ -0,0 +1,130 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <perfmgr/AdpfConfig.h>
+#include <perfmgr/HintManager.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "aidl/PowerHintSession.h"
+#include "aidl/PowerSessionManager.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::perfmgr::AdpfConfig;
+using ::android::perfmgr::HintManager;
+
+namespace {
+
+constexpr char kPowerHintConfigPath[] = "/vendor/etc/powerhint.json";
+// PowerSessionManager::updateHintMode switches to these as the display refresh rate changes, the
+// default profile comes first.
+constexpr const char *kRefreshProfiles[] = {"REFRESH_60FPS", "REFRESH_90FPS", "REFRESH_120FPS"};
+constexpr int64_t kRefreshPeriodsNs[] = {16666666, 11111111, 8333333};
+
+std::unique_ptr<HintManager> LoadConfig() {
+    return std::unique_ptr<HintManager>(HintManager::GetFromJSON(kPowerHintConfigPath, false));
+}
+
+}  // namespace
+
+TEST(AdpfConfigTest, refreshProfilesArePresent) {
+    auto hm = LoadConfig();
+    ASSERT_NE(nullptr, hm);
+    ASSERT_NE(nullptr, hm->GetAdpfProfile());
+    EXPECT_EQ(kRefreshProfiles[0], hm->GetAdpfProfile()->mName);
+    for (const char *profile : kRefreshProfiles) {
+        EXPECT_TRUE(hm->SetAdpfProfile(profile)) << profile;
+        EXPECT_EQ(profile, hm->GetAdpfProfile()->mName);
+    }
+}
+
+TEST(AdpfConfigTest, refreshProfilesAreSane) {
+    auto hm = LoadConfig();
+    ASSERT_NE(nullptr, hm);
+    uint32_t previousHigh = 0;
+    for (size_t i = 0; i < std::size(kRefreshProfiles); i++) {
+        ASSERT_TRUE(hm->SetAdpfProfile(kRefreshProfiles[i]));
+        std::shared_ptr<AdpfConfig> config = hm->GetAdpfProfile();
+        SCOPED_TRACE(config->mName);
+        // Power::createHintSession refuses sessions without a reporting rate.
+        EXPECT_GT(config->mReportingRateLimitNs, 0);
+        // The rate limit is a multiple of frames; anything shorter than a frame drops reports.
+        EXPECT_GE(config->mReportingRateLimitNs, kRefreshPeriodsNs[i]);
+        EXPECT_TRUE(config->mPidOn);
+        EXPECT_LE(config->mUclampMinLow, config->mUclampMinInit);
+        EXPECT_LE(config->mUclampMinInit, config->mUclampMinHigh);
+        EXPECT_LE(config->mUclampMinHigh, 1024u);
+        EXPECT_GE(config->getPidIHighDivI(), 0);
+        EXPECT_LE(config->getPidILowDivI(), 0);
+        // Faster refresh rates never get less headroom than slower ones.
+        EXPECT_GE(config->mUclampMinHigh, previousHigh);
+        previousHigh = config->mUclampMinHigh;
+    }
+}
+
+// Drives a session for this thread through the live HintManager, like Power::createHintSession.
+TEST(AdpfConfigTest, sessionLifecycleWithDeviceConfig) {
+    std::shared_ptr<HintManager> hm = HintManager::GetInstance();
+    ASSERT_NE(nullptr, hm);
+    ASSERT_NE(nullptr, hm->GetAdpfProfile());
+    ASSERT_GT(hm->GetAdpfProfile()->mReportingRateLimitNs, 0);
+    PowerHintMonitor::getInstance()->start();
+
+    const int32_t tid = static_cast<int32_t>(syscall(__NR_gettid));
+    std::shared_ptr<PowerHintSession> session = ndk::SharedRefBase::make<PowerHintSession>(
+            std::make_shared<AdaptiveCpu>(), getpid(), getuid(), std::vector<int32_t>{tid},
+            kRefreshPeriodsNs[0]);
+    EXPECT_EQ(static_cast<int>(hm->GetAdpfProfile()->mUclampMinInit), session->getUclampMin());
+
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now().time_since_epoch())
+                                .count();
+    // Overrunning frames raise the boost, within the profile's range.
+    const std::vector<WorkDuration> overrun = {{.timeStampNanos = now,
+                                                .durationNanos = kRefreshPeriodsNs[0] * 2}};
+    EXPECT_TRUE(session->reportActualWorkDuration(overrun).isOk());
+    EXPECT_GT(session->getUclampMin(), static_cast<int>(hm->GetAdpfProfile()->mUclampMinInit));
+    EXPECT_LE(session->getUclampMin(), static_cast<int>(hm->GetAdpfProfile()->mUclampMinHigh));
+
+    // A refresh switch moves the live session into the 120 Hz profile's range.
+    PowerSessionManager::getInstance()->updateHintMode("REFRESH_120FPS", true);
+    EXPECT_EQ(kRefreshProfiles[2], hm->GetAdpfProfile()->mName);
+    EXPECT_EQ(120, PowerSessionManager::getInstance()->getDisplayRefreshRate());
+    EXPECT_LE(session->getUclampMin(), static_cast<int>(hm->GetAdpfProfile()->mUclampMinHigh));
+    EXPECT_GE(session->getUclampMin(), static_cast<int>(hm->GetAdpfProfile()->mUclampMinLow));
+    PowerSessionManager::getInstance()->updateHintMode("REFRESH_60FPS", true);
+    EXPECT_EQ(kRefreshProfiles[0], hm->GetAdpfProfile()->mName);
+
+    EXPECT_TRUE(session->pause().isOk());
+    EXPECT_FALSE(session->reportActualWorkDuration(overrun).isOk());
+    EXPECT_TRUE(session->resume().isOk());
+    EXPECT_TRUE(session->close().isOk());
+    EXPECT_EQ(0, session->getUclampMin());
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "aidl/BoostCoalescer.h"
+
+using std::chrono_literals::operator""ms;
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+const BoostCoalescer::Clock::time_point kStart = BoostCoalescer::Clock::time_point() + 1000ms;
+
+BoostCoalescer MakeCoalescer(std::chrono::milliseconds window) {
+    return BoostCoalescer({.window = window}, {"A", "B"});
+}
+
+}  // namespace
+
+TEST(BoostCoalescerTest, overlappingTimedBoostsAreMerged) {
+    BoostCoalescer coalescer = MakeCoalescer(10ms);
+    EXPECT_TRUE(coalescer.AcceptBoost(0, 100, kStart));
+    // Moves the deadline by 4ms and 10ms, within the window.
+    EXPECT_FALSE(coalescer.AcceptBoost(0, 100, kStart + 4ms));
+    EXPECT_FALSE(coalescer.AcceptBoost(0, 100, kStart + 10ms));
+    // 11ms past the forwarded deadline.
+    EXPECT_TRUE(coalescer.AcceptBoost(0, 100, kStart + 11ms));
+    // Shorter boosts that are already covered.
+    EXPECT_FALSE(coalescer.AcceptBoost(0, 20, kStart + 50ms));
+}
+
+TEST(BoostCoalescerTest, expiredBoostIsForwarded) {
+    BoostCoalescer coalescer = MakeCoalescer(10ms);
+    EXPECT_TRUE(coalescer.AcceptBoost(0, 5, kStart));
+    EXPECT_TRUE(coalescer.AcceptBoost(0, 5, kStart + 6ms));
+}
+
+TEST(BoostCoalescerTest, slotsAreIndependent) {
+    BoostCoalescer coalescer = MakeCoalescer(10ms);
+    EXPECT_TRUE(coalescer.AcceptBoost(0, 100, kStart));
+    EXPECT_TRUE(coalescer.AcceptBoost(1, 100, kStart));
+    // Unknown slots are never filtered.
+    EXPECT_TRUE(coalescer.AcceptBoost(2, 100, kStart));
+    EXPECT_TRUE(coalescer.AcceptBoost(2, 100, kStart));
+}
+
+TEST(BoostCoalescerTest, untimedBoosts) {
+    BoostCoalescer coalescer = MakeCoalescer(10ms);
+    EXPECT_TRUE(coalescer.AcceptBoost(0, 0, kStart));
+    EXPECT_FALSE(coalescer.AcceptBoost(0, 0, kStart + 1ms));
+    // A timed boost turns the untimed one into a timed one in HintManager.
+    EXPECT_TRUE(coalescer.AcceptBoost(0, 100, kStart + 2ms));
+    EXPECT_TRUE(coalescer.AcceptBoost(0, -1, kStart + 3ms));
+    EXPECT_TRUE(coalescer.AcceptBoost(0, -1, kStart + 4ms));
+    EXPECT_TRUE(coalescer.AcceptBoost(0, 0, kStart + 5ms));
+}
+
+TEST(BoostCoalescerTest, eventsAreRateLimited) {
+    BoostCoalescer coalescer = MakeCoalescer(10ms);
+    EXPECT_TRUE(coalescer.AcceptEvent(0, kStart));
+    EXPECT_FALSE(coalescer.AcceptEvent(0, kStart + 9ms));
+    EXPECT_TRUE(coalescer.AcceptEvent(0, kStart + 10ms));
+}
+
+TEST(BoostCoalescerTest, zeroWindowForwardsEverything) {
+    BoostCoalescer coalescer = MakeCoalescer(0ms);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(coalescer.AcceptBoost(0, 100, kStart));
+        EXPECT_TRUE(coalescer.AcceptBoost(0, 0, kStart));
+        EXPECT_TRUE(coalescer.AcceptEvent(1, kStart));
+    }
+}
+
+TEST(BoostCoalescerTest, dumpCountsDecisions) {
+    BoostCoalescer coalescer = MakeCoalescer(10ms);
+    coalescer.AcceptBoost(0, 100, kStart);
+    coalescer.AcceptBoost(0, 100, kStart + 1ms);
+    coalescer.AcceptBoost(0, 100, kStart + 2ms);
+    std::ostringstream stream;
+    coalescer.DumpToStream(stream);
+    EXPECT_NE(std::string::npos, stream.str().find("A: accepted 1, coalesced 2"));
+    // Untouched slots are left out.
+    EXPECT_EQ(std::string::npos, stream.str().find("B:"));
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "aidl/BoostController.h"
+#include "aidl/tests/WorkDurationReplay.h"
+
+using std::chrono_literals::operator""ms;
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+std::vector<WorkDuration> Batch(std::chrono::nanoseconds duration) {
+    return {{.timeStampNanos = 0, .durationNanos = duration.count()}};
+}
+
+std::shared_ptr<IBoostController> MakeController(BoostControllerType type) {
+    if (type == BoostControllerType::PID_FEED_FORWARD) {
+        WorkloadPredictorConfig config = WorkloadPredictorConfig::DEFAULT;
+        config.enabled = true;
+        config.seasonPeriod = 8;
+        return std::make_shared<FeedForwardBoostController>("replay", config);
+    }
+    return CreateBoostController(type, "replay");
+}
+
+constexpr BoostControllerType kAllControllers[] = {
+        BoostControllerType::PID, BoostControllerType::PID_FEED_FORWARD,
+        BoostControllerType::FUZZY};
+
+// Replays |trace| through every controller, prints the deadline hit rate against the average
+// uclamp.min and returns the results in kAllControllers order.
+std::vector<ReplayResult> Compare(const std::string &traceName,
+                                  const std::vector<std::chrono::nanoseconds> &trace) {
+    std::vector<ReplayResult> results;
+    for (auto type : kAllControllers) {
+        const ReplayResult result = ReplayTrace(trace, MakeReplayController(MakeController(type)));
+        const double hitRate =
+                1.0 - static_cast<double>(result.numMissedDeadlines) / result.numFrames;
+        std::cout << traceName << " " << BoostControllerTypeName(type) << ": hit rate "
+                  << hitRate * 100 << "%, avg uclamp.min " << result.averageUclampMin << "\n";
+        testing::Test::RecordProperty(traceName + "_" + BoostControllerTypeName(type) + "_missed",
+                                      result.numMissedDeadlines);
+        results.push_back(result);
+    }
+    return results;
+}
+
+}  // namespace
+
+TEST(BoostControllerTest, pidOutputIsAddedToCurrentMin) {
+    PidBoostController pid("test");
+    // 10ms over a 10ms target is +100 in 100us units: 2*100 from P, 500*100/100 from D and
+    // 0.001*100*100 from I.
+    EXPECT_EQ(100 + 200 + 500 + 10,
+              pid.Update(Batch(20ms), 10ms, 100, {.pidPo = 2.0,
+                                                  .pidPu = 1.0,
+                                                  .pidI = 0.001,
+                                                  .pidIHighDivI = 512000,
+                                                  .pidILowDivI = -120000,
+                                                  .pidDo = 500.0,
+                                                  .pidDu = 0.0,
+                                                  .samplingWindowP = 0,
+                                                  .samplingWindowI = 0,
+                                                  .samplingWindowD = 0,
+                                                  .uclampMinLow = 0,
+                                                  .uclampMinHigh = 1024}));
+}
+
+TEST(BoostControllerTest, outputIsClampedToRange) {
+    for (auto type : kAllControllers) {
+        auto controller = MakeController(type);
+        EXPECT_EQ(kReplayControllerParams.uclampMinHigh,
+                  controller->Update(Batch(100ms), 10ms, kReplayControllerParams.uclampMinHigh,
+                                     kReplayControllerParams))
+                << BoostControllerTypeName(type);
+        EXPECT_EQ(kReplayControllerParams.uclampMinLow,
+                  controller->Update(Batch(1ms), 10ms, kReplayControllerParams.uclampMinLow,
+                                     kReplayControllerParams))
+                << BoostControllerTypeName(type);
+    }
+}
+
+TEST(BoostControllerTest, pidRescaleKeepsIntegralOutput) {
+    BoostControllerParams slow = kReplayControllerParams;
+    slow.pidPo = slow.pidPu = slow.pidDo = slow.pidDu = 0;
+    BoostControllerParams fast = slow;
+    fast.pidI = slow.pidI * 2;
+    fast.pidIHighDivI = slow.pidIHighDivI / 2;
+    fast.pidILowDivI = slow.pidILowDivI / 2;
+
+    PidBoostController unchanged("a");
+    PidBoostController rescaled("b");
+    for (int i = 0; i < 4; i++) {
+        unchanged.ComputeOutput(Batch(20ms), 16ms, slow);
+        rescaled.ComputeOutput(Batch(20ms), 16ms, slow);
+    }
+    // Moving from 60 to 120 Hz halves the target; with only the I term left, an on-target frame
+    // must produce the same output in both regimes.
+    rescaled.Rescale(0.5, slow, fast);
+    EXPECT_NEAR(unchanged.ComputeOutput(Batch(16ms), 16ms, slow),
+                rescaled.ComputeOutput(Batch(8ms), 8ms, fast), 1);
+}
+
+TEST(BoostControllerTest, fuzzyRulesAreMonotonic) {
+    EXPECT_DOUBLE_EQ(0, FuzzyBoostController::Infer(0, 0));
+    EXPECT_GT(FuzzyBoostController::Infer(0.3, 0), FuzzyBoostController::Infer(0.1, 0));
+    EXPECT_GT(FuzzyBoostController::Infer(0.3, 0.3), FuzzyBoostController::Infer(0.3, 0));
+    EXPECT_LT(FuzzyBoostController::Infer(-0.3, 0), 0);
+    // Boosting is more aggressive than releasing.
+    EXPECT_GT(FuzzyBoostController::Infer(1.0, 0), -FuzzyBoostController::Infer(-1.0, 0));
+}
+
+TEST(BoostControllerTest, fuzzyHoldsAtTarget) {
+    FuzzyBoostController fuzzy;
+    EXPECT_EQ(200, fuzzy.Update(Batch(10ms), 10ms, 200, kReplayControllerParams));
+    EXPECT_GT(fuzzy.Update(Batch(13ms), 10ms, 200, kReplayControllerParams), 200);
+    EXPECT_LT(fuzzy.Update(Batch(6ms), 10ms, 200, kReplayControllerParams), 200);
+}
+
+TEST(BoostControllerConfigTest, parseOverrides) {
+    BoostControllerConfig config = BoostControllerConfig::DEFAULT;
+    ASSERT_TRUE(config.ParseOverrides("10123:fuzzy, com.example.game:pid_ff,10200:pid"));
+    EXPECT_EQ(BoostControllerType::FUZZY, config.Select(10123, "com.example.game"));
+    EXPECT_EQ(BoostControllerType::PID_FEED_FORWARD, config.Select(10124, "com.example.game"));
+    EXPECT_EQ(BoostControllerType::PID, config.Select(10200, ""));
+    EXPECT_EQ(config.defaultType, config.Select(10300, "com.example.other"));
+}
+
+TEST(BoostControllerConfigTest, parseOverridesRejectsMalformedEntries) {
+    BoostControllerConfig config = BoostControllerConfig::DEFAULT;
+    ASSERT_TRUE(config.ParseOverrides("10123:fuzzy"));
+    EXPECT_FALSE(config.ParseOverrides("10123:fuzzy,com.example.game:bangbang"));
+    EXPECT_FALSE(config.ParseOverrides("com.example.game"));
+    EXPECT_FALSE(config.ParseOverrides(":pid"));
+    // A failed parse leaves the previous overrides in place.
+    EXPECT_EQ(BoostControllerType::FUZZY, config.Select(10123, ""));
+}
+
+TEST(BoostControllerConfigTest, parseTypeNames) {
+    for (auto type : kAllControllers) {
+        EXPECT_EQ(type, ParseBoostControllerType(BoostControllerTypeName(type)));
+    }
+    EXPECT_FALSE(ParseBoostControllerType("PID"));
+}
+
+TEST(BoostControllerReplayTest, periodicSpikes) {
+    const auto results = Compare("periodic", MakePeriodicTrace(960, 8, 6ms, 10ms));
+    // Feed-forward exists for exactly this load.
+    EXPECT_LT(results[1].numMissedDeadlines, results[0].numMissedDeadlines);
+}
+
+TEST(BoostControllerReplayTest, steadyLoad) {
+    const auto results = Compare("steady", MakePeriodicTrace(960, 1, 7ms, 7ms));
+    for (const auto &result : results) {
+        EXPECT_EQ(0, result.numMissedDeadlines);
+    }
+}
+
+TEST(BoostControllerReplayTest, loadStep) {
+    // Light for the first half, then close to the deadline at full speed.
+    std::vector<std::chrono::nanoseconds> trace(480, 5ms);
+    trace.insert(trace.end(), 480, 11ms);
+    const auto results = Compare("step", trace);
+    for (const auto &result : results) {
+        // The light half must not miss. After the step the loops settle on the deadline itself,
+        // since errors below 100us don't move them, but none of them may run away to the ceiling.
+        EXPECT_LE(result.numMissedDeadlines, trace.size() / 2);
+        EXPECT_LT(result.averageUclampMin, kReplayControllerParams.uclampMinHigh / 2);
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Mixed-traffic load generator and idle wakeup counter for the running Power HAL. Not part of
+// device-tests since it keeps the CPUs boosted for most of its run, so it is only run by hand.
+
+#include <aidl/android/hardware/power/IPower.h>
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <gtest/gtest.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::aidl::android::hardware::power::Boost;
+using ::aidl::android::hardware::power::IPower;
+using ::aidl::android::hardware::power::IPowerHintSession;
+using ::aidl::android::hardware::power::Mode;
+using ::aidl::android::hardware::power::WorkDuration;
+using std::chrono::steady_clock;
+
+namespace {
+
+constexpr auto kRunTime = std::chrono::seconds(10);
+constexpr int kNumSessionThreads = 4;
+constexpr int64_t kTargetDurationNs = 16666666;
+
+class LatencyRecorder {
+  public:
+    void Add(steady_clock::duration latency) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mLatenciesUs.push_back(
+                std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    }
+
+    // Prints and records p50/p99 in microseconds under |name|.
+    void Report(const std::string &name) {
+        std::lock_guard<std::mutex> lock(mLock);
+        ASSERT_FALSE(mLatenciesUs.empty()) << name;
+        std::sort(mLatenciesUs.begin(), mLatenciesUs.end());
+        const int64_t p50 = mLatenciesUs[mLatenciesUs.size() / 2];
+        const int64_t p99 = mLatenciesUs[mLatenciesUs.size() * 99 / 100];
+        std::cout << name << ": " << mLatenciesUs.size() << " calls, p50 " << p50 << "us, p99 "
+                  << p99 << "us\n";
+        testing::Test::RecordProperty(name + "_p50_us", p50);
+        testing::Test::RecordProperty(name + "_p99_us", p99);
+    }
+
+  private:
+    std::mutex mLock;
+    std::vector<int64_t> mLatenciesUs;
+};
+
+template <typename F>
+void Timed(LatencyRecorder *recorder, F &&call) {
+    const auto start = steady_clock::now();
+    call();
+    recorder->Add(steady_clock::now() - start);
+}
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   steady_clock::now().time_since_epoch())
+            .count();
+}
+
+constexpr std::string_view kServiceName = "android.hardware.power-service.xiaomi-sm8250-libperfmgr";
+
+std::vector<std::string> ListDir(const std::string &path) {
+    std::vector<std::string> entries;
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(path.c_str()), closedir);
+    if (!dir) {
+        return entries;
+    }
+    while (const dirent *entry = readdir(dir.get())) {
+        if (entry->d_name[0] != '.') {
+            entries.push_back(entry->d_name);
+        }
+    }
+    return entries;
+}
+
+// Returns the pid of the Power HAL service, or -1 if it isn't running.
+pid_t FindServicePid() {
+    for (const std::string &entry : ListDir("/proc")) {
+        pid_t pid;
+        std::string cmdline;
+        if (::android::base::ParseInt(entry, &pid) &&
+            ::android::base::ReadFileToString("/proc/" + entry + "/cmdline", &cmdline) &&
+            cmdline.find(kServiceName) != std::string::npos) {
+            return pid;
+        }
+    }
+    return -1;
+}
+
+// Sums the context switches of all threads of |pid|, i.e. how often any of them woke up.
+uint64_t CountWakeups(pid_t pid, size_t *numThreads) {
+    const std::string taskDir = "/proc/" + std::to_string(pid) + "/task";
+    uint64_t wakeups = 0;
+    *numThreads = 0;
+    for (const std::string &tid : ListDir(taskDir)) {
+        std::string status;
+        if (!::android::base::ReadFileToString(taskDir + "/" + tid + "/status", &status)) {
+            continue;
+        }
+        (*numThreads)++;
+        for (const std::string &line : ::android::base::Split(status, "\n")) {
+            const std::vector<std::string> fields = ::android::base::Split(line, ":");
+            uint64_t count;
+            if (fields.size() == 2 &&
+                (fields[0] == "voluntary_ctxt_switches" ||
+                 fields[0] == "nonvoluntary_ctxt_switches") &&
+                ::android::base::ParseUint(::android::base::Trim(fields[1]), &count)) {
+                wakeups += count;
+            }
+        }
+    }
+    return wakeups;
+}
+
+}  // namespace
+
+class PowerHalLoadTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        ABinderProcess_setThreadPoolMaxThreadCount(0);
+        const std::string instance = std::string() + IPower::descriptor + "/default";
+        mPower = IPower::fromBinder(
+                ndk::SpAIBinder(AServiceManager_waitForService(instance.c_str())));
+        ASSERT_NE(nullptr, mPower);
+    }
+
+    std::shared_ptr<IPower> mPower;
+};
+
+// Sessions report every frame while boosts and mode changes arrive like they do during scrolling.
+// The interesting numbers are the boost and mode p99s; with a single binder thread they include
+// the time spent queued behind reports.
+TEST_F(PowerHalLoadTest, mixedTraffic) {
+    const auto deadline = steady_clock::now() + kRunTime;
+    std::atomic<bool> sessionsSupported(true);
+    LatencyRecorder boostLatency, modeLatency, reportLatency;
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < kNumSessionThreads; i++) {
+        threads.emplace_back([&] {
+            const int32_t tid = static_cast<int32_t>(syscall(__NR_gettid));
+            std::shared_ptr<IPowerHintSession> session;
+            if (!mPower->createHintSession(getpid(), getuid(), {tid}, kTargetDurationNs, &session)
+                         .isOk() ||
+                !session) {
+                sessionsSupported = false;
+                return;
+            }
+            while (steady_clock::now() < deadline) {
+                const std::vector<WorkDuration> durations = {
+                        {.timeStampNanos = NowNs(), .durationNanos = kTargetDurationNs / 2}};
+                Timed(&reportLatency, [&] { session->reportActualWorkDuration(durations); });
+                std::this_thread::sleep_for(std::chrono::nanoseconds(kTargetDurationNs));
+            }
+            session->close();
+        });
+    }
+    threads.emplace_back([&] {
+        while (steady_clock::now() < deadline) {
+            Timed(&boostLatency, [&] { mPower->setBoost(Boost::INTERACTION, 0); });
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+    threads.emplace_back([&] {
+        bool enabled = true;
+        while (steady_clock::now() < deadline) {
+            Timed(&modeLatency, [&] { mPower->setMode(Mode::EXPENSIVE_RENDERING, enabled); });
+            enabled = !enabled;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        mPower->setMode(Mode::EXPENSIVE_RENDERING, false);
+    });
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    boostLatency.Report("setBoost");
+    modeLatency.Report("setMode");
+    if (sessionsSupported) {
+        reportLatency.Report("reportActualWorkDuration");
+    }
+}
+
+// Back-to-back LAUNCH mode toggles. Unlike INTERACTION, which goes to InteractionHandler, and
+// DISPLAY_UPDATE_IMMINENT, which the boost coalescer may drop, every one of these calls looks up
+// its interned name and reaches HintManager::DoHint()/EndHint(), so this times the hint name
+// dispatch path itself. Run it on builds with and without interned names to compare; the
+// toString() line is the client-side cost of the three string builds that interning removed.
+TEST_F(PowerHalLoadTest, launchBurst) {
+    constexpr int kBurstSize = 2000;
+    bool supported = false;
+    ASSERT_TRUE(mPower->isModeSupported(Mode::LAUNCH, &supported).isOk());
+    if (!supported) {
+        GTEST_SKIP() << "LAUNCH is not supported";
+    }
+
+    LatencyRecorder latency;
+    const auto start = steady_clock::now();
+    for (int i = 0; i < kBurstSize; i++) {
+        Timed(&latency, [&] { mPower->setMode(Mode::LAUNCH, i % 2 == 0); });
+    }
+    const auto elapsedUs =
+            std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - start);
+    mPower->setMode(Mode::LAUNCH, false);
+    std::cout << "setMode(LAUNCH) burst: " << elapsedUs.count() / kBurstSize << "us per call\n";
+    latency.Report("setModeBurst");
+
+    size_t length = 0;
+    const auto toStringStart = steady_clock::now();
+    for (int i = 0; i < kBurstSize; i++) {
+        for (int j = 0; j < 3; j++) {
+            length += toString(Mode::LAUNCH).size();
+        }
+    }
+    const auto toStringNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            steady_clock::now() - toStringStart);
+    ASSERT_GT(length, 0u);
+    std::cout << "3x toString(LAUNCH): " << toStringNs.count() / kBurstSize << "ns per call\n";
+    testing::Test::RecordProperty("toString_x3_ns",
+                                  static_cast<int>(toStringNs.count() / kBurstSize));
+}
+
+// Counts how often the HAL's threads wake up while nothing is sent to it, as with the screen on
+// but untouched. Run it on two builds to compare; every background thread that polls or ticks
+// shows up here. Needs root to read the service's /proc entries.
+TEST_F(PowerHalLoadTest, idleWakeups) {
+    const pid_t pid = FindServicePid();
+    if (pid < 0) {
+        GTEST_SKIP() << kServiceName << " is not running";
+    }
+    // Let boosts from the test setup and earlier tests run out.
+    std::this_thread::sleep_for(std::chrono::seconds(6));
+
+    size_t numThreads;
+    const uint64_t before = CountWakeups(pid, &numThreads);
+    if (numThreads == 0) {
+        GTEST_SKIP() << "no access to /proc/" << pid << "/task";
+    }
+    std::this_thread::sleep_for(kRunTime);
+    const uint64_t after = CountWakeups(pid, &numThreads);
+
+    const double perSecond = static_cast<double>(after - before) / kRunTime.count();
+    std::cout << "idle wakeups: " << perSecond << "/s across " << numThreads << " threads\n";
+    testing::Test::RecordProperty("idle_wakeups_per_s", std::to_string(perSecond));
+    testing::Test::RecordProperty("threads", static_cast<int>(numThreads));
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/power/WorkDuration.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "aidl/BoostController.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::aidl::android::hardware::power::WorkDuration;
+
+// Host-side replay of a hint session against a simulated CPU. Each trace entry is the work of one
+// frame, expressed as its duration at uclamp.min 1024. The simulated frame duration scales with
+// the capacity implied by the current uclamp.min, and the controller under test then receives the
+// resulting WorkDuration exactly as PowerHintSession::reportActualWorkDuration would.
+struct ReplayResult {
+    size_t numFrames = 0;
+    size_t numMissedDeadlines = 0;
+    // Mean uclamp.min over the trace, used as a proxy for the energy spent on boosting.
+    double averageUclampMin = 0;
+};
+
+// Returns the uclamp.min to apply after the reported durations. The harness clamps the result to
+// the configured range.
+using ReplayController = std::function<int(const std::vector<WorkDuration> &actualDurations,
+                                           std::chrono::nanoseconds targetDuration,
+                                           int currentUclampMin)>;
+
+struct ReplayParams {
+    std::chrono::nanoseconds targetDuration = std::chrono::nanoseconds(16666666);
+    int uclampMinInit = 162;
+    int uclampMinLow = 2;
+    int uclampMinHigh = 480;
+};
+
+inline ReplayResult ReplayTrace(const std::vector<std::chrono::nanoseconds> &trace,
+                                const ReplayController &controller,
+                                const ReplayParams &params = ReplayParams()) {
+    ReplayResult result;
+    int uclampMin = params.uclampMinInit;
+    int64_t now = 0;
+    double uclampSum = 0;
+    for (const auto &work : trace) {
+        // Capacity ramps linearly from half speed at uclamp.min 0 to full speed at 1024.
+        const double capacity = 0.5 + 0.5 * uclampMin / 1024.0;
+        const int64_t duration = static_cast<int64_t>(work.count() / capacity);
+        now += std::max(duration, static_cast<int64_t>(params.targetDuration.count()));
+        result.numFrames++;
+        result.numMissedDeadlines += duration > params.targetDuration.count();
+        uclampSum += uclampMin;
+
+        const std::vector<WorkDuration> batch = {{.timeStampNanos = now,
+                                                  .durationNanos = duration}};
+        uclampMin = std::clamp(controller(batch, params.targetDuration, uclampMin),
+                               params.uclampMinLow, params.uclampMinHigh);
+    }
+    result.averageUclampMin = result.numFrames ? uclampSum / result.numFrames : 0;
+    return result;
+}
+
+// A mostly light workload with a heavy frame every |period| frames, e.g. a game doing physics or
+// asset streaming on a fixed cadence.
+inline std::vector<std::chrono::nanoseconds> MakePeriodicTrace(size_t numFrames, size_t period,
+                                                               std::chrono::nanoseconds light,
+                                                               std::chrono::nanoseconds heavy) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int64_t> jitter(-300000, 300000);
+    std::vector<std::chrono::nanoseconds> trace;
+    for (size_t i = 0; i < numFrames; i++) {
+        const auto base = (i % period == period - 1) ? heavy : light;
+        trace.push_back(base + std::chrono::nanoseconds(jitter(rng)));
+    }
+    return trace;
+}
+
+// AdpfConfig-equivalent controller parameters used for replays, matching the PID gains shipped in
+// Pixel powerhint.json files.
+constexpr BoostControllerParams kReplayControllerParams{
+        .pidPo = 2.0,
+        .pidPu = 1.0,
+        .pidI = 0.001,
+        .pidIHighDivI = static_cast<int64_t>(512 / 0.001),
+        .pidILowDivI = static_cast<int64_t>(-120 / 0.001),
+        .pidDo = 500.0,
+        .pidDu = 0.0,
+        .samplingWindowP = 1,
+        .samplingWindowI = 0,
+        .samplingWindowD = 1,
+        .uclampMinLow = 2,
+        .uclampMinHigh = 480,
+};
+
+// Drives |controller| the way PowerHintSession::reportActualWorkDuration does.
+inline ReplayController MakeReplayController(std::shared_ptr<IBoostController> controller,
+                                             const BoostControllerParams &params =
+                                                     kReplayControllerParams) {
+    return [controller, params](const std::vector<WorkDuration> &actualDurations,
+                                std::chrono::nanoseconds targetDuration, int currentUclampMin) {
+        return controller->Update(actualDurations, targetDuration, currentUclampMin, params);
+    };
+}
+
+inline ReplayController MakePidController() {
+    return MakeReplayController(std::make_shared<PidBoostController>("replay"));
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
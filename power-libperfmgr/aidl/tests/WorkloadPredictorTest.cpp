@@ -0,0 +1,133 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "aidl/WorkloadPredictor.h"
+#include "aidl/tests/WorkDurationReplay.h"
+
+using std::chrono_literals::operator""ms;
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+WorkloadPredictorConfig MakeConfig(uint32_t seasonPeriod) {
+    WorkloadPredictorConfig config = WorkloadPredictorConfig::DEFAULT;
+    config.enabled = true;
+    config.seasonPeriod = seasonPeriod;
+    return config;
+}
+
+std::vector<WorkDuration> Batch(std::chrono::nanoseconds duration) {
+    return {{.timeStampNanos = 0, .durationNanos = duration.count()}};
+}
+
+ReplayController PidWithFeedForward(WorkloadPredictorConfig config) {
+    return MakeReplayController(std::make_shared<FeedForwardBoostController>("replay", config));
+}
+
+void ReportDeltas(const ReplayResult &pid, const ReplayResult &ff) {
+    const int missedDelta = static_cast<int>(ff.numMissedDeadlines) -
+                            static_cast<int>(pid.numMissedDeadlines);
+    const double uclampDelta = ff.averageUclampMin - pid.averageUclampMin;
+    std::cout << "PID: missed " << pid.numMissedDeadlines << "/" << pid.numFrames
+              << ", avg uclamp.min " << pid.averageUclampMin << "\n";
+    std::cout << "PID+FF: missed " << ff.numMissedDeadlines << "/" << ff.numFrames
+              << ", avg uclamp.min " << ff.averageUclampMin << "\n";
+    testing::Test::RecordProperty("missed_deadline_delta", missedDelta);
+    testing::Test::RecordProperty("avg_uclamp_delta", std::to_string(uclampDelta));
+}
+
+}  // namespace
+
+TEST(WorkloadPredictorTest, noHistoryPredictsTarget) {
+    WorkloadPredictor predictor(MakeConfig(0));
+    EXPECT_EQ(1.0, predictor.Predict());
+}
+
+TEST(WorkloadPredictorTest, constantLoadHasNoFeedForward) {
+    WorkloadPredictor predictor(MakeConfig(0));
+    int64_t output = 0;
+    for (int i = 0; i < 32; i++) {
+        output = predictor.Update(Batch(8ms), 16ms);
+    }
+    EXPECT_EQ(0, output);
+    EXPECT_DOUBLE_EQ(0.5, predictor.Predict());
+}
+
+TEST(WorkloadPredictorTest, seasonalModelAnticipatesSpike) {
+    WorkloadPredictor predictor(MakeConfig(4));
+    // Three light frames then a heavy one, repeated.
+    for (int i = 0; i < 8 * 4; i++) {
+        predictor.Update(Batch(i % 4 == 3 ? 24ms : 8ms), 16ms);
+    }
+    // The next frame is the 3rd light one, and then comes the spike.
+    predictor.Update(Batch(8ms), 16ms);
+    predictor.Update(Batch(8ms), 16ms);
+    const int64_t output = predictor.Update(Batch(8ms), 16ms);
+    EXPECT_GT(predictor.Predict(), 1.0);
+    EXPECT_GT(output, 0);
+    // Right after the spike the predictor backs off.
+    EXPECT_LE(predictor.Update(Batch(24ms), 16ms), 0);
+}
+
+TEST(WorkloadPredictorTest, outputIsBounded) {
+    WorkloadPredictorConfig config = MakeConfig(2);
+    config.gain = 10000;
+    config.maxOutput = 100;
+    WorkloadPredictor predictor(config);
+    for (int i = 0; i < 32; i++) {
+        const int64_t output = predictor.Update(Batch(i % 2 ? 60ms : 1ms), 16ms);
+        EXPECT_LE(output, config.maxOutput);
+        EXPECT_GE(output, -config.maxOutput);
+    }
+}
+
+TEST(WorkloadPredictorTest, ignoresInvalidTarget) {
+    WorkloadPredictor predictor(MakeConfig(0));
+    EXPECT_EQ(0, predictor.Update(Batch(8ms), std::chrono::nanoseconds(0)));
+    EXPECT_EQ(1.0, predictor.Predict());
+}
+
+TEST(WorkloadPredictorReplayTest, periodicSpikesMissFewerDeadlines) {
+    const auto trace = MakePeriodicTrace(960, 8, 6ms, 10ms);
+    const ReplayResult pid = ReplayTrace(trace, MakePidController());
+    const ReplayResult ff = ReplayTrace(trace, PidWithFeedForward(MakeConfig(8)));
+    ReportDeltas(pid, ff);
+    EXPECT_LT(ff.numMissedDeadlines, pid.numMissedDeadlines);
+}
+
+TEST(WorkloadPredictorReplayTest, steadyLoadCostsNoExtraBoost) {
+    const auto trace = MakePeriodicTrace(960, 1, 7ms, 7ms);
+    const ReplayResult pid = ReplayTrace(trace, MakePidController());
+    const ReplayResult ff = ReplayTrace(trace, PidWithFeedForward(MakeConfig(8)));
+    ReportDeltas(pid, ff);
+    EXPECT_LE(ff.numMissedDeadlines, pid.numMissedDeadlines);
+    EXPECT_NEAR(pid.averageUclampMin, ff.averageUclampMin, pid.averageUclampMin * 0.05 + 1);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
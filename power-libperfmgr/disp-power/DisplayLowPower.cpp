@@ -16,11 +16,11 @@
 
 #define LOG_TAG "powerhal-libperfmgr"
 
-#include <errno.h>
-#include <unistd.h>
-
-#include <cutils/sockets.h>
+#include <android-base/properties.h>
 #include <log/log.h>
+#include <perfmgr/HintManager.h>
+
+#include <algorithm>
 
 #include "DisplayLowPower.h"
 
@@ -31,51 +31,125 @@ namespace power {
 namespace impl {
 namespace pixel {
 
-DisplayLowPower::DisplayLowPower() : mFossStatus(false) {}
+namespace {
+
+// How long a lower power state must be asked for before it is entered.
+const std::chrono::milliseconds kEnterDelay(::android::base::GetUintProperty<uint32_t>(
+        "vendor.powerhal.disp.lp_enter_delay_ms", /*default*/ 2000U));
+// Held in LOW_POWER, for whatever else powerhint.json wants to downshift with the display.
+constexpr char kLowPowerHint[] = "DISPLAY_LOW_POWER";
+
+}  // namespace
+
+using ::android::perfmgr::HintManager;
+
+DisplayLowPower::DisplayLowPower()
+    : mPolicy(kEnterDelay, DisplayPowerPolicy::Clock::now()),
+      mFossStatus(false),
+      mLowPowerHintOn(false) {}
 
-void DisplayLowPower::Init() {
-    ConnectPpsDaemon();
+void DisplayLowPower::Init(const ::android::sp<::android::Looper> &looper) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mLooper != nullptr) {
+        return;
+    }
+    mLooper = looper;
+    mDeadlineHandler = new DeadlineHandler(this);
+    mPpsClient = new PpsClient(looper, PpsClientConfig::ReadFromSystemProperties(),
+                               PpsClient::DaemonConnector());
+    // Requested before the client existed.
+    if (mFossStatus) {
+        mPpsClient->Send("foss:on");
+    }
+    mPpsClient->Start();
+    UpdateLocked();
 }
 
-void DisplayLowPower::SetDisplayLowPower(bool enable) {
-    SetFoss(enable);
+void DisplayLowPower::SetLowPowerMode(bool enabled) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mInputs.lowPowerMode = enabled;
+    UpdateLocked();
 }
 
-void DisplayLowPower::ConnectPpsDaemon() {
-    constexpr const char kPpsDaemon[] = "pps";
+void DisplayLowPower::SetDisplayInactive(bool inactive) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mInputs.displayInactive = inactive;
+    UpdateLocked();
+}
 
-    mPpsSocket.reset(
-            socket_local_client(kPpsDaemon, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM));
-    if (mPpsSocket.get() < 0) {
-        ALOGW("Connecting to PPS daemon failed (%s)", strerror(errno));
-    }
+void DisplayLowPower::SetSessionsActive(bool active) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mInputs.sessionsActive = active;
+    UpdateLocked();
 }
 
-int DisplayLowPower::SendPpsCommand(const std::string_view cmd) {
-    if (TEMP_FAILURE_RETRY(write(mPpsSocket.get(), cmd.data(), cmd.size())) < 0) {
-        ALOGE("Failed to send pps command '%s' over socket (%s)", cmd.data(), strerror(errno));
-        return -1;
+void DisplayLowPower::DumpToStream(std::ostream &stream) {
+    std::lock_guard<std::mutex> lock(mLock);
+    const auto residency = mPolicy.GetResidency(DisplayPowerPolicy::Clock::now());
+    stream << "DisplayLowPower: state " << toString(mPolicy.GetState()) << ", foss "
+           << (mFossStatus ? "on" : "off") << ", transitions " << mPolicy.GetNumTransitions()
+           << "\n";
+    stream << "  residency";
+    for (size_t i = 0; i < kNumDisplayPowerStates; i++) {
+        stream << (i ? ", " : " ") << toString(static_cast<DisplayPowerState>(i)) << " "
+               << residency[i].count() << "ms";
+    }
+    stream << "\n";
+    if (mPpsClient != nullptr) {
+        mPpsClient->DumpToStream(stream);
     }
+}
 
-    return 0;
+void DisplayLowPower::DeadlineHandler::handleMessage(const ::android::Message &) {
+    std::lock_guard<std::mutex> lock(mDisplayLowPower->mLock);
+    mDisplayLowPower->UpdateLocked();
 }
 
-void DisplayLowPower::SetFoss(bool enable) {
-    if (mPpsSocket.get() < 0 || mFossStatus == enable) {
+// should be called while locked
+void DisplayLowPower::UpdateLocked() {
+    const auto now = DisplayPowerPolicy::Clock::now();
+    const std::optional<DisplayPowerState> state = mPolicy.Update(mInputs, now);
+    if (state) {
+        ApplyLocked(*state);
+    }
+    // Before Init() a pending transition waits for the next update.
+    if (mLooper == nullptr) {
         return;
     }
+    mLooper->removeMessages(mDeadlineHandler);
+    if (const auto deadline = mPolicy.GetDeadline()) {
+        const auto delay = std::max(*deadline - now, DisplayPowerPolicy::Clock::duration::zero());
+        mLooper->sendMessageDelayed(std::chrono::nanoseconds(delay).count(), mDeadlineHandler,
+                                    ::android::Message());
+    }
+}
 
-    ALOGI("%s foss", (enable) ? "Enable" : "Disable");
+// should be called while locked
+void DisplayLowPower::ApplyLocked(DisplayPowerState state) {
+    ALOGI("Display power state %s", toString(state));
+    SetFoss(state != DisplayPowerState::NORMAL);
+
+    const bool hintOn = state == DisplayPowerState::LOW_POWER;
+    if (hintOn != mLowPowerHintOn && HintManager::GetInstance()->IsHintSupported(kLowPowerHint)) {
+        if (hintOn) {
+            HintManager::GetInstance()->DoHint(kLowPowerHint);
+        } else {
+            HintManager::GetInstance()->EndHint(kLowPowerHint);
+        }
+    }
+    mLowPowerHintOn = hintOn;
+}
 
-    std::string_view foss_cmd;
-    if (enable) {
-        foss_cmd = "foss:on";
-    } else {
-        foss_cmd = "foss:off";
+// should be called while locked
+void DisplayLowPower::SetFoss(bool enable) {
+    if (mFossStatus == enable) {
+        return;
     }
 
-    if (!SendPpsCommand(foss_cmd)) {
-        mFossStatus = enable;
+    ALOGI("%s foss", (enable) ? "Enable" : "Disable");
+    mFossStatus = enable;
+    if (mPpsClient != nullptr) {
+        mPpsClient->Send(enable ? "foss:on" : "foss:off");
     }
 }
 
@@ -16,9 +16,13 @@
 
 #pragma once
 
-#include <string_view>
+#include <mutex>
+#include <ostream>
 
-#include <android-base/unique_fd.h>
+#include <utils/Looper.h>
+
+#include "DisplayPowerPolicy.h"
+#include "PpsClient.h"
 
 namespace aidl {
 namespace google {
@@ -27,20 +31,46 @@ namespace power {
 namespace impl {
 namespace pixel {
 
+// Drives FOSS and the DISPLAY_LOW_POWER hint together from the display power state
+// DisplayPowerPolicy picks. The touch sampling rate is left alone: bump_sample_rate is the
+// high touch sampling rate toggle in Parts, and only the user changes it.
 class DisplayLowPower {
   public:
     DisplayLowPower();
     ~DisplayLowPower() {}
-    void Init();
-    void SetDisplayLowPower(bool enable);
+    // Connects to the pps daemon from |looper|, retrying until it is up. Delayed transitions are
+    // also applied from there.
+    void Init(const ::android::sp<::android::Looper> &looper);
+    void SetLowPowerMode(bool enabled);
+    void SetDisplayInactive(bool inactive);
+    void SetSessionsActive(bool active);
+    void DumpToStream(std::ostream &stream);
 
   private:
-    void ConnectPpsDaemon();
-    int SendPpsCommand(const std::string_view cmd);
+    class DeadlineHandler : public ::android::MessageHandler {
+      public:
+        explicit DeadlineHandler(DisplayLowPower *displayLowPower)
+            : mDisplayLowPower(displayLowPower) {}
+        void handleMessage(const ::android::Message &message) override;
+
+      private:
+        DisplayLowPower *const mDisplayLowPower;
+    };
+
+    void UpdateLocked();
+    void ApplyLocked(DisplayPowerState state);
     void SetFoss(bool enable);
 
-    ::android::base::unique_fd mPpsSocket;
+    // Binder threads may change the inputs before Init().
+    std::mutex mLock;
+    // Everything below is protected by mLock.
+    ::android::sp<::android::Looper> mLooper;
+    ::android::sp<DeadlineHandler> mDeadlineHandler;
+    ::android::sp<PpsClient> mPpsClient;
+    DisplayPowerInputs mInputs;
+    DisplayPowerPolicy mPolicy;
     bool mFossStatus;
+    bool mLowPowerHintOn;
 };
 
 }  // namespace pixel
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DisplayPowerPolicy.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+DisplayPowerState TargetState(const DisplayPowerInputs &inputs) {
+    if (inputs.displayInactive) {
+        return DisplayPowerState::INACTIVE;
+    }
+    if (inputs.lowPowerMode && !inputs.sessionsActive) {
+        return DisplayPowerState::LOW_POWER;
+    }
+    return DisplayPowerState::NORMAL;
+}
+
+}  // namespace
+
+const char *toString(DisplayPowerState state) {
+    switch (state) {
+        case DisplayPowerState::NORMAL:
+            return "NORMAL";
+        case DisplayPowerState::LOW_POWER:
+            return "LOW_POWER";
+        case DisplayPowerState::INACTIVE:
+            return "INACTIVE";
+    }
+    return "UNKNOWN";
+}
+
+DisplayPowerPolicy::DisplayPowerPolicy(std::chrono::milliseconds enterDelay,
+                                       Clock::time_point now)
+    : mEnterDelay(enterDelay),
+      mState(DisplayPowerState::NORMAL),
+      mStateSince(now),
+      mNumTransitions(0),
+      mResidency({}) {}
+
+std::optional<DisplayPowerState> DisplayPowerPolicy::Update(const DisplayPowerInputs &inputs,
+                                                            Clock::time_point now) {
+    const DisplayPowerState target = TargetState(inputs);
+    if (target <= mState) {
+        mPending.reset();
+        if (target == mState) {
+            return std::nullopt;
+        }
+    } else {
+        if (mPending != target) {
+            mPending = target;
+            mPendingSince = now;
+        }
+        if (now - mPendingSince < mEnterDelay) {
+            return std::nullopt;
+        }
+        mPending.reset();
+    }
+
+    mResidency[static_cast<size_t>(mState)] +=
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - mStateSince);
+    mState = target;
+    mStateSince = now;
+    mNumTransitions++;
+    return mState;
+}
+
+std::optional<DisplayPowerPolicy::Clock::time_point> DisplayPowerPolicy::GetDeadline() const {
+    if (!mPending) {
+        return std::nullopt;
+    }
+    return mPendingSince + mEnterDelay;
+}
+
+std::array<std::chrono::milliseconds, kNumDisplayPowerStates> DisplayPowerPolicy::GetResidency(
+        Clock::time_point now) const {
+    std::array<std::chrono::milliseconds, kNumDisplayPowerStates> residency = mResidency;
+    residency[static_cast<size_t>(mState)] +=
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - mStateSince);
+    return residency;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
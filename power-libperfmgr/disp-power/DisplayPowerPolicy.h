@@ -0,0 +1,88 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Ordered from the most to the least power drawn.
+enum class DisplayPowerState : uint8_t {
+    NORMAL,
+    LOW_POWER,
+    INACTIVE,
+};
+
+constexpr size_t kNumDisplayPowerStates = 3;
+
+const char *toString(DisplayPowerState state);
+
+struct DisplayPowerInputs {
+    // Mode::LOW_POWER, i.e. battery saver.
+    bool lowPowerMode = false;
+    // Mode::DISPLAY_INACTIVE.
+    bool displayInactive = false;
+    // Some app has an active ADPF session, which keeps the display at full power.
+    bool sessionsActive = false;
+};
+
+// Picks the display power state from the modes and session activity. A move to a lower power state
+// only happens once its target held for |enterDelay|, so a mode toggled back and forth never
+// reaches the panel; moves back towards NORMAL are immediate. Tracks the time spent in each state.
+// Not thread-safe.
+class DisplayPowerPolicy {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    DisplayPowerPolicy(std::chrono::milliseconds enterDelay, Clock::time_point now);
+
+    // Returns the new state if it changed.
+    std::optional<DisplayPowerState> Update(const DisplayPowerInputs &inputs,
+                                            Clock::time_point now);
+    // When Update() needs to be called again to apply a delayed transition, if one is pending.
+    std::optional<Clock::time_point> GetDeadline() const;
+    DisplayPowerState GetState() const { return mState; }
+    uint64_t GetNumTransitions() const { return mNumTransitions; }
+    // Time spent in each state up to |now|, indexed by DisplayPowerState.
+    std::array<std::chrono::milliseconds, kNumDisplayPowerStates> GetResidency(
+            Clock::time_point now) const;
+
+  private:
+    const std::chrono::milliseconds mEnterDelay;
+    DisplayPowerState mState;
+    Clock::time_point mStateSince;
+    // A lower power state waiting for the delay to pass.
+    std::optional<DisplayPowerState> mPending;
+    Clock::time_point mPendingSince;
+    uint64_t mNumTransitions;
+    std::array<std::chrono::milliseconds, kNumDisplayPowerStates> mResidency;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IdlePredictor.h"
+
+#include <algorithm>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+// Fraction of interactions whose display activity should fit within the prediction.
+constexpr double kQuantile = 0.9;
+// Relative move of the estimate per sample, roughly a memory of the last few dozen interactions.
+constexpr double kStep = 0.05;
+// Keeps the step from vanishing when the estimate gets close to zero.
+constexpr double kMinStepBaseMs = 20.0;
+constexpr uint32_t kMinSamples = 8;
+// Apps remembered at once; the least recently used one is dropped beyond this.
+constexpr size_t kMaxApps = 32;
+
+}  // namespace
+
+void DecayingQuantile::Add(double sample) {
+    if (mNumSamples++ == 0) {
+        mEstimate = sample;
+        return;
+    }
+    const double delta = mStep * std::max(mEstimate, kMinStepBaseMs);
+    if (sample > mEstimate) {
+        mEstimate += delta * mQuantile;
+    } else if (sample < mEstimate) {
+        mEstimate -= delta * (1 - mQuantile);
+    }
+    mEstimate = std::max(mEstimate, 0.0);
+}
+
+void IdlePredictor::AddSample(int32_t app, int32_t touchToIdleMs) {
+    mNumSamples++;
+    auto it = mApps.find(app);
+    if (it == mApps.end()) {
+        if (mApps.size() >= kMaxApps) {
+            mApps.erase(std::min_element(mApps.begin(), mApps.end(),
+                                         [](const auto &a, const auto &b) {
+                                             return a.second.lastUsed < b.second.lastUsed;
+                                         }));
+        }
+        it = mApps.emplace(app, AppHistory{DecayingQuantile(kQuantile, kStep), 0}).first;
+    }
+    it->second.touchToIdle.Add(touchToIdleMs);
+    it->second.lastUsed = mNumSamples;
+}
+
+std::optional<int32_t> IdlePredictor::PredictMs(int32_t app) const {
+    auto it = mApps.find(app);
+    if (it == mApps.end() || it->second.touchToIdle.GetNumSamples() < kMinSamples) {
+        return std::nullopt;
+    }
+    return static_cast<int32_t>(it->second.touchToIdle.Get());
+}
+
+void IdlePredictor::DumpToStream(std::ostream &stream) const {
+    for (const auto &[app, history] : mApps) {
+        stream << "  uid " << app << ": touch-to-idle p" << static_cast<int>(kQuantile * 100)
+               << " " << static_cast<int32_t>(history.touchToIdle.Get()) << "ms over "
+               << history.touchToIdle.GetNumSamples() << " interactions\n";
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
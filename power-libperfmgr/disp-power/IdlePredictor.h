@@ -0,0 +1,76 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <unordered_map>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Online estimate of a quantile of a stream. Every sample moves the estimate by a fixed fraction
+// of itself, up when the sample is above it and down when below, weighted so the estimate settles
+// where |quantile| of the samples fall below it. Older samples decay geometrically.
+class DecayingQuantile {
+  public:
+    DecayingQuantile(double quantile, double step) : mQuantile(quantile), mStep(step) {}
+
+    void Add(double sample);
+    double Get() const { return mEstimate; }
+    uint32_t GetNumSamples() const { return mNumSamples; }
+
+  private:
+    const double mQuantile;
+    const double mStep;
+    double mEstimate = 0;
+    uint32_t mNumSamples = 0;
+};
+
+// Learns how long after the last touch the display goes idle, separately for each app. Apps are
+// identified by uid; kUnknownApp collects interactions outside any known app. Not thread-safe.
+class IdlePredictor {
+  public:
+    static constexpr int32_t kUnknownApp = -1;
+
+    // Adds a touch-to-idle time for |app|.
+    void AddSample(int32_t app, int32_t touchToIdleMs);
+    // Returns the predicted touch-to-idle time of |app|, once there are enough samples for it.
+    std::optional<int32_t> PredictMs(int32_t app) const;
+    void DumpToStream(std::ostream &stream) const;
+
+  private:
+    struct AppHistory {
+        DecayingQuantile touchToIdle;
+        uint64_t lastUsed;
+    };
+
+    std::unordered_map<int32_t, AppHistory> mApps;
+    uint64_t mNumSamples = 0;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
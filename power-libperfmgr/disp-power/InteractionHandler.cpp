@@ -19,18 +19,21 @@
 
 #include "InteractionHandler.h"
 
+#include <android-base/file.h>
 #include <android-base/properties.h>
+#include <android-base/stringprintf.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <perfmgr/HintManager.h>
-#include <poll.h>
-#include <sys/eventfd.h>
 #include <time.h>
 #include <unistd.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
 #include <array>
 #include <memory>
+#include <sstream>
 
 #define MAX_LENGTH 64
 
@@ -58,6 +61,13 @@ static const uint32_t kMaxDurationMs =
         ::android::base::GetUintProperty("vendor.powerhal.interaction.max", /*default*/ 5650U);
 static const uint32_t kDurationOffsetMs =
         ::android::base::GetUintProperty("vendor.powerhal.interaction.offset", /*default*/ 650U);
+// Release the boost once the learned touch-to-idle time of the app has passed, even if the
+// display has not reported idle yet.
+static const bool kPredictIdle =
+        ::android::base::GetBoolProperty("vendor.powerhal.interaction.predict", true);
+// How often the boost tier is reconsidered while waiting for idle, 0 to hold HEAVY throughout.
+static const int32_t kTierStepMs = static_cast<int32_t>(::android::base::GetUintProperty(
+        "vendor.powerhal.interaction.tier_step", /*default*/ 100U));
 
 static size_t CalcTimespecDiffMs(struct timespec start, struct timespec end) {
     size_t diff_in_ms = 0;
@@ -82,70 +92,119 @@ static int FbIdleOpen(void) {
 using ::android::perfmgr::HintManager;
 
 InteractionHandler::InteractionHandler()
-    : mState(INTERACTION_STATE_UNINITIALIZED), mDurationMs(0) {}
+    : mState(INTERACTION_STATE_UNINITIALIZED),
+      mIdleFd(-1),
+      mDurationMs(0),
+      mApp(IdlePredictor::kUnknownApp),
+      mHoldApp(IdlePredictor::kUnknownApp),
+      mHoldDurationMs(0),
+      mHoldMs(0),
+      mShadowWaiting(false),
+      mShadowReleasedAtMs(0),
+      mWatchingIdle(false),
+      mTimerGeneration(0),
+      mTierSupported({false, false, true}),
+      mTier(InteractionTier::HEAVY) {}
 
 InteractionHandler::~InteractionHandler() {
     Exit();
 }
 
-bool InteractionHandler::Init() {
+void InteractionHandler::SetLoadProvider(InteractionLoadProvider provider) {
+    mLoadProvider = std::move(provider);
+}
+
+bool InteractionHandler::Init(const ::android::sp<::android::Looper> &looper) {
     std::lock_guard<std::mutex> lk(mLock);
 
     if (mState != INTERACTION_STATE_UNINITIALIZED)
         return true;
 
+    for (size_t i = 0; i < kNumInteractionTiers; i++) {
+        mTierSupported[i] = HintManager::GetInstance()->IsHintSupported(kInteractionTierHints[i]);
+    }
+    // HEAVY is what every interaction starts in; without it there is nothing to step from.
+    if (!mTierSupported[static_cast<size_t>(InteractionTier::HEAVY)]) {
+        mTierSupported.fill(false);
+        mTierSupported[static_cast<size_t>(InteractionTier::HEAVY)] = true;
+    }
+
     int fd = FbIdleOpen();
     if (fd < 0)
         return false;
     mIdleFd = fd;
 
-    mEventFd = eventfd(0, EFD_NONBLOCK);
-    if (mEventFd < 0) {
-        ALOGE("Unable to create event fd (%d)", errno);
-        close(mIdleFd);
-        return false;
-    }
-
+    mLooper = looper;
+    mTimerHandler = new TimerHandler(this);
+    mIdleFdCallback = new IdleFdCallback(this);
     mState = INTERACTION_STATE_IDLE;
-    mThread = std::unique_ptr<std::thread>(new std::thread(&InteractionHandler::Routine, this));
 
     return true;
 }
 
 void InteractionHandler::Exit() {
-    std::unique_lock<std::mutex> lk(mLock);
+    std::lock_guard<std::mutex> lk(mLock);
     if (mState == INTERACTION_STATE_UNINITIALIZED)
         return;
 
-    AbortWaitLocked();
+    CancelTimerLocked();
+    StopWatchingIdleLocked();
     mState = INTERACTION_STATE_UNINITIALIZED;
-    lk.unlock();
-
-    mCond.notify_all();
-    mThread->join();
-
-    close(mEventFd);
     close(mIdleFd);
+    mIdleFd = -1;
 }
 
+// should be called while locked
 void InteractionHandler::PerfLock() {
     ALOGV("%s: acquiring perf lock", __func__);
+    mTier = InteractionTier::HEAVY;
+    clock_gettime(CLOCK_MONOTONIC, &mTierTimespec);
     if (!HintManager::GetInstance()->DoHint("INTERACTION")) {
         ALOGE("%s: do hint INTERACTION failed", __func__);
     }
 }
 
+// should be called while locked
 void InteractionHandler::PerfRel() {
     ALOGV("%s: releasing perf lock", __func__);
-    if (!HintManager::GetInstance()->EndHint("INTERACTION")) {
-        ALOGE("%s: end hint INTERACTION failed", __func__);
+    const char *hint = kInteractionTierHints[static_cast<size_t>(mTier)];
+    struct timespec cur_timespec;
+    clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+    mStats.tierMs[static_cast<size_t>(mTier)] += CalcTimespecDiffMs(mTierTimespec, cur_timespec);
+    if (!HintManager::GetInstance()->EndHint(hint)) {
+        ALOGE("%s: end hint %s failed", __func__, hint);
+    }
+}
+
+// should be called while locked
+void InteractionHandler::SwitchTierLocked(InteractionTier tier) {
+    if (tier == mTier) {
+        return;
+    }
+    ATRACE_INT("interaction_tier", static_cast<int>(tier));
+    const char *from = kInteractionTierHints[static_cast<size_t>(mTier)];
+    const char *to = kInteractionTierHints[static_cast<size_t>(tier)];
+    struct timespec cur_timespec;
+    clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+    mStats.tierMs[static_cast<size_t>(mTier)] += CalcTimespecDiffMs(mTierTimespec, cur_timespec);
+    mStats.numTierChanges++;
+    mTierTimespec = cur_timespec;
+    mTier = tier;
+    // Take the new tier before dropping the old one so the nodes never fall back to their
+    // defaults in between.
+    if (!HintManager::GetInstance()->DoHint(to)) {
+        ALOGE("%s: do hint %s failed", __func__, to);
+    }
+    if (!HintManager::GetInstance()->EndHint(from)) {
+        ALOGE("%s: end hint %s failed", __func__, from);
     }
 }
 
-void InteractionHandler::Acquire(int32_t duration) {
+void InteractionHandler::Acquire(int32_t duration, int32_t app) {
     ATRACE_CALL();
 
     std::lock_guard<std::mutex> lk(mLock);
+    mApp = app;
 
     int inputDuration = duration + kDurationOffsetMs;
     int finalDuration;
@@ -166,6 +225,10 @@ void InteractionHandler::Acquire(int32_t duration) {
 
     struct timespec cur_timespec;
     clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+    mLastTouchTimespec = cur_timespec;
+    // Every touch gets the full boost back, even one the running boost already covers.
+    if (mState != INTERACTION_STATE_IDLE)
+        SwitchTierLocked(InteractionTier::HEAVY);
     if (mState != INTERACTION_STATE_IDLE && finalDuration <= mDurationMs) {
         size_t elapsed_time = CalcTimespecDiffMs(mLastTimespec, cur_timespec);
         // don't hint if previous hint's duration covers this hint's duration
@@ -182,96 +245,239 @@ void InteractionHandler::Acquire(int32_t duration) {
     ALOGV("%s: input: %d final duration: %d", __func__, duration, finalDuration);
 
     if (mState == INTERACTION_STATE_WAITING)
-        AbortWaitLocked();
-    else if (mState == INTERACTION_STATE_IDLE)
+        StopWatchingIdleLocked();
+    if (mShadowWaiting)
+        EndShadowWaitLocked(IdleWaitResult::ABORTED);
+    if (mState == INTERACTION_STATE_IDLE)
         PerfLock();
 
     mState = INTERACTION_STATE_INTERACTION;
-    mCond.notify_one();
+    // Frames usually keep coming for a while after the touch, so don't look at the display
+    // before kWaitMs.
+    ScheduleTimerLocked(kWaitMs);
+}
+
+void InteractionHandler::TimerHandler::handleMessage(const ::android::Message &message) {
+    mHandler->OnTimer(message.what);
 }
 
-void InteractionHandler::Release() {
+int InteractionHandler::IdleFdCallback::handleEvent(int /*fd*/, int /*events*/, void * /*data*/) {
+    return mHandler->OnIdleEvent() ? 1 : 0;
+}
+
+void InteractionHandler::OnTimer(int generation) {
+    ATRACE_CALL();
+    std::optional<InteractionLoad> load;
+    bool stepping = mLoadProvider && kTierStepMs > 0;
+    if (stepping) {
+        std::lock_guard<std::mutex> lk(mLock);
+        if (generation != mTimerGeneration || mState != INTERACTION_STATE_WAITING)
+            stepping = false;
+    }
+    // Sampled outside the lock, it reads procfs. Only this thread calls the provider.
+    if (stepping)
+        load = mLoadProvider();
+
     std::lock_guard<std::mutex> lk(mLock);
-    if (mState == INTERACTION_STATE_WAITING) {
-        ATRACE_CALL();
-        PerfRel();
-        mState = INTERACTION_STATE_IDLE;
-    } else {
-        // clear any wait aborts pending in event fd
-        uint64_t val;
-        ssize_t ret = read(mEventFd, &val, sizeof(val));
+    if (generation != mTimerGeneration)
+        return;
+    if (mState == INTERACTION_STATE_INTERACTION) {
+        StartWaitLocked();
+    } else if (mState == INTERACTION_STATE_WAITING) {
+        if (load && RemainingHoldMsLocked() > 0)
+            SwitchTierLocked(NextInteractionTier(mTier, *load, mTierSupported));
+        ContinueWaitLocked();
+    } else if (mShadowWaiting) {
+        EndShadowWaitLocked(IdleWaitResult::TIMEOUT);
+    }
+}
+
+bool InteractionHandler::OnIdleEvent() {
+    std::lock_guard<std::mutex> lk(mLock);
+    if (!mWatchingIdle)
+        return false;
+    if (!IsIdleLocked())
+        return true;
 
-        ALOGW_IF(ret < 0, "%s: failed to clear eventfd (%zd, %d)", __func__, ret, errno);
+    ALOGV("%s: idle detected", __func__);
+    if (mState == INTERACTION_STATE_WAITING) {
+        ReleaseLocked(IdleWaitResult::IDLE);
+    } else if (mShadowWaiting) {
+        EndShadowWaitLocked(IdleWaitResult::IDLE);
     }
+    return mWatchingIdle;
 }
 
 // should be called while locked
-void InteractionHandler::AbortWaitLocked() {
-    uint64_t val = 1;
-    ssize_t ret = write(mEventFd, &val, sizeof(val));
-    if (ret != sizeof(val))
-        ALOGW("Unable to write to event fd (%zd)", ret);
+void InteractionHandler::ScheduleTimerLocked(int32_t delayMs) {
+    CancelTimerLocked();
+    mLooper->sendMessageDelayed(ms2ns(std::max(delayMs, 0)), mTimerHandler,
+                                ::android::Message(mTimerGeneration));
 }
 
-void InteractionHandler::WaitForIdle(int32_t wait_ms, int32_t timeout_ms) {
-    char data[MAX_LENGTH];
-    ssize_t ret;
-    struct pollfd pfd[2];
+// should be called while locked
+void InteractionHandler::CancelTimerLocked() {
+    mTimerGeneration++;
+    mLooper->removeMessages(mTimerHandler);
+}
+
+// should be called while locked
+void InteractionHandler::StartWaitLocked() {
+    mState = INTERACTION_STATE_WAITING;
+    mStats.numInteractions++;
+    mHoldApp = mApp;
+    mHoldDurationMs = mDurationMs;
+    mHoldMs = HoldTimeMsLocked(mHoldApp, mHoldDurationMs);
+    clock_gettime(CLOCK_MONOTONIC, &mWaitTimespec);
+
+    if (IsIdleLocked()) {
+        ALOGV("%s: already idle", __func__);
+        ReleaseLocked(IdleWaitResult::IDLE);
+        return;
+    }
+    WatchIdleLocked();
+    ContinueWaitLocked();
+}
+
+// should be called while locked
+void InteractionHandler::ContinueWaitLocked() {
+    const int32_t remainingMs = RemainingHoldMsLocked();
+    if (remainingMs <= 0) {
+        ALOGV("%s: timed out waiting for idle", __func__);
+        ReleaseLocked(IdleWaitResult::TIMEOUT);
+        return;
+    }
+    const bool stepping = mLoadProvider && kTierStepMs > 0;
+    ScheduleTimerLocked(stepping ? std::min(remainingMs, kTierStepMs) : remainingMs);
+}
 
+// should be called while locked
+void InteractionHandler::ReleaseLocked(IdleWaitResult result) {
     ATRACE_CALL();
+    PerfRel();
+    mState = INTERACTION_STATE_IDLE;
 
-    ALOGV("%s: wait:%d timeout:%d", __func__, wait_ms, timeout_ms);
+    const bool predicted = mHoldMs < mHoldDurationMs;
+    if (result == IdleWaitResult::IDLE) {
+        mStats.numIdleReleases++;
+        mPredictor.AddSample(mHoldApp, MsSinceLastTouchLocked());
+    } else if (result == IdleWaitResult::TIMEOUT && predicted) {
+        mStats.numPredictedReleases++;
+    } else if (result == IdleWaitResult::TIMEOUT) {
+        mStats.numTimeoutReleases++;
+        mPredictor.AddSample(mHoldApp, mHoldDurationMs);
+    }
 
-    pfd[0].fd = mEventFd;
-    pfd[0].events = POLLIN;
-    pfd[1].fd = mIdleFd;
-    pfd[1].events = POLLPRI | POLLERR;
+    if (result == IdleWaitResult::TIMEOUT && predicted) {
+        // Keep watching the display to learn when it really went idle.
+        mShadowWaiting = true;
+        mShadowReleasedAtMs = MsSinceLastTouchLocked();
+        ScheduleTimerLocked(mHoldDurationMs - mShadowReleasedAtMs);
+    } else {
+        CancelTimerLocked();
+        StopWatchingIdleLocked();
+    }
+}
 
-    ret = poll(pfd, 1, wait_ms);
-    if (ret > 0) {
-        ALOGV("%s: wait aborted", __func__);
-        return;
-    } else if (ret < 0) {
-        ALOGE("%s: error in poll while waiting", __func__);
-        return;
+// should be called while locked
+void InteractionHandler::EndShadowWaitLocked(IdleWaitResult result) {
+    mShadowWaiting = false;
+    const int32_t sinceTouchMs = MsSinceLastTouchLocked();
+    mStats.boostMsSaved += std::max(sinceTouchMs - mShadowReleasedAtMs, 0);
+    if (result == IdleWaitResult::IDLE) {
+        mPredictor.AddSample(mHoldApp, sinceTouchMs);
+    } else if (result == IdleWaitResult::TIMEOUT) {
+        mPredictor.AddSample(mHoldApp, mHoldDurationMs);
+    } else if (result == IdleWaitResult::ABORTED) {
+        mStats.numResumedBeforeIdle++;
     }
+    CancelTimerLocked();
+    StopWatchingIdleLocked();
+}
 
-    ret = pread(mIdleFd, data, sizeof(data), 0);
-    if (!ret) {
-        ALOGE("%s: Unexpected EOF!", __func__);
+// should be called while locked
+void InteractionHandler::WatchIdleLocked() {
+    if (mWatchingIdle)
+        return;
+    // sysfs_notify() raises POLLPRI | POLLERR, while a sysfs file always polls readable. Asking
+    // for no events leaves just the error condition, which epoll reports regardless.
+    if (mLooper->addFd(mIdleFd, ::android::Looper::POLL_CALLBACK, 0, mIdleFdCallback, nullptr) !=
+        1) {
+        ALOGE("%s: unable to watch idle state fd", __func__);
         return;
     }
+    mWatchingIdle = true;
+}
 
-    if (!strncmp(data, "idle", 4)) {
-        ALOGV("%s: already idle", __func__);
+// should be called while locked
+void InteractionHandler::StopWatchingIdleLocked() {
+    if (!mWatchingIdle)
         return;
+    mLooper->removeFd(mIdleFd);
+    mWatchingIdle = false;
+}
+
+// should be called while locked
+bool InteractionHandler::IsIdleLocked() {
+    char data[MAX_LENGTH];
+    // Reading from the start also rearms the notification.
+    ssize_t ret = pread(mIdleFd, data, sizeof(data), 0);
+    if (ret <= 0) {
+        ALOGE("%s: failed to read idle state (%zd, %d)", __func__, ret, errno);
+        return false;
     }
+    return !strncmp(data, "idle", 4);
+}
 
-    ret = poll(pfd, 2, timeout_ms);
-    if (ret < 0)
-        ALOGE("%s: Error on waiting for idle (%zd)", __func__, ret);
-    else if (ret == 0)
-        ALOGV("%s: timed out waiting for idle", __func__);
-    else if (pfd[0].revents)
-        ALOGV("%s: wait for idle aborted", __func__);
-    else if (pfd[1].revents)
-        ALOGV("%s: idle detected", __func__);
+// should be called while locked
+int32_t InteractionHandler::RemainingHoldMsLocked() const {
+    if (mHoldMs < mHoldDurationMs) {
+        // Touches covered by the running boost don't restart the wait, so a predicted hold is
+        // measured from the latest one.
+        return mHoldMs - MsSinceLastTouchLocked();
+    }
+    struct timespec cur_timespec;
+    clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+    return mHoldMs - static_cast<int32_t>(CalcTimespecDiffMs(mWaitTimespec, cur_timespec));
 }
 
-void InteractionHandler::Routine() {
-    pthread_setname_np(pthread_self(), "DispIdle");
-    std::unique_lock<std::mutex> lk(mLock, std::defer_lock);
+// should be called while locked
+int32_t InteractionHandler::HoldTimeMsLocked(int32_t app, int32_t durationMs) const {
+    if (!kPredictIdle) {
+        return durationMs;
+    }
+    const std::optional<int32_t> predictedMs = mPredictor.PredictMs(app);
+    if (!predictedMs) {
+        return durationMs;
+    }
+    // kWaitMs is both the margin on top of the prediction and the shortest hold.
+    return std::min(durationMs, *predictedMs + static_cast<int32_t>(kWaitMs));
+}
 
-    while (true) {
-        lk.lock();
-        mCond.wait(lk, [&] { return mState != INTERACTION_STATE_IDLE; });
-        if (mState == INTERACTION_STATE_UNINITIALIZED)
-            return;
-        mState = INTERACTION_STATE_WAITING;
-        lk.unlock();
+// should be called while locked
+int32_t InteractionHandler::MsSinceLastTouchLocked() const {
+    struct timespec cur_timespec;
+    clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+    return static_cast<int32_t>(CalcTimespecDiffMs(mLastTouchTimespec, cur_timespec));
+}
 
-        WaitForIdle(kWaitMs, mDurationMs);
-        Release();
+void InteractionHandler::DumpToFd(int fd) {
+    std::lock_guard<std::mutex> lk(mLock);
+    std::string buf = ::android::base::StringPrintf(
+            "InteractionHandler: interactions %" PRIu64 ", released on idle %" PRIu64
+            ", predicted %" PRIu64 ", timeout %" PRIu64 "\n"
+            "  boost time saved %" PRIu64 "ms, touches resumed before idle %" PRIu64 "\n",
+            mStats.numInteractions, mStats.numIdleReleases, mStats.numPredictedReleases,
+            mStats.numTimeoutReleases, mStats.boostMsSaved, mStats.numResumedBeforeIdle);
+    buf += ::android::base::StringPrintf(
+            "  tier changes %" PRIu64 ", held light %" PRIu64 "ms, medium %" PRIu64
+            "ms, heavy %" PRIu64 "ms\n",
+            mStats.numTierChanges, mStats.tierMs[0], mStats.tierMs[1], mStats.tierMs[2]);
+    std::ostringstream predictions;
+    mPredictor.DumpToStream(predictions);
+    buf += predictions.str();
+    if (!::android::base::WriteStringToFd(buf, fd)) {
+        ALOGE("Failed to dump InteractionHandler to fd:%d", fd);
     }
 }
 
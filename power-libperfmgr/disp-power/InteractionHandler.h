@@ -16,11 +16,16 @@
 
 #pragma once
 
-#include <condition_variable>
+#include <utils/Looper.h>
+
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
-#include <thread>
+
+#include "IdlePredictor.h"
+#include "InteractionTier.h"
 
 namespace aidl {
 namespace google {
@@ -36,31 +41,116 @@ enum InteractionState {
     INTERACTION_STATE_WAITING,
 };
 
+enum class IdleWaitResult {
+    IDLE,
+    TIMEOUT,
+    ABORTED,
+    ERROR,
+};
+
+// Called on the looper thread while a boost is held. Returns nullopt if no sample is available.
+using InteractionLoadProvider = std::function<std::optional<InteractionLoad>()>;
+
 class InteractionHandler {
   public:
     InteractionHandler();
     ~InteractionHandler();
-    bool Init();
+    // Without a load provider the HEAVY tier is held for the whole interaction. Must be called
+    // before Init().
+    void SetLoadProvider(InteractionLoadProvider provider);
+    // The idle wait runs as timers and an fd watch on |looper|, whose thread must be polling it.
+    bool Init(const ::android::sp<::android::Looper> &looper);
     void Exit();
-    void Acquire(int32_t duration);
+    // |app| is the uid of the app in the foreground, or IdlePredictor::kUnknownApp.
+    void Acquire(int32_t duration, int32_t app);
+    void DumpToFd(int fd);
 
   private:
-    void Release();
-    void WaitForIdle(int32_t wait_ms, int32_t timeout_ms);
-    void AbortWaitLocked();
-    void Routine();
+    struct Stats {
+        uint64_t numInteractions = 0;
+        uint64_t numIdleReleases = 0;
+        uint64_t numPredictedReleases = 0;
+        uint64_t numTimeoutReleases = 0;
+        // Touches arriving after a predicted release but before the display went idle.
+        uint64_t numResumedBeforeIdle = 0;
+        // Boost time the predicted releases saved over holding until idle or the full duration.
+        uint64_t boostMsSaved = 0;
+        uint64_t numTierChanges = 0;
+        // Time held in each tier.
+        std::array<uint64_t, kNumInteractionTiers> tierMs = {};
+    };
+
+    // Runs the timer of the current state once the delay posted for |generation| has passed.
+    class TimerHandler : public ::android::MessageHandler {
+      public:
+        explicit TimerHandler(InteractionHandler *handler) : mHandler(handler) {}
+        void handleMessage(const ::android::Message &message) override;
+
+      private:
+        InteractionHandler *const mHandler;
+    };
+
+    class IdleFdCallback : public ::android::LooperCallback {
+      public:
+        explicit IdleFdCallback(InteractionHandler *handler) : mHandler(handler) {}
+        int handleEvent(int fd, int events, void *data) override;
+
+      private:
+        InteractionHandler *const mHandler;
+    };
+
+    void OnTimer(int generation);
+    // Returns whether the idle fd should stay registered.
+    bool OnIdleEvent();
+    // Replaces the pending timer, if any, with one firing after |delayMs|.
+    void ScheduleTimerLocked(int32_t delayMs);
+    void CancelTimerLocked();
+    void StartWaitLocked();
+    // Releases the boost on timeout, or schedules the next tier step.
+    void ContinueWaitLocked();
+    void ReleaseLocked(IdleWaitResult result);
+    void EndShadowWaitLocked(IdleWaitResult result);
+    void WatchIdleLocked();
+    void StopWatchingIdleLocked();
+    bool IsIdleLocked();
+    int32_t RemainingHoldMsLocked() const;
+    void SwitchTierLocked(InteractionTier tier);
+    int32_t HoldTimeMsLocked(int32_t app, int32_t durationMs) const;
+    int32_t MsSinceLastTouchLocked() const;
 
     void PerfLock();
     void PerfRel();
 
     enum InteractionState mState;
     int mIdleFd;
-    int mEventFd;
     int32_t mDurationMs;
     struct timespec mLastTimespec;
-    std::unique_ptr<std::thread> mThread;
+    // Time of the latest Acquire(), including those covered by the running boost.
+    struct timespec mLastTouchTimespec;
+    int32_t mApp;
+    // The hold being waited out, fixed when the wait starts.
+    int32_t mHoldApp;
+    int32_t mHoldDurationMs;
+    int32_t mHoldMs;
+    struct timespec mWaitTimespec;
+    // Set after a predicted release while the display is still watched to learn when it went
+    // idle; mState is IDLE meanwhile.
+    bool mShadowWaiting;
+    int32_t mShadowReleasedAtMs;
+    bool mWatchingIdle;
+    // Bumped whenever the pending timer is replaced, so a timer that already fired but lost the
+    // race for mLock is dropped.
+    int mTimerGeneration;
+    InteractionLoadProvider mLoadProvider;
+    std::array<bool, kNumInteractionTiers> mTierSupported;
+    InteractionTier mTier;  // protected by mLock
+    struct timespec mTierTimespec;
+    IdlePredictor mPredictor;  // protected by mLock
+    Stats mStats;              // protected by mLock
+    ::android::sp<::android::Looper> mLooper;
+    ::android::sp<TimerHandler> mTimerHandler;
+    ::android::sp<IdleFdCallback> mIdleFdCallback;
     std::mutex mLock;
-    std::condition_variable mCond;
 };
 
 }  // namespace pixel
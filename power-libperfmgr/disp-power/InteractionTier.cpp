@@ -0,0 +1,63 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "InteractionTier.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr double kLowUtilization = 0.5;
+constexpr double kHighUtilization = 0.85;
+
+}  // namespace
+
+InteractionTier NextInteractionTier(InteractionTier current, const InteractionLoad &load,
+                                    const std::array<bool, kNumInteractionTiers> &supported) {
+    int step;
+    if (load.sessionsMissing) {
+        step = static_cast<int>(kNumInteractionTiers);
+    } else if (load.maxCpuUtilization < kLowUtilization) {
+        step = -1;
+    } else if (load.maxCpuUtilization > kHighUtilization) {
+        step = 1;
+    } else {
+        return current;
+    }
+    // Moves |step| supported tiers away from the current one, stopping at the last one available.
+    const int direction = step > 0 ? 1 : -1;
+    int tier = static_cast<int>(current);
+    for (int i = tier + direction; i >= 0 && i < static_cast<int>(kNumInteractionTiers) && step;
+         i += direction) {
+        if (supported[i]) {
+            tier = i;
+            step -= direction;
+        }
+    }
+    return static_cast<InteractionTier>(tier);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Strength of the boost held for an interaction, each backed by its own powerhint.json hint.
+enum class InteractionTier {
+    LIGHT = 0,
+    MEDIUM,
+    HEAVY,
+};
+constexpr size_t kNumInteractionTiers = 3;
+
+// HEAVY keeps the name of the original single hint.
+constexpr std::array<const char *, kNumInteractionTiers> kInteractionTierHints = {
+        "INTERACTION_LIGHT", "INTERACTION_MEDIUM", "INTERACTION"};
+
+// What the held boost is currently needed for, sampled while the display is still busy.
+struct InteractionLoad {
+    // ADPF sessions missed their target since the previous sample.
+    bool sessionsMissing;
+    // Utilization of the busiest CPU since the previous sample, between 0 and 1.
+    double maxCpuUtilization;
+};
+
+// Returns the tier to hold next. Misses go straight back to HEAVY; otherwise the tier steps down
+// one level while the CPUs are mostly idle and up one level while they are close to saturated.
+// |supported| lists which tiers have a hint; unsupported tiers are skipped over.
+InteractionTier NextInteractionTier(InteractionTier current, const InteractionLoad &load,
+                                    const std::array<bool, kNumInteractionTiers> &supported);
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,343 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "PpsClient.h"
+
+#include <android-base/properties.h>
+#include <cutils/sockets.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string_view>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::chrono_literals::operator""ms;
+
+namespace {
+
+constexpr std::string_view kAckTimeoutProperty("vendor.powerhal.pps.ack_timeout_ms");
+constexpr std::string_view kMaxBackoffProperty("vendor.powerhal.pps.max_backoff_ms");
+
+std::string_view KeyOf(std::string_view command) {
+    return command.substr(0, command.find(':'));
+}
+
+}  // namespace
+
+const PpsClientConfig PpsClientConfig::DEFAULT{
+        .minBackoff = 100ms,
+        .maxBackoff = 30000ms,
+        .ackTimeout = 0ms,
+        .maxQueued = 8,
+};
+
+PpsClientConfig PpsClientConfig::ReadFromSystemProperties() {
+    PpsClientConfig config = DEFAULT;
+    config.ackTimeout = std::chrono::milliseconds(::android::base::GetUintProperty<uint32_t>(
+            kAckTimeoutProperty.data(), DEFAULT.ackTimeout.count()));
+    config.maxBackoff = std::chrono::milliseconds(::android::base::GetUintProperty<uint32_t>(
+            kMaxBackoffProperty.data(), DEFAULT.maxBackoff.count()));
+    config.maxBackoff = std::max(config.maxBackoff, config.minBackoff);
+    return config;
+}
+
+bool PpsClientConfig::operator==(const PpsClientConfig &other) const {
+    return minBackoff == other.minBackoff && maxBackoff == other.maxBackoff &&
+           ackTimeout == other.ackTimeout && maxQueued == other.maxQueued;
+}
+
+std::ostream &operator<<(std::ostream &stream, const PpsClientConfig &config) {
+    stream << "PpsClientConfig(";
+    stream << "minBackoff=" << config.minBackoff.count() << "ms, ";
+    stream << "maxBackoff=" << config.maxBackoff.count() << "ms, ";
+    stream << "ackTimeout=" << config.ackTimeout.count() << "ms, ";
+    stream << "maxQueued=" << config.maxQueued;
+    stream << ")";
+    return stream;
+}
+
+PpsClient::PpsClient(const ::android::sp<::android::Looper> &looper, PpsClientConfig config,
+                     Connector connector)
+    : mLooper(looper),
+      mConfig(config),
+      mConnector(std::move(connector)),
+      mStarted(false),
+      mBackoff(config.minBackoff),
+      mWriteOffset(0),
+      mAwaitingAck(false) {}
+
+PpsClient::Connector PpsClient::DaemonConnector() {
+    return [] {
+        constexpr const char kPpsDaemon[] = "pps";
+        return ::android::base::unique_fd(
+                socket_local_client(kPpsDaemon, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM));
+    };
+}
+
+void PpsClient::Start() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mStarted) {
+        return;
+    }
+    mStarted = true;
+    PostLocked(MESSAGE_CONNECT, 0ms);
+}
+
+void PpsClient::Send(const std::string &command) {
+    std::lock_guard<std::mutex> lock(mLock);
+    EnqueueLocked(command);
+    if (mSocket.ok()) {
+        PostLocked(MESSAGE_FLUSH, 0ms);
+    }
+}
+
+bool PpsClient::IsConnected() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mSocket.ok();
+}
+
+PpsClient::Stats PpsClient::GetStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStats;
+}
+
+void PpsClient::DumpToStream(std::ostream &stream) {
+    std::lock_guard<std::mutex> lock(mLock);
+    stream << "PpsClient: " << (mSocket.ok() ? "connected" : "disconnected") << ", "
+           << mQueue.size() << " queued\n";
+    stream << "  connects " << mStats.numConnects << " (failed " << mStats.numConnectFailures
+           << "), disconnects " << mStats.numDisconnects << "\n";
+    stream << "  sent " << mStats.numSent << ", collapsed " << mStats.numCollapsed << ", dropped "
+           << mStats.numDropped << ", acks " << mStats.numAcks << ", ack timeouts "
+           << mStats.numAckTimeouts << "\n";
+}
+
+void PpsClient::handleMessage(const ::android::Message &message) {
+    std::lock_guard<std::mutex> lock(mLock);
+    switch (message.what) {
+        case MESSAGE_CONNECT:
+            ConnectLocked();
+            break;
+        case MESSAGE_FLUSH:
+            FlushLocked();
+            break;
+        case MESSAGE_ACK_TIMEOUT:
+            if (mAwaitingAck) {
+                mStats.numAckTimeouts++;
+                DisconnectLocked("no reply");
+            }
+            break;
+    }
+}
+
+int PpsClient::handleEvent(int fd, int events, void * /*data*/) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (fd != mSocket.get()) {
+        return 0;
+    }
+    if (events & (::android::Looper::EVENT_ERROR | ::android::Looper::EVENT_HANGUP)) {
+        DisconnectLocked("hung up");
+        return 0;
+    }
+    if (events & ::android::Looper::EVENT_INPUT) {
+        char buf[64];
+        const ssize_t ret = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)));
+        if (ret == 0 || (ret < 0 && errno != EAGAIN)) {
+            DisconnectLocked(ret == 0 ? "closed by daemon" : "read failed");
+            return 0;
+        }
+        // Anything the daemon sends acknowledges the command in flight; unsolicited data is
+        // dropped.
+        if (ret > 0 && mAwaitingAck) {
+            mStats.numAcks++;
+            mAwaitingAck = false;
+            mLooper->removeMessages(this, MESSAGE_ACK_TIMEOUT);
+            DeliveredLocked();
+        }
+    }
+    FlushLocked();
+    return mSocket.ok() ? 1 : 0;
+}
+
+// should be called while locked
+void PpsClient::ConnectLocked() {
+    if (mSocket.ok()) {
+        return;
+    }
+    ::android::base::unique_fd socket = mConnector();
+    if (!socket.ok()) {
+        if (mStats.numConnectFailures++ == 0) {
+            ALOGW("Connecting to PPS daemon failed (%s), retrying", strerror(errno));
+        }
+        ScheduleReconnectLocked();
+        return;
+    }
+    const int flags = fcntl(socket.get(), F_GETFL);
+    if (flags < 0 || fcntl(socket.get(), F_SETFL, flags | O_NONBLOCK) < 0) {
+        ALOGE("Failed to make PPS socket non-blocking (%s)", strerror(errno));
+        mStats.numConnectFailures++;
+        ScheduleReconnectLocked();
+        return;
+    }
+    ALOGI("Connected to PPS daemon");
+    mSocket = std::move(socket);
+    mStats.numConnects++;
+    mBackoff = mConfig.minBackoff;
+    mWriteOffset = 0;
+    mAwaitingAck = false;
+
+    // The daemon may have restarted and lost what was set before.
+    for (auto it = mDelivered.rbegin(); it != mDelivered.rend(); ++it) {
+        const bool queued = std::any_of(mQueue.begin(), mQueue.end(), [&](const auto &command) {
+            return KeyOf(command) == it->first;
+        });
+        if (!queued) {
+            mQueue.push_front(it->second);
+        }
+    }
+    WatchSocketLocked(false);
+    FlushLocked();
+}
+
+// should be called while locked
+void PpsClient::DisconnectLocked(const char *reason) {
+    ALOGW("Lost PPS daemon connection (%s)", reason);
+    mLooper->removeFd(mSocket.get());
+    mLooper->removeMessages(this, MESSAGE_ACK_TIMEOUT);
+    mSocket.reset();
+    mStats.numDisconnects++;
+    // A command cut off or not acknowledged is sent again, in full, on the next connection.
+    mWriteOffset = 0;
+    mAwaitingAck = false;
+    ScheduleReconnectLocked();
+}
+
+// should be called while locked
+void PpsClient::ScheduleReconnectLocked() {
+    PostLocked(MESSAGE_CONNECT, mBackoff);
+    mBackoff = std::min(mBackoff * 2, mConfig.maxBackoff);
+}
+
+// should be called while locked
+void PpsClient::DeliveredLocked() {
+    const std::string &command = mQueue.front();
+    mDelivered[std::string(KeyOf(command))] = command;
+    mStats.numSent++;
+    mQueue.pop_front();
+}
+
+// should be called while locked
+void PpsClient::FlushLocked() {
+    while (mSocket.ok() && !mQueue.empty() && !mAwaitingAck) {
+        const std::string &command = mQueue.front();
+        const ssize_t ret =
+                TEMP_FAILURE_RETRY(send(mSocket.get(), command.data() + mWriteOffset,
+                                        command.size() - mWriteOffset, MSG_NOSIGNAL));
+        if (ret < 0 && errno == EAGAIN) {
+            WatchSocketLocked(true);
+            return;
+        }
+        if (ret < 0) {
+            ALOGE("Failed to send pps command '%s' over socket (%s)", command.c_str(),
+                  strerror(errno));
+            DisconnectLocked("write failed");
+            return;
+        }
+        mWriteOffset += ret;
+        if (mWriteOffset < command.size()) {
+            continue;
+        }
+        mWriteOffset = 0;
+        if (mConfig.ackTimeout > 0ms) {
+            mAwaitingAck = true;
+            PostLocked(MESSAGE_ACK_TIMEOUT, mConfig.ackTimeout);
+        } else {
+            DeliveredLocked();
+        }
+    }
+    if (mSocket.ok()) {
+        WatchSocketLocked(false);
+    }
+}
+
+// should be called while locked
+void PpsClient::EnqueueLocked(const std::string &command) {
+    const std::string_view key = KeyOf(command);
+    // The front is not replaceable once part of it is on the wire.
+    const bool frontInFlight = mWriteOffset > 0 || mAwaitingAck;
+    const auto replaceable = mQueue.begin() + (frontInFlight && !mQueue.empty() ? 1 : 0);
+    auto pending = std::find_if(replaceable, mQueue.end(),
+                                [&](const auto &queued) { return KeyOf(queued) == key; });
+    if (pending != mQueue.end()) {
+        mStats.numCollapsed++;
+        *pending = command;
+        return;
+    }
+
+    // What the daemon ends up with once the queue drains, ignoring this command.
+    const std::string *effective = nullptr;
+    if (frontInFlight && !mQueue.empty() && KeyOf(mQueue.front()) == key) {
+        effective = &mQueue.front();
+    } else if (auto it = mDelivered.find(std::string(key)); it != mDelivered.end()) {
+        effective = &it->second;
+    }
+    if (effective && *effective == command) {
+        mStats.numCollapsed++;
+        return;
+    }
+
+    if (mQueue.size() >= mConfig.maxQueued && replaceable != mQueue.end()) {
+        ALOGW("PPS command queue full, dropping '%s'", replaceable->c_str());
+        mStats.numDropped++;
+        mQueue.erase(replaceable);
+    }
+    mQueue.push_back(command);
+}
+
+// should be called while locked
+void PpsClient::WatchSocketLocked(bool writable) {
+    const int events =
+            ::android::Looper::EVENT_INPUT | (writable ? ::android::Looper::EVENT_OUTPUT : 0);
+    if (mLooper->addFd(mSocket.get(), ::android::Looper::POLL_CALLBACK, events, this, nullptr) !=
+        1) {
+        ALOGE("Failed to watch PPS socket");
+    }
+}
+
+// should be called while locked
+void PpsClient::PostLocked(What what, std::chrono::milliseconds delay) {
+    mLooper->removeMessages(this, what);
+    mLooper->sendMessageDelayed(ms2ns(delay.count()), this, ::android::Message(what));
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+#include <utils/Looper.h>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+struct PpsClientConfig {
+    static PpsClientConfig ReadFromSystemProperties();
+    static const PpsClientConfig DEFAULT;
+
+    // Delay before the first reconnection attempt, doubled after every failure up to maxBackoff.
+    std::chrono::milliseconds minBackoff;
+    std::chrono::milliseconds maxBackoff;
+    // How long to wait for the daemon to reply to a command before reconnecting. 0 if the daemon
+    // doesn't reply, in which case a command counts as delivered once written.
+    std::chrono::milliseconds ackTimeout;
+    // Commands waiting for the connection beyond this drop the oldest one.
+    size_t maxQueued;
+
+    bool operator==(const PpsClientConfig &other) const;
+};
+
+std::ostream &operator<<(std::ostream &os, const PpsClientConfig &config);
+
+// Client of the pps daemon socket. Commands are queued and written from the looper thread on a
+// non-blocking socket, so callers never wait on the daemon. The connection is retried with
+// exponential backoff until the daemon is up, and after it goes away.
+//
+// Commands are "<key>:<value>". A queued command replaces one for the same key still waiting to be
+// written, so toggles that happen while disconnected collapse into the latest one. The last
+// command written for each key is sent again after reconnecting, since a restarted daemon has
+// lost it. Thread-safe.
+class PpsClient : public ::android::MessageHandler, public ::android::LooperCallback {
+  public:
+    // Returns a connected stream socket, or -1.
+    using Connector = std::function<::android::base::unique_fd()>;
+
+    struct Stats {
+        uint64_t numConnects = 0;
+        uint64_t numConnectFailures = 0;
+        uint64_t numDisconnects = 0;
+        uint64_t numSent = 0;
+        // Replaced by a later command for the same key before they were written.
+        uint64_t numCollapsed = 0;
+        // Dropped because the queue was full.
+        uint64_t numDropped = 0;
+        uint64_t numAcks = 0;
+        uint64_t numAckTimeouts = 0;
+    };
+
+    PpsClient(const ::android::sp<::android::Looper> &looper, PpsClientConfig config,
+              Connector connector);
+    // Connects to the reserved "pps" socket.
+    static Connector DaemonConnector();
+
+    // Starts connecting. Commands sent before are kept until connected.
+    void Start();
+    void Send(const std::string &command);
+    bool IsConnected();
+    Stats GetStats();
+    void DumpToStream(std::ostream &stream);
+
+    void handleMessage(const ::android::Message &message) override;
+    int handleEvent(int fd, int events, void *data) override;
+
+  private:
+    enum What {
+        MESSAGE_CONNECT,
+        MESSAGE_FLUSH,
+        MESSAGE_ACK_TIMEOUT,
+    };
+
+    void ConnectLocked();
+    void DisconnectLocked(const char *reason);
+    void ScheduleReconnectLocked();
+    void DeliveredLocked();
+    void FlushLocked();
+    void EnqueueLocked(const std::string &command);
+    void WatchSocketLocked(bool writable);
+    void PostLocked(What what, std::chrono::milliseconds delay);
+
+    const ::android::sp<::android::Looper> mLooper;
+    const PpsClientConfig mConfig;
+    const Connector mConnector;
+    std::mutex mLock;
+    // Everything below is protected by mLock.
+    bool mStarted;
+    ::android::base::unique_fd mSocket;
+    std::chrono::milliseconds mBackoff;
+    std::deque<std::string> mQueue;
+    // Bytes of the front of mQueue already written.
+    size_t mWriteOffset;
+    // The front of mQueue was written and waits for the daemon to reply.
+    bool mAwaitingAck;
+    // Last command delivered per key, sent again after reconnecting.
+    std::map<std::string, std::string> mDelivered;
+    Stats mStats;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "disp-power/DisplayPowerPolicy.h"
+
+using std::chrono_literals::operator""ms;
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+const DisplayPowerPolicy::Clock::time_point kStart =
+        DisplayPowerPolicy::Clock::time_point() + 1000ms;
+
+constexpr DisplayPowerInputs kLowPower = {.lowPowerMode = true};
+constexpr DisplayPowerInputs kNormal = {};
+
+}  // namespace
+
+TEST(DisplayPowerPolicyTest, lowPowerIsEnteredAfterDelay) {
+    DisplayPowerPolicy policy(100ms, kStart);
+    EXPECT_EQ(std::nullopt, policy.Update(kLowPower, kStart));
+    EXPECT_EQ(kStart + 100ms, policy.GetDeadline());
+    EXPECT_EQ(std::nullopt, policy.Update(kLowPower, kStart + 99ms));
+    EXPECT_EQ(DisplayPowerState::LOW_POWER, policy.Update(kLowPower, kStart + 100ms));
+    EXPECT_EQ(std::nullopt, policy.GetDeadline());
+}
+
+TEST(DisplayPowerPolicyTest, flappingNeverLeavesNormal) {
+    DisplayPowerPolicy policy(100ms, kStart);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(std::nullopt, policy.Update(kLowPower, kStart + i * 60ms));
+        EXPECT_EQ(std::nullopt, policy.Update(kNormal, kStart + i * 60ms + 30ms));
+    }
+    EXPECT_EQ(DisplayPowerState::NORMAL, policy.GetState());
+    EXPECT_EQ(0u, policy.GetNumTransitions());
+}
+
+TEST(DisplayPowerPolicyTest, returnToNormalIsImmediate) {
+    DisplayPowerPolicy policy(100ms, kStart);
+    policy.Update(kLowPower, kStart);
+    policy.Update(kLowPower, kStart + 100ms);
+    EXPECT_EQ(DisplayPowerState::NORMAL, policy.Update(kNormal, kStart + 101ms));
+    // Sessions keep the display at full power, even in battery saver.
+    EXPECT_EQ(std::nullopt,
+              policy.Update({.lowPowerMode = true, .sessionsActive = true}, kStart + 300ms));
+    EXPECT_EQ(std::nullopt, policy.GetDeadline());
+}
+
+TEST(DisplayPowerPolicyTest, inactiveOverridesLowPower) {
+    DisplayPowerPolicy policy(100ms, kStart);
+    const DisplayPowerInputs inactive = {.lowPowerMode = true, .displayInactive = true};
+    policy.Update(kLowPower, kStart);
+    policy.Update(kLowPower, kStart + 100ms);
+    EXPECT_EQ(std::nullopt, policy.Update(inactive, kStart + 200ms));
+    EXPECT_EQ(DisplayPowerState::INACTIVE, policy.Update(inactive, kStart + 300ms));
+    EXPECT_EQ(DisplayPowerState::LOW_POWER, policy.Update(kLowPower, kStart + 400ms));
+}
+
+TEST(DisplayPowerPolicyTest, residencyCoversEveryState) {
+    DisplayPowerPolicy policy(100ms, kStart);
+    policy.Update(kLowPower, kStart);
+    policy.Update(kLowPower, kStart + 100ms);
+    policy.Update({.displayInactive = true}, kStart + 400ms);
+    policy.Update({.displayInactive = true}, kStart + 500ms);
+    const auto residency = policy.GetResidency(kStart + 1500ms);
+    EXPECT_EQ(100ms, residency[static_cast<size_t>(DisplayPowerState::NORMAL)]);
+    EXPECT_EQ(400ms, residency[static_cast<size_t>(DisplayPowerState::LOW_POWER)]);
+    EXPECT_EQ(1000ms, residency[static_cast<size_t>(DisplayPowerState::INACTIVE)]);
+    EXPECT_EQ(2u, policy.GetNumTransitions());
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
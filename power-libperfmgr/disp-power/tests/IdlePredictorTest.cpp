@@ -0,0 +1,95 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <sstream>
+
+#include "disp-power/IdlePredictor.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+TEST(DecayingQuantileTest, convergesToQuantile) {
+    DecayingQuantile quantile(0.9, 0.02);
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dist(0, 1000);
+    for (int i = 0; i < 5000; i++) {
+        quantile.Add(dist(gen));
+    }
+    EXPECT_NEAR(900, quantile.Get(), 50);
+}
+
+TEST(DecayingQuantileTest, followsShift) {
+    DecayingQuantile quantile(0.9, 0.05);
+    for (int i = 0; i < 200; i++) {
+        quantile.Add(1000);
+    }
+    EXPECT_NEAR(1000, quantile.Get(), 1);
+    for (int i = 0; i < 200; i++) {
+        quantile.Add(300);
+    }
+    EXPECT_LT(quantile.Get(), 400);
+}
+
+TEST(IdlePredictorTest, needsHistoryBeforePredicting) {
+    IdlePredictor predictor;
+    EXPECT_FALSE(predictor.PredictMs(10100));
+    for (int i = 0; i < 7; i++) {
+        predictor.AddSample(10100, 500);
+    }
+    EXPECT_FALSE(predictor.PredictMs(10100));
+    predictor.AddSample(10100, 500);
+    EXPECT_EQ(500, predictor.PredictMs(10100));
+}
+
+TEST(IdlePredictorTest, appsAreLearnedSeparately) {
+    IdlePredictor predictor;
+    for (int i = 0; i < 50; i++) {
+        predictor.AddSample(10100, 300);
+        predictor.AddSample(IdlePredictor::kUnknownApp, 2000);
+    }
+    EXPECT_EQ(300, predictor.PredictMs(10100));
+    EXPECT_EQ(2000, predictor.PredictMs(IdlePredictor::kUnknownApp));
+    EXPECT_FALSE(predictor.PredictMs(10200));
+
+    std::ostringstream stream;
+    predictor.DumpToStream(stream);
+    EXPECT_NE(std::string::npos, stream.str().find("uid 10100: touch-to-idle p90 300ms"));
+}
+
+TEST(IdlePredictorTest, leastRecentlyUsedAppIsDropped) {
+    IdlePredictor predictor;
+    for (int32_t app = 0; app < 40; app++) {
+        for (int i = 0; i < 8; i++) {
+            predictor.AddSample(app, 100);
+        }
+    }
+    EXPECT_FALSE(predictor.PredictMs(0));
+    EXPECT_TRUE(predictor.PredictMs(39));
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "disp-power/InteractionTier.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr std::array<bool, kNumInteractionTiers> kAllTiers = {true, true, true};
+constexpr InteractionLoad kIdle = {.sessionsMissing = false, .maxCpuUtilization = 0.2};
+constexpr InteractionLoad kBusy = {.sessionsMissing = false, .maxCpuUtilization = 0.7};
+constexpr InteractionLoad kSaturated = {.sessionsMissing = false, .maxCpuUtilization = 0.95};
+constexpr InteractionLoad kMissing = {.sessionsMissing = true, .maxCpuUtilization = 0.2};
+
+}  // namespace
+
+TEST(InteractionTierTest, stepsDownWhileIdle) {
+    EXPECT_EQ(InteractionTier::MEDIUM,
+              NextInteractionTier(InteractionTier::HEAVY, kIdle, kAllTiers));
+    EXPECT_EQ(InteractionTier::LIGHT,
+              NextInteractionTier(InteractionTier::MEDIUM, kIdle, kAllTiers));
+    EXPECT_EQ(InteractionTier::LIGHT,
+              NextInteractionTier(InteractionTier::LIGHT, kIdle, kAllTiers));
+}
+
+TEST(InteractionTierTest, holdsWhileBusy) {
+    EXPECT_EQ(InteractionTier::MEDIUM,
+              NextInteractionTier(InteractionTier::MEDIUM, kBusy, kAllTiers));
+}
+
+TEST(InteractionTierTest, stepsUpWhenSaturated) {
+    EXPECT_EQ(InteractionTier::MEDIUM,
+              NextInteractionTier(InteractionTier::LIGHT, kSaturated, kAllTiers));
+    EXPECT_EQ(InteractionTier::HEAVY,
+              NextInteractionTier(InteractionTier::HEAVY, kSaturated, kAllTiers));
+}
+
+TEST(InteractionTierTest, missesRestoreHeavy) {
+    EXPECT_EQ(InteractionTier::HEAVY,
+              NextInteractionTier(InteractionTier::LIGHT, kMissing, kAllTiers));
+}
+
+TEST(InteractionTierTest, unsupportedTiersAreSkipped) {
+    const std::array<bool, kNumInteractionTiers> noMedium = {true, false, true};
+    EXPECT_EQ(InteractionTier::LIGHT,
+              NextInteractionTier(InteractionTier::HEAVY, kIdle, noMedium));
+    EXPECT_EQ(InteractionTier::HEAVY,
+              NextInteractionTier(InteractionTier::LIGHT, kSaturated, noMedium));
+    const std::array<bool, kNumInteractionTiers> heavyOnly = {false, false, true};
+    EXPECT_EQ(InteractionTier::HEAVY,
+              NextInteractionTier(InteractionTier::HEAVY, kIdle, heavyOnly));
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <thread>
+
+#include "disp-power/PpsClient.h"
+
+using std::chrono_literals::operator""ms;
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::unique_fd;
+
+// The daemon is stood in for by the far end of a socket pair, handed out by the connector once
+// the test makes it available.
+class PpsClientTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        mLooper = new ::android::Looper(true);
+        mLooperThread = std::thread([this] {
+            while (!mStop) {
+                mLooper->pollOnce(10);
+            }
+        });
+    }
+
+    void TearDown() override {
+        mStop = true;
+        mLooperThread.join();
+    }
+
+    ::android::sp<PpsClient> MakeClient(std::chrono::milliseconds ackTimeout = 0ms) {
+        PpsClientConfig config = {
+                .minBackoff = 5ms, .maxBackoff = 20ms, .ackTimeout = ackTimeout, .maxQueued = 4};
+        return new PpsClient(mLooper, config, [this] {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (mPending.empty()) {
+                errno = ECONNREFUSED;
+                return unique_fd();
+            }
+            unique_fd fd = std::move(mPending.front());
+            mPending.pop_front();
+            return fd;
+        });
+    }
+
+    // Starts a daemon, returning its end of the connection.
+    unique_fd StartDaemon() {
+        int fds[2];
+        EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        std::lock_guard<std::mutex> lock(mLock);
+        mPending.emplace_back(fds[0]);
+        return unique_fd(fds[1]);
+    }
+
+    // Reads from the daemon end until |size| bytes arrived or |timeout| passed.
+    static std::string Receive(int fd, size_t size,
+                               std::chrono::milliseconds timeout = std::chrono::seconds(2)) {
+        std::string received;
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (received.size() < size) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now());
+            struct pollfd pfd = {.fd = fd, .events = POLLIN};
+            if (left <= 0ms || poll(&pfd, 1, left.count()) <= 0) {
+                break;
+            }
+            char buf[64];
+            const ssize_t ret = read(fd, buf, sizeof(buf));
+            if (ret <= 0) {
+                break;
+            }
+            received.append(buf, ret);
+        }
+        return received;
+    }
+
+    static bool WaitFor(const std::function<bool()> &condition) {
+        for (int i = 0; i < 200; i++) {
+            if (condition()) {
+                return true;
+            }
+            std::this_thread::sleep_for(10ms);
+        }
+        return false;
+    }
+
+    ::android::sp<::android::Looper> mLooper;
+
+  private:
+    std::thread mLooperThread;
+    std::atomic<bool> mStop = false;
+    std::mutex mLock;
+    std::deque<unique_fd> mPending;
+};
+
+TEST_F(PpsClientTest, connectsOnceDaemonIsUp) {
+    ::android::sp<PpsClient> client = MakeClient();
+    client->Start();
+    ASSERT_TRUE(WaitFor([&] { return client->GetStats().numConnectFailures >= 2; }));
+    client->Send("foss:on");
+    EXPECT_FALSE(client->IsConnected());
+
+    unique_fd daemon = StartDaemon();
+    EXPECT_EQ("foss:on", Receive(daemon.get(), 7));
+    EXPECT_TRUE(client->IsConnected());
+}
+
+TEST_F(PpsClientTest, togglesCollapseWhileDisconnected) {
+    ::android::sp<PpsClient> client = MakeClient();
+    client->Start();
+    client->Send("foss:on");
+    client->Send("foss:off");
+    client->Send("foss:on");
+    EXPECT_EQ(2u, client->GetStats().numCollapsed);
+
+    unique_fd daemon = StartDaemon();
+    EXPECT_EQ("foss:on", Receive(daemon.get(), 100, 200ms));
+    EXPECT_EQ(1u, client->GetStats().numSent);
+}
+
+TEST_F(PpsClientTest, repeatedCommandIsDropped) {
+    ::android::sp<PpsClient> client = MakeClient();
+    unique_fd daemon = StartDaemon();
+    client->Start();
+    client->Send("foss:on");
+    EXPECT_EQ("foss:on", Receive(daemon.get(), 7));
+    ASSERT_TRUE(WaitFor([&] { return client->GetStats().numSent == 1; }));
+
+    client->Send("foss:on");
+    EXPECT_EQ("", Receive(daemon.get(), 1, 100ms));
+    client->Send("foss:off");
+    EXPECT_EQ("foss:off", Receive(daemon.get(), 8));
+}
+
+TEST_F(PpsClientTest, stateIsRestoredAfterReconnect) {
+    ::android::sp<PpsClient> client = MakeClient();
+    unique_fd daemon = StartDaemon();
+    client->Start();
+    client->Send("foss:on");
+    EXPECT_EQ("foss:on", Receive(daemon.get(), 7));
+
+    unique_fd restarted = StartDaemon();
+    daemon.reset();
+    EXPECT_EQ("foss:on", Receive(restarted.get(), 7));
+    EXPECT_EQ(1u, client->GetStats().numDisconnects);
+}
+
+TEST_F(PpsClientTest, unacknowledgedCommandIsResent) {
+    ::android::sp<PpsClient> client = MakeClient(20ms);
+    unique_fd daemon = StartDaemon();
+    client->Start();
+    client->Send("foss:on");
+    // Received but never answered.
+    EXPECT_EQ("foss:on", Receive(daemon.get(), 7));
+
+    unique_fd restarted = StartDaemon();
+    EXPECT_EQ("foss:on", Receive(restarted.get(), 7));
+    ASSERT_EQ(2, write(restarted.get(), "ok", 2));
+    ASSERT_TRUE(WaitFor([&] { return client->GetStats().numAcks == 1; }));
+    EXPECT_EQ(1u, client->GetStats().numAckTimeouts);
+    EXPECT_EQ(1u, client->GetStats().numSent);
+}
+
+TEST_F(PpsClientTest, queueIsBounded) {
+    ::android::sp<PpsClient> client = MakeClient();
+    for (const char *command : {"a:1", "b:1", "c:1", "d:1", "e:1"}) {
+        client->Send(command);
+    }
+    EXPECT_EQ(1u, client->GetStats().numDropped);
+
+    unique_fd daemon = StartDaemon();
+    client->Start();
+    EXPECT_EQ("b:1c:1d:1e:1", Receive(daemon.get(), 12));
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl